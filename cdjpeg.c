@@ -179,3 +179,15 @@ write_stdout (void)
 #endif
   return output_file;
 }
+
+
+/*
+ * Test whether we can reposition within a file, as the BMP writer would
+ * like to do.  Pipes and terminals fail this test.
+ */
+
+GLOBAL(boolean)
+file_is_seekable (FILE * file)
+{
+  return (fseek(file, 0L, SEEK_CUR) == 0);
+}
@@ -44,9 +44,8 @@ jpeg_start_compress (j_compress_ptr cinfo, boolean write_all_tables)
   if (write_all_tables)
     jpeg_suppress_tables(cinfo, FALSE);	/* mark all tables to be written */
 
-  /* (Re)initialize error mgr and destination modules */
+  /* (Re)initialize error mgr; the destination follows master control */
   (*cinfo->err->reset_error_mgr) ((j_common_ptr) cinfo);
-  (*cinfo->dest->init_destination) (cinfo);
   /* Perform master selection of active modules */
   jinit_compress_master(cinfo);
   /* Set up for the first pass */
@@ -218,6 +218,9 @@ compress_data (j_compress_ptr cinfo, JSAMPIMAGE input_buf)
   /* Completed the iMCU row, advance counters for next one */
   coef->iMCU_row_num++;
   start_iMCU_row(cinfo);
+  /* Let a streaming destination pass on the data */
+  if (cinfo->master->iMCU_row_done != NULL)
+    (*cinfo->master->iMCU_row_done) (cinfo);
   return TRUE;
 }
 
@@ -396,6 +399,9 @@ compress_output (j_compress_ptr cinfo, JSAMPIMAGE input_buf)
   /* Completed the iMCU row, advance counters for next one */
   coef->iMCU_row_num++;
   start_iMCU_row(cinfo);
+  /* Let a streaming destination pass on the data */
+  if (cinfo->master->iMCU_row_done != NULL)
+    (*cinfo->master->iMCU_row_done) (cinfo);
   return TRUE;
 }
 
@@ -13,6 +13,14 @@
 #include "jinclude.h"
 #include "jpeglib.h"
 
+/* The SSE2 code handles 8-bit samples in 3-byte RGB pixels */
+#ifdef JSIMD_SSE2
+#if BITS_IN_JSAMPLE == 8 && RGB_PIXELSIZE == 3
+#define COLOR_SSE2_SUPPORTED
+#include <emmintrin.h>
+#endif
+#endif
+
 
 /* Private subobject */
 
@@ -20,7 +28,7 @@ typedef struct {
   struct jpeg_color_converter pub; /* public fields */
 
   /* Private state for RGB->YCC conversion */
-  INT32 * rgb_ycc_tab;		/* => table for RGB to YCbCr conversion */
+  const INT32 * rgb_ycc_tab;	/* => table for RGB to YCbCr conversion */
 } my_color_converter;
 
 typedef my_color_converter * my_cconvert_ptr;
@@ -73,10 +81,12 @@ typedef my_color_converter * my_cconvert_ptr;
 #define ONE_HALF	((INT32) 1 << (SCALEBITS-1))
 #define FIX(x)		((INT32) ((x) * (1L<<SCALEBITS) + 0.5))
 
-/* We allocate one big table and divide it up into eight parts, instead of
- * doing eight alloc_small requests.  This lets us use a single table base
+/* We use one big table and divide it up into eight parts, instead of
+ * having eight separate tables.  This lets us use a single table base
  * address, which can be held in a register in the inner loops on many
  * machines (more than can hold all eight addresses, anyway).
+ * The table does not depend on the image, so it is a constant shared by
+ * all compression objects.
  */
 
 #define R_Y_OFF		0			/* offset to R => Y section */
@@ -91,40 +101,27 @@ typedef my_color_converter * my_cconvert_ptr;
 #define TABLE_SIZE	(8*(MAXJSAMPLE+1))
 
 
-/*
- * Initialize for RGB->YCC colorspace conversion.
+#define R_Y(i)		(FIX(0.299) * (i))
+#define G_Y(i)		(FIX(0.587) * (i))
+#define B_Y(i)		(FIX(0.114) * (i) + ONE_HALF)
+#define R_CB(i)		((-FIX(0.168735892)) * (i))
+#define G_CB(i)		((-FIX(0.331264108)) * (i))
+/* We use a rounding fudge-factor of 0.5-epsilon for Cb and Cr.
+ * This ensures that the maximum output will round to MAXJSAMPLE
+ * not MAXJSAMPLE+1, and thus that we don't have to range-limit.
  */
-
-METHODDEF(void)
-rgb_ycc_start (j_compress_ptr cinfo)
-{
-  my_cconvert_ptr cconvert = (my_cconvert_ptr) cinfo->cconvert;
-  INT32 * rgb_ycc_tab;
-  INT32 i;
-
-  /* Allocate and fill in the conversion tables. */
-  cconvert->rgb_ycc_tab = rgb_ycc_tab = (INT32 *)
-    (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
-				(TABLE_SIZE * SIZEOF(INT32)));
-
-  for (i = 0; i <= MAXJSAMPLE; i++) {
-    rgb_ycc_tab[i+R_Y_OFF] = FIX(0.299) * i;
-    rgb_ycc_tab[i+G_Y_OFF] = FIX(0.587) * i;
-    rgb_ycc_tab[i+B_Y_OFF] = FIX(0.114) * i   + ONE_HALF;
-    rgb_ycc_tab[i+R_CB_OFF] = (-FIX(0.168735892)) * i;
-    rgb_ycc_tab[i+G_CB_OFF] = (-FIX(0.331264108)) * i;
-    /* We use a rounding fudge-factor of 0.5-epsilon for Cb and Cr.
-     * This ensures that the maximum output will round to MAXJSAMPLE
-     * not MAXJSAMPLE+1, and thus that we don't have to range-limit.
-     */
-    rgb_ycc_tab[i+B_CB_OFF] = FIX(0.5) * i    + CBCR_OFFSET + ONE_HALF-1;
+#define B_CB(i)		(FIX(0.5) * (i) + CBCR_OFFSET + ONE_HALF-1)
 /*  B=>Cb and R=>Cr tables are the same
-    rgb_ycc_tab[i+R_CR_OFF] = FIX(0.5) * i    + CBCR_OFFSET + ONE_HALF-1;
+#define R_CR(i)		(FIX(0.5) * (i) + CBCR_OFFSET + ONE_HALF-1)
 */
-    rgb_ycc_tab[i+G_CR_OFF] = (-FIX(0.418687589)) * i;
-    rgb_ycc_tab[i+B_CR_OFF] = (-FIX(0.081312411)) * i;
-  }
-}
+#define G_CR(i)		((-FIX(0.418687589)) * (i))
+#define B_CR(i)		((-FIX(0.081312411)) * (i))
+
+static const INT32 rgb_ycc_table[TABLE_SIZE] = {
+  JSAMPLE_TABLE(R_Y, 0), JSAMPLE_TABLE(G_Y, 0), JSAMPLE_TABLE(B_Y, 0),
+  JSAMPLE_TABLE(R_CB, 0), JSAMPLE_TABLE(G_CB, 0), JSAMPLE_TABLE(B_CB, 0),
+  JSAMPLE_TABLE(G_CR, 0), JSAMPLE_TABLE(B_CR, 0)
+};
 
 
 /*
@@ -145,7 +142,7 @@ rgb_ycc_convert (j_compress_ptr cinfo,
 		 JDIMENSION output_row, int num_rows)
 {
   my_cconvert_ptr cconvert = (my_cconvert_ptr) cinfo->cconvert;
-  register INT32 * ctab = cconvert->rgb_ycc_tab;
+  register const INT32 * ctab = cconvert->rgb_ycc_tab;
   register int r, g, b;
   register JSAMPROW inptr;
   register JSAMPROW outptr0, outptr1, outptr2;
@@ -192,7 +189,7 @@ rgb_ycc_convert (j_compress_ptr cinfo,
  * Convert some rows of samples to the JPEG colorspace.
  * This version handles RGB->grayscale conversion, which is the same
  * as the RGB->Y portion of RGB->YCbCr.
- * We assume rgb_ycc_start has been called (we only use the Y tables).
+ * We only use the Y tables.
  */
 
 METHODDEF(void)
@@ -201,7 +198,7 @@ rgb_gray_convert (j_compress_ptr cinfo,
 		  JDIMENSION output_row, int num_rows)
 {
   my_cconvert_ptr cconvert = (my_cconvert_ptr) cinfo->cconvert;
-  register INT32 * ctab = cconvert->rgb_ycc_tab;
+  register const INT32 * ctab = cconvert->rgb_ycc_tab;
   register int r, g, b;
   register JSAMPROW inptr;
   register JSAMPROW outptr;
@@ -230,7 +227,6 @@ rgb_gray_convert (j_compress_ptr cinfo,
  * This version handles Adobe-style CMYK->YCCK conversion,
  * where we convert R=1-C, G=1-M, and B=1-Y to YCbCr using the same
  * conversion as above, while passing K (black) unchanged.
- * We assume rgb_ycc_start has been called.
  */
 
 METHODDEF(void)
@@ -239,7 +235,7 @@ cmyk_ycck_convert (j_compress_ptr cinfo,
 		   JDIMENSION output_row, int num_rows)
 {
   my_cconvert_ptr cconvert = (my_cconvert_ptr) cinfo->cconvert;
-  register INT32 * ctab = cconvert->rgb_ycc_tab;
+  register const INT32 * ctab = cconvert->rgb_ycc_tab;
   register int r, g, b;
   register JSAMPROW inptr;
   register JSAMPROW outptr0, outptr1, outptr2, outptr3;
@@ -419,6 +415,277 @@ null_convert (j_compress_ptr cinfo,
 }
 
 
+#ifdef COLOR_SSE2_SUPPORTED
+
+/*
+ * SSE2 versions of the RGB conversions above, which work on 16 pixels
+ * at a time.  Instead of table lookups they compute the same fixed-point
+ * sums with 16x16->32 bit multiply-adds.  FIX(0.587) does not fit in a
+ * signed 16-bit multiplier, so G is multiplied by two halves of it, and
+ * the products with FIX(0.5) are shifts.  The results are exactly those
+ * of the table versions.  A partial group at the end of a row goes
+ * through a small buffer.
+ */
+
+/* A pair of multipliers, repeated for _mm_madd_epi16 */
+#define PAIR_SSE2(a,b) \
+  _mm_setr_epi16((short) (a), (short) (b), (short) (a), (short) (b), \
+		 (short) (a), (short) (b), (short) (a), (short) (b))
+
+
+INLINE
+LOCAL(void)
+load_rgb_sse2 (JSAMPROW inptr, __m128i * rgb)
+/* Load 16 pixels and separate them into planes.  Each round below is a
+ * perfect shuffle of the 48 bytes; after four rounds every third byte
+ * has been gathered.
+ */
+{
+  __m128i t0, t1, t2;
+  int i;
+
+  rgb[0] = _mm_loadu_si128((const __m128i *) inptr);
+  rgb[1] = _mm_loadu_si128((const __m128i *) (inptr + 16));
+  rgb[2] = _mm_loadu_si128((const __m128i *) (inptr + 32));
+  for (i = 0; i < 4; i++) {
+    t0 = _mm_unpacklo_epi8(rgb[0], _mm_unpackhi_epi64(rgb[1], rgb[1]));
+    t1 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(rgb[0], rgb[0]), rgb[2]);
+    t2 = _mm_unpacklo_epi8(rgb[1], _mm_unpackhi_epi64(rgb[2], rgb[2]));
+    rgb[0] = t0; rgb[1] = t1; rgb[2] = t2;
+  }
+}
+
+
+INLINE
+LOCAL(void)
+load_pairs_sse2 (JSAMPROW inptr, __m128i * rg, __m128i * bg)
+/* Load 16 pixels as (R,G) and (B,G) pairs of 16-bit values,
+ * four pixels to a vector.
+ */
+{
+  __m128i rgb[3], zero, r, g, b;
+  int i;
+
+  load_rgb_sse2(inptr, rgb);
+  zero = _mm_setzero_si128();
+  for (i = 0; i < 2; i++) {
+    if (i == 0) {
+      r = _mm_unpacklo_epi8(rgb[RGB_RED], zero);
+      g = _mm_unpacklo_epi8(rgb[RGB_GREEN], zero);
+      b = _mm_unpacklo_epi8(rgb[RGB_BLUE], zero);
+    } else {
+      r = _mm_unpackhi_epi8(rgb[RGB_RED], zero);
+      g = _mm_unpackhi_epi8(rgb[RGB_GREEN], zero);
+      b = _mm_unpackhi_epi8(rgb[RGB_BLUE], zero);
+    }
+    rg[2*i]   = _mm_unpacklo_epi16(r, g);
+    rg[2*i+1] = _mm_unpackhi_epi16(r, g);
+    bg[2*i]   = _mm_unpacklo_epi16(b, g);
+    bg[2*i+1] = _mm_unpackhi_epi16(b, g);
+  }
+}
+
+
+INLINE
+LOCAL(void)
+store_sse2 (JSAMPROW outptr, __m128i * x)
+/* Store 16 samples held in the 32-bit lanes of x[0..3] */
+{
+  _mm_storeu_si128((__m128i *) outptr,
+		   _mm_packus_epi16(_mm_packs_epi32(x[0], x[1]),
+				    _mm_packs_epi32(x[2], x[3])));
+}
+
+
+INLINE
+LOCAL(void)
+rgb_y_sse2 (__m128i * rg, __m128i * bg, __m128i * y)
+{
+  int i;
+
+  for (i = 0; i < 4; i++) {
+    y[i] = _mm_add_epi32(
+      _mm_madd_epi16(rg[i], PAIR_SSE2(FIX(0.299), FIX(0.587) - FIX(0.587)/2)),
+      _mm_madd_epi16(bg[i], PAIR_SSE2(FIX(0.114), FIX(0.587)/2)));
+    y[i] = _mm_srli_epi32(_mm_add_epi32(y[i], _mm_set1_epi32(ONE_HALF)),
+			  SCALEBITS);
+  }
+}
+
+
+INLINE
+LOCAL(void)
+rgb_ycc_sse2 (JSAMPROW inptr, JSAMPROW outptr0, JSAMPROW outptr1,
+	      JSAMPROW outptr2)
+/* Convert 16 pixels to YCbCr */
+{
+  __m128i rg[4], bg[4], y[4], cb[4], cr[4];
+  __m128i mask = _mm_set1_epi32(0xFFFF);
+  __m128i offset = _mm_set1_epi32(CBCR_OFFSET + ONE_HALF-1);
+  int i;
+
+  load_pairs_sse2(inptr, rg, bg);
+  rgb_y_sse2(rg, bg, y);
+  for (i = 0; i < 4; i++) {
+    /* FIX(0.5) * B and FIX(0.5) * R are taken from the low halves */
+    cb[i] = _mm_add_epi32(
+      _mm_madd_epi16(rg[i], PAIR_SSE2(- FIX(0.168735892),
+				      - FIX(0.331264108))),
+      _mm_slli_epi32(_mm_and_si128(bg[i], mask), SCALEBITS-1));
+    cb[i] = _mm_srli_epi32(_mm_add_epi32(cb[i], offset), SCALEBITS);
+    cr[i] = _mm_add_epi32(
+      _mm_madd_epi16(bg[i], PAIR_SSE2(- FIX(0.081312411),
+				      - FIX(0.418687589))),
+      _mm_slli_epi32(_mm_and_si128(rg[i], mask), SCALEBITS-1));
+    cr[i] = _mm_srli_epi32(_mm_add_epi32(cr[i], offset), SCALEBITS);
+  }
+  store_sse2(outptr0, y);
+  store_sse2(outptr1, cb);
+  store_sse2(outptr2, cr);
+}
+
+
+INLINE
+LOCAL(void)
+rgb_gray_sse2 (JSAMPROW inptr, JSAMPROW outptr)
+/* Convert 16 pixels to grayscale */
+{
+  __m128i rg[4], bg[4], y[4];
+
+  load_pairs_sse2(inptr, rg, bg);
+  rgb_y_sse2(rg, bg, y);
+  store_sse2(outptr, y);
+}
+
+
+INLINE
+LOCAL(void)
+rgb_rgb1_sse2 (JSAMPROW inptr, JSAMPROW outptr0, JSAMPROW outptr1,
+	       JSAMPROW outptr2)
+/* Apply the forward reversible color transform to 16 pixels */
+{
+  __m128i rgb[3];
+  __m128i center = _mm_set1_epi8((char) CENTERJSAMPLE);
+
+  load_rgb_sse2(inptr, rgb);
+  /* Byte arithmetic wraps around modulo MAXJSAMPLE+1 */
+  _mm_storeu_si128((__m128i *) outptr0,
+		   _mm_add_epi8(_mm_sub_epi8(rgb[RGB_RED], rgb[RGB_GREEN]),
+				center));
+  _mm_storeu_si128((__m128i *) outptr1, rgb[RGB_GREEN]);
+  _mm_storeu_si128((__m128i *) outptr2,
+		   _mm_add_epi8(_mm_sub_epi8(rgb[RGB_BLUE], rgb[RGB_GREEN]),
+				center));
+}
+
+
+
+
+METHODDEF(void)
+rgb_ycc_convert_sse2 (j_compress_ptr cinfo,
+		     JSAMPARRAY input_buf, JSAMPIMAGE output_buf,
+		     JDIMENSION output_row, int num_rows)
+/* SSE2 version of rgb_ycc_convert */
+{
+  JSAMPLE inbuf[16 * RGB_PIXELSIZE];
+  JSAMPLE outbuf[3][16];
+  JSAMPROW inptr;
+  JSAMPROW outptr0, outptr1, outptr2;
+  JDIMENSION col, rest;
+  JDIMENSION num_cols = cinfo->image_width;
+
+  while (--num_rows >= 0) {
+    inptr = *input_buf++;
+    outptr0 = output_buf[0][output_row];
+    outptr1 = output_buf[1][output_row];
+    outptr2 = output_buf[2][output_row];
+    output_row++;
+    for (col = 0; col + 16 <= num_cols; col += 16) {
+      rgb_ycc_sse2(inptr, outptr0 + col, outptr1 + col, outptr2 + col);
+      inptr += 16 * RGB_PIXELSIZE;
+    }
+    if (col < num_cols) {
+      rest = num_cols - col;
+      MEMZERO(inbuf, SIZEOF(inbuf));
+      MEMCOPY(inbuf, inptr, rest * RGB_PIXELSIZE * SIZEOF(JSAMPLE));
+      rgb_ycc_sse2(inbuf, outbuf[0], outbuf[1], outbuf[2]);
+      MEMCOPY(outptr0 + col, outbuf[0], rest * SIZEOF(JSAMPLE));
+      MEMCOPY(outptr1 + col, outbuf[1], rest * SIZEOF(JSAMPLE));
+      MEMCOPY(outptr2 + col, outbuf[2], rest * SIZEOF(JSAMPLE));
+    }
+  }
+}
+
+
+METHODDEF(void)
+rgb_gray_convert_sse2 (j_compress_ptr cinfo,
+		      JSAMPARRAY input_buf, JSAMPIMAGE output_buf,
+		      JDIMENSION output_row, int num_rows)
+/* SSE2 version of rgb_gray_convert */
+{
+  JSAMPLE inbuf[16 * RGB_PIXELSIZE];
+  JSAMPLE outbuf[16];
+  JSAMPROW inptr;
+  JSAMPROW outptr;
+  JDIMENSION col, rest;
+  JDIMENSION num_cols = cinfo->image_width;
+
+  while (--num_rows >= 0) {
+    inptr = *input_buf++;
+    outptr = output_buf[0][output_row++];
+    for (col = 0; col + 16 <= num_cols; col += 16) {
+      rgb_gray_sse2(inptr, outptr + col);
+      inptr += 16 * RGB_PIXELSIZE;
+    }
+    if (col < num_cols) {
+      rest = num_cols - col;
+      MEMZERO(inbuf, SIZEOF(inbuf));
+      MEMCOPY(inbuf, inptr, rest * RGB_PIXELSIZE * SIZEOF(JSAMPLE));
+      rgb_gray_sse2(inbuf, outbuf);
+      MEMCOPY(outptr + col, outbuf, rest * SIZEOF(JSAMPLE));
+    }
+  }
+}
+
+
+METHODDEF(void)
+rgb_rgb1_convert_sse2 (j_compress_ptr cinfo,
+		      JSAMPARRAY input_buf, JSAMPIMAGE output_buf,
+		      JDIMENSION output_row, int num_rows)
+/* SSE2 version of rgb_rgb1_convert */
+{
+  JSAMPLE inbuf[16 * RGB_PIXELSIZE];
+  JSAMPLE outbuf[3][16];
+  JSAMPROW inptr;
+  JSAMPROW outptr0, outptr1, outptr2;
+  JDIMENSION col, rest;
+  JDIMENSION num_cols = cinfo->image_width;
+
+  while (--num_rows >= 0) {
+    inptr = *input_buf++;
+    outptr0 = output_buf[0][output_row];
+    outptr1 = output_buf[1][output_row];
+    outptr2 = output_buf[2][output_row];
+    output_row++;
+    for (col = 0; col + 16 <= num_cols; col += 16) {
+      rgb_rgb1_sse2(inptr, outptr0 + col, outptr1 + col, outptr2 + col);
+      inptr += 16 * RGB_PIXELSIZE;
+    }
+    if (col < num_cols) {
+      rest = num_cols - col;
+      MEMZERO(inbuf, SIZEOF(inbuf));
+      MEMCOPY(inbuf, inptr, rest * RGB_PIXELSIZE * SIZEOF(JSAMPLE));
+      rgb_rgb1_sse2(inbuf, outbuf[0], outbuf[1], outbuf[2]);
+      MEMCOPY(outptr0 + col, outbuf[0], rest * SIZEOF(JSAMPLE));
+      MEMCOPY(outptr1 + col, outbuf[1], rest * SIZEOF(JSAMPLE));
+      MEMCOPY(outptr2 + col, outbuf[2], rest * SIZEOF(JSAMPLE));
+    }
+  }
+}
+
+#endif /* COLOR_SSE2_SUPPORTED */
+
+
 /*
  * Empty method for start_pass.
  */
@@ -443,8 +710,8 @@ jinit_color_converter (j_compress_ptr cinfo)
     (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
 				SIZEOF(my_color_converter));
   cinfo->cconvert = &cconvert->pub;
-  /* set start_pass to null method until we find out differently */
   cconvert->pub.start_pass = null_method;
+  cconvert->rgb_ycc_tab = rgb_ycc_table;
 
   /* Make sure input_components agrees with in_color_space */
   switch (cinfo->in_color_space) {
@@ -495,8 +762,11 @@ jinit_color_converter (j_compress_ptr cinfo)
       cconvert->pub.color_convert = grayscale_convert;
       break;
     case JCS_RGB:
-      cconvert->pub.start_pass = rgb_ycc_start;
       cconvert->pub.color_convert = rgb_gray_convert;
+#ifdef COLOR_SSE2_SUPPORTED
+      if (jsimd_flags() & JSIMD_FLAG_SSE2)
+	cconvert->pub.color_convert = rgb_gray_convert_sse2;
+#endif
       break;
     default:
       ERREXIT(cinfo, JERR_CONVERSION_NOTIMPL);
@@ -514,6 +784,10 @@ jinit_color_converter (j_compress_ptr cinfo)
 	break;
       case JCT_SUBTRACT_GREEN:
 	cconvert->pub.color_convert = rgb_rgb1_convert;
+#ifdef COLOR_SSE2_SUPPORTED
+	if (jsimd_flags() & JSIMD_FLAG_SSE2)
+	  cconvert->pub.color_convert = rgb_rgb1_convert_sse2;
+#endif
 	break;
       default:
 	ERREXIT(cinfo, JERR_CONVERSION_NOTIMPL);
@@ -527,8 +801,11 @@ jinit_color_converter (j_compress_ptr cinfo)
       ERREXIT(cinfo, JERR_BAD_J_COLORSPACE);
     switch (cinfo->in_color_space) {
     case JCS_RGB:
-      cconvert->pub.start_pass = rgb_ycc_start;
       cconvert->pub.color_convert = rgb_ycc_convert;
+#ifdef COLOR_SSE2_SUPPORTED
+      if (jsimd_flags() & JSIMD_FLAG_SSE2)
+	cconvert->pub.color_convert = rgb_ycc_convert_sse2;
+#endif
       break;
     case JCS_YCbCr:
       cconvert->pub.color_convert = null_convert;
@@ -552,8 +829,11 @@ jinit_color_converter (j_compress_ptr cinfo)
       cinfo->comp_info[1].component_needed = TRUE;
       cinfo->comp_info[2].component_needed = TRUE;
       /* compute normal YCC first */
-      cconvert->pub.start_pass = rgb_ycc_start;
       cconvert->pub.color_convert = rgb_ycc_convert;
+#ifdef COLOR_SSE2_SUPPORTED
+      if (jsimd_flags() & JSIMD_FLAG_SSE2)
+	cconvert->pub.color_convert = rgb_ycc_convert_sse2;
+#endif
       break;
     case JCS_YCbCr:
       /* need quantization scale by factor of 2 after DCT */
@@ -583,7 +863,6 @@ jinit_color_converter (j_compress_ptr cinfo)
       ERREXIT(cinfo, JERR_BAD_J_COLORSPACE);
     switch (cinfo->in_color_space) {
     case JCS_CMYK:
-      cconvert->pub.start_pass = rgb_ycc_start;
       cconvert->pub.color_convert = cmyk_ycck_convert;
       break;
     case JCS_YCCK:
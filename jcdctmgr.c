@@ -17,6 +17,10 @@
 #include "jpeglib.h"
 #include "jdct.h"		/* Private declarations for DCT subsystem */
 
+#ifdef FDCT_SSE2_SUPPORTED
+#include <emmintrin.h>
+#endif
+
 
 /* Private subobject for this module */
 
@@ -40,6 +44,8 @@ typedef my_fdct_controller * my_fdct_ptr;
  * because of scaling (especially for an unnormalized DCT) --
  * are pointed to by dct_table in the per-component comp_info
  * structures.  Each table is given in normal array order.
+ * For SSE2 quantization, the integer divisors are followed by
+ * 16-bit copies and reciprocals (see quantize_sse2 below).
  */
 
 typedef union {
@@ -47,6 +53,14 @@ typedef union {
 #ifdef DCT_FLOAT_SUPPORTED
   FAST_FLOAT float_array[DCTSIZE2];
 #endif
+#ifdef FDCT_SSE2_SUPPORTED
+  struct {
+    DCTELEM divisor[DCTSIZE2];	/* same as int_array */
+    UINT16 divisor16[DCTSIZE2];	/* the divisors again, in 16 bits */
+    UINT16 round[DCTSIZE2];	/* divisor/2, for rounding */
+    UINT16 reciprocal[DCTSIZE2]; /* 65536/divisor, rounded up */
+  } sse2;
+#endif
 } divisor_table;
 
 
@@ -62,6 +76,51 @@ typedef union {
 #endif
 
 
+/*
+ * Quantize/descale the coefficients of one block.
+ */
+
+INLINE
+LOCAL(void)
+quantize (DCTELEM * workspace, DCTELEM * divisors, JCOEFPTR output_ptr)
+{
+  register DCTELEM temp, qval;
+  register int i;
+
+  for (i = 0; i < DCTSIZE2; i++) {
+    qval = divisors[i];
+    temp = workspace[i];
+    /* Divide the coefficient value by qval, ensuring proper rounding.
+     * Since C does not specify the direction of rounding for negative
+     * quotients, we have to force the dividend positive for portability.
+     *
+     * In most files, at least half of the output values will be zero
+     * (at default quantization settings, more like three-quarters...)
+     * so we should ensure that this case is fast.  On many machines,
+     * a comparison is enough cheaper than a divide to make a special test
+     * a win.  Since both inputs will be nonnegative, we need only test
+     * for a < b to discover whether a/b is 0.
+     * If your machine's division is fast enough, define FAST_DIVIDE.
+     */
+#ifdef FAST_DIVIDE
+#define DIVIDE_BY(a,b)	a /= b
+#else
+#define DIVIDE_BY(a,b)	if (a >= b) a /= b; else a = 0
+#endif
+    if (temp < 0) {
+      temp = -temp;
+      temp += qval>>1;	/* for rounding */
+      DIVIDE_BY(temp, qval);
+      temp = -temp;
+    } else {
+      temp += qval>>1;	/* for rounding */
+      DIVIDE_BY(temp, qval);
+    }
+    output_ptr[i] = (JCOEF) temp;
+  }
+}
+
+
 /*
  * Perform forward DCT on one or more blocks of a component.
  *
@@ -91,42 +150,7 @@ forward_DCT (j_compress_ptr cinfo, jpeg_component_info * compptr,
     (*do_dct) (workspace, sample_data, start_col);
 
     /* Quantize/descale the coefficients, and store into coef_blocks[] */
-    { register DCTELEM temp, qval;
-      register int i;
-      register JCOEFPTR output_ptr = coef_blocks[bi];
-
-      for (i = 0; i < DCTSIZE2; i++) {
-	qval = divisors[i];
-	temp = workspace[i];
-	/* Divide the coefficient value by qval, ensuring proper rounding.
-	 * Since C does not specify the direction of rounding for negative
-	 * quotients, we have to force the dividend positive for portability.
-	 *
-	 * In most files, at least half of the output values will be zero
-	 * (at default quantization settings, more like three-quarters...)
-	 * so we should ensure that this case is fast.  On many machines,
-	 * a comparison is enough cheaper than a divide to make a special test
-	 * a win.  Since both inputs will be nonnegative, we need only test
-	 * for a < b to discover whether a/b is 0.
-	 * If your machine's division is fast enough, define FAST_DIVIDE.
-	 */
-#ifdef FAST_DIVIDE
-#define DIVIDE_BY(a,b)	a /= b
-#else
-#define DIVIDE_BY(a,b)	if (a >= b) a /= b; else a = 0
-#endif
-	if (temp < 0) {
-	  temp = -temp;
-	  temp += qval>>1;	/* for rounding */
-	  DIVIDE_BY(temp, qval);
-	  temp = -temp;
-	} else {
-	  temp += qval>>1;	/* for rounding */
-	  DIVIDE_BY(temp, qval);
-	}
-	output_ptr[i] = (JCOEF) temp;
-      }
-    }
+    quantize(workspace, divisors, coef_blocks[bi]);
   }
 }
 
@@ -176,6 +200,113 @@ forward_DCT_float (j_compress_ptr cinfo, jpeg_component_info * compptr,
 #endif /* DCT_FLOAT_SUPPORTED */
 
 
+#ifdef FDCT_SSE2_SUPPORTED
+
+/*
+ * SSE2 quantization of one block.
+ *
+ * Eight coefficients are divided at a time, with a multiply by the rounded
+ * up reciprocal in place of the division.  For a dividend n < 65536 the
+ * high half of n * ceil(65536/q) is either n/q or n/q+1, and the latter is
+ * caught by multiplying back.  With coefficients within 16 bits and
+ * divisors from 2 to 16383, the dividends and the products checked stay
+ * below 65536, so this gives exactly what the division in forward_DCT
+ * gives.  FALSE is returned if some coefficient does not fit; the caller
+ * must then quantize the block the ordinary way.
+ */
+
+/* Nonzero in each 32-bit lane holding a value that needs more than 16 bits */
+#define WIDE_SSE2(var) \
+  _mm_srli_epi32(_mm_add_epi32(var, _mm_set1_epi32(32768)), 16)
+
+INLINE
+LOCAL(boolean)
+quantize_sse2 (DCTELEM * workspace, divisor_table * dtbl,
+	       JCOEFPTR output_ptr)
+{
+  __m128i lo, hi, coef, sign, temp, quot, prod, wide;
+  __m128i bias = _mm_set1_epi16((short) 0x8000);
+  int i;
+
+  wide = _mm_setzero_si128();
+  for (i = 0; i < DCTSIZE2; i += 8) {
+    lo = _mm_loadu_si128((const __m128i *) (workspace + i));
+    hi = _mm_loadu_si128((const __m128i *) (workspace + i + 4));
+    wide = _mm_or_si128(wide, _mm_or_si128(WIDE_SSE2(lo), WIDE_SSE2(hi)));
+    coef = _mm_packs_epi32(lo, hi);
+    /* Force the dividend positive, as the C code does */
+    sign = _mm_srai_epi16(coef, 15);
+    temp = _mm_sub_epi16(_mm_xor_si128(coef, sign), sign);
+    temp = _mm_add_epi16(temp, _mm_loadu_si128((const __m128i *)
+					       (dtbl->sse2.round + i)));
+    quot = _mm_mulhi_epu16(temp, _mm_loadu_si128((const __m128i *)
+						 (dtbl->sse2.reciprocal + i)));
+    /* Decrement the quotient where it comes out one too large */
+    prod = _mm_mullo_epi16(quot, _mm_loadu_si128((const __m128i *)
+						 (dtbl->sse2.divisor16 + i)));
+    quot = _mm_add_epi16(quot,
+			 _mm_cmpgt_epi16(_mm_xor_si128(prod, bias),
+					 _mm_xor_si128(temp, bias)));
+    _mm_storeu_si128((__m128i *) (output_ptr + i),
+		     _mm_sub_epi16(_mm_xor_si128(quot, sign), sign));
+  }
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(wide, _mm_setzero_si128()))
+	 == 0xFFFF;
+}
+
+
+METHODDEF(void)
+forward_DCT_sse2 (j_compress_ptr cinfo, jpeg_component_info * compptr,
+		  JSAMPARRAY sample_data, JBLOCKROW coef_blocks,
+		  JDIMENSION start_row, JDIMENSION start_col,
+		  JDIMENSION num_blocks)
+/* This version is used for integer DCT implementations when the
+ * divisors suit quantize_sse2.
+ */
+{
+  /* This routine is heavily used, so it's worth coding it tightly. */
+  my_fdct_ptr fdct = (my_fdct_ptr) cinfo->fdct;
+  forward_DCT_method_ptr do_dct = fdct->do_dct[compptr->component_index];
+  divisor_table * dtbl = (divisor_table *) compptr->dct_table;
+  DCTELEM workspace[DCTSIZE2];	/* work area for FDCT subroutine */
+  JDIMENSION bi;
+
+  sample_data += start_row;	/* fold in the vertical offset once */
+
+  for (bi = 0; bi < num_blocks; bi++, start_col += compptr->DCT_h_scaled_size) {
+    /* Perform the DCT */
+    (*do_dct) (workspace, sample_data, start_col);
+
+    /* Quantize/descale the coefficients, and store into coef_blocks[] */
+    if (! quantize_sse2(workspace, dtbl, coef_blocks[bi]))
+      quantize(workspace, dtbl->int_array, coef_blocks[bi]);
+  }
+}
+
+
+LOCAL(boolean)
+prepare_quantize_sse2 (divisor_table * dtbl)
+/* Fill in the SSE2 part of an integer divisor table.
+ * Returns FALSE if some divisor is out of range for quantize_sse2.
+ */
+{
+  DCTELEM qval;
+  int i;
+
+  for (i = 0; i < DCTSIZE2; i++) {
+    qval = dtbl->int_array[i];
+    if (qval < 2 || qval > 16383)
+      return FALSE;
+    dtbl->sse2.divisor16[i] = (UINT16) qval;
+    dtbl->sse2.round[i] = (UINT16) (qval >> 1);
+    dtbl->sse2.reciprocal[i] = (UINT16) ((65536L + qval - 1) / qval);
+  }
+  return TRUE;
+}
+
+#endif /* FDCT_SSE2_SUPPORTED */
+
+
 /*
  * Initialize for a processing pass.
  * Verify that all referenced Q-tables are present, and set up
@@ -330,6 +461,10 @@ start_pass_fdctmgr (j_compress_ptr cinfo)
 #ifdef DCT_ISLOW_SUPPORTED
       case JDCT_ISLOW:
 	fdct->do_dct[ci] = jpeg_fdct_islow;
+#ifdef FDCT_SSE2_SUPPORTED
+	if (jsimd_flags() & JSIMD_FLAG_SSE2)
+	  fdct->do_dct[ci] = jpeg_fdct_islow_sse2;
+#endif
 	method = JDCT_ISLOW;
 	break;
 #endif
@@ -374,6 +509,11 @@ start_pass_fdctmgr (j_compress_ptr cinfo)
 	  ((DCTELEM) qtbl->quantval[i]) << (compptr->component_needed ? 4 : 3);
       }
       fdct->pub.forward_DCT[ci] = forward_DCT;
+#ifdef FDCT_SSE2_SUPPORTED
+      if ((jsimd_flags() & JSIMD_FLAG_SSE2) &&
+	  prepare_quantize_sse2((divisor_table *) compptr->dct_table))
+	fdct->pub.forward_DCT[ci] = forward_DCT_sse2;
+#endif
       break;
 #endif
 #ifdef DCT_IFAST_SUPPORTED
@@ -408,6 +548,11 @@ start_pass_fdctmgr (j_compress_ptr cinfo)
 	}
       }
       fdct->pub.forward_DCT[ci] = forward_DCT;
+#ifdef FDCT_SSE2_SUPPORTED
+      if ((jsimd_flags() & JSIMD_FLAG_SSE2) &&
+	  prepare_quantize_sse2((divisor_table *) compptr->dct_table))
+	fdct->pub.forward_DCT[ci] = forward_DCT_sse2;
+#endif
       break;
 #endif
 #ifdef DCT_FLOAT_SUPPORTED
@@ -51,6 +51,9 @@ jinit_compress_master (j_compress_ptr cinfo)
   /* Initialize master control (includes parameter checking/processing) */
   jinit_c_master_control(cinfo, FALSE /* full compression */);
 
+  /* (Re)initialize the destination, which may hook into master control */
+  (*cinfo->dest->init_destination) (cinfo);
+
   /* Preprocessing */
   if (! cinfo->raw_data_in) {
     jinit_color_converter(cinfo);
@@ -809,6 +809,7 @@ jinit_c_master_control (j_compress_ptr cinfo, boolean transcode_only)
   master->pub.prepare_for_pass = prepare_for_pass;
   master->pub.pass_startup = pass_startup;
   master->pub.finish_pass = finish_pass_master;
+  master->pub.iMCU_row_done = NULL;
   master->pub.is_last_pass = FALSE;
 
   /* Validate parameters, determine derived values */
@@ -49,6 +49,14 @@
 #include "jinclude.h"
 #include "jpeglib.h"
 
+/* The SSE2 code handles 8-bit samples */
+#ifdef JSIMD_SSE2
+#if BITS_IN_JSAMPLE == 8
+#define SAMPLE_SSE2_SUPPORTED
+#include <emmintrin.h>
+#endif
+#endif
+
 
 /* Pointer to routine to downsample a single component */
 typedef JMETHOD(void, downsample1_ptr,
@@ -469,6 +477,255 @@ fullsize_smooth_downsample (j_compress_ptr cinfo, jpeg_component_info *compptr,
 #endif /* INPUT_SMOOTHING_SUPPORTED */
 
 
+#ifdef SAMPLE_SSE2_SUPPORTED
+
+/*
+ * SSE2 versions of the 2:1 downsampling routines above.  The pixel pairs
+ * are summed in 16-bit lanes, and the alternating bias is a constant vector,
+ * since each group of output samples starts at an even column.  The results
+ * are exactly those of the C versions; output samples left over at the end
+ * of a row are done as in the C versions.
+ */
+
+METHODDEF(void)
+h2v1_downsample_sse2 (j_compress_ptr cinfo, jpeg_component_info * compptr,
+		      JSAMPARRAY input_data, JSAMPARRAY output_data)
+/* SSE2 version of h2v1_downsample */
+{
+  int inrow;
+  JDIMENSION outcol;
+  JDIMENSION output_cols = compptr->width_in_blocks * compptr->DCT_h_scaled_size;
+  register JSAMPROW inptr, outptr;
+  register int bias;
+  __m128i mask, bias_sse2, in0, in1, sum0, sum1;
+
+  expand_right_edge(input_data, cinfo->max_v_samp_factor,
+		    cinfo->image_width, output_cols * 2);
+
+  mask = _mm_set1_epi16(0xFF);
+  bias_sse2 = _mm_set1_epi32(0x00010000); /* 0,1,0,1,... */
+
+  for (inrow = 0; inrow < cinfo->max_v_samp_factor; inrow++) {
+    outptr = output_data[inrow];
+    inptr = input_data[inrow];
+    for (outcol = 0; outcol + 16 <= output_cols; outcol += 16) {
+      in0 = _mm_loadu_si128((const __m128i *) inptr);
+      in1 = _mm_loadu_si128((const __m128i *) (inptr + 16));
+      sum0 = _mm_add_epi16(_mm_and_si128(in0, mask), _mm_srli_epi16(in0, 8));
+      sum1 = _mm_add_epi16(_mm_and_si128(in1, mask), _mm_srli_epi16(in1, 8));
+      sum0 = _mm_srli_epi16(_mm_add_epi16(sum0, bias_sse2), 1);
+      sum1 = _mm_srli_epi16(_mm_add_epi16(sum1, bias_sse2), 1);
+      _mm_storeu_si128((__m128i *) outptr, _mm_packus_epi16(sum0, sum1));
+      outptr += 16;
+      inptr += 32;
+    }
+    bias = 0;
+    for (; outcol < output_cols; outcol++) {
+      *outptr++ = (JSAMPLE) ((GETJSAMPLE(*inptr) + GETJSAMPLE(inptr[1])
+			      + bias) >> 1);
+      bias ^= 1;
+      inptr += 2;
+    }
+  }
+}
+
+
+METHODDEF(void)
+h2v2_downsample_sse2 (j_compress_ptr cinfo, jpeg_component_info * compptr,
+		      JSAMPARRAY input_data, JSAMPARRAY output_data)
+/* SSE2 version of h2v2_downsample */
+{
+  int inrow, outrow;
+  JDIMENSION outcol;
+  JDIMENSION output_cols = compptr->width_in_blocks * compptr->DCT_h_scaled_size;
+  register JSAMPROW inptr0, inptr1, outptr;
+  register int bias;
+  __m128i mask, bias_sse2, in0, in1, sum0, sum1;
+
+  expand_right_edge(input_data, cinfo->max_v_samp_factor,
+		    cinfo->image_width, output_cols * 2);
+
+  mask = _mm_set1_epi16(0xFF);
+  bias_sse2 = _mm_set1_epi32(0x00020001); /* 1,2,1,2,... */
+
+  inrow = outrow = 0;
+  while (inrow < cinfo->max_v_samp_factor) {
+    outptr = output_data[outrow];
+    inptr0 = input_data[inrow];
+    inptr1 = input_data[inrow+1];
+    for (outcol = 0; outcol + 16 <= output_cols; outcol += 16) {
+      in0 = _mm_loadu_si128((const __m128i *) inptr0);
+      in1 = _mm_loadu_si128((const __m128i *) inptr1);
+      sum0 = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(in0, mask),
+					 _mm_srli_epi16(in0, 8)),
+			   _mm_add_epi16(_mm_and_si128(in1, mask),
+					 _mm_srli_epi16(in1, 8)));
+      in0 = _mm_loadu_si128((const __m128i *) (inptr0 + 16));
+      in1 = _mm_loadu_si128((const __m128i *) (inptr1 + 16));
+      sum1 = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(in0, mask),
+					 _mm_srli_epi16(in0, 8)),
+			   _mm_add_epi16(_mm_and_si128(in1, mask),
+					 _mm_srli_epi16(in1, 8)));
+      sum0 = _mm_srli_epi16(_mm_add_epi16(sum0, bias_sse2), 2);
+      sum1 = _mm_srli_epi16(_mm_add_epi16(sum1, bias_sse2), 2);
+      _mm_storeu_si128((__m128i *) outptr, _mm_packus_epi16(sum0, sum1));
+      outptr += 16;
+      inptr0 += 32; inptr1 += 32;
+    }
+    bias = 1;
+    for (; outcol < output_cols; outcol++) {
+      *outptr++ = (JSAMPLE) ((GETJSAMPLE(*inptr0) + GETJSAMPLE(inptr0[1]) +
+			      GETJSAMPLE(*inptr1) + GETJSAMPLE(inptr1[1])
+			      + bias) >> 2);
+      bias ^= 3;
+      inptr0 += 2; inptr1 += 2;
+    }
+    inrow += 2;
+    outrow++;
+  }
+}
+
+
+#ifdef INPUT_SMOOTHING_SUPPORTED
+
+/* The even-numbered and odd-numbered samples of a vector,
+ * as 16-bit values
+ */
+#define EVEN_SSE2(v)  _mm_and_si128(v, mask)
+#define ODD_SSE2(v)   _mm_srli_epi16(v, 8)
+
+/* Load 16 samples at ptr */
+#define LOAD_SSE2(ptr)  _mm_loadu_si128((const __m128i *) (ptr))
+
+METHODDEF(void)
+h2v2_smooth_downsample_sse2 (j_compress_ptr cinfo,
+			     jpeg_component_info * compptr,
+			     JSAMPARRAY input_data, JSAMPARRAY output_data)
+/* SSE2 version of h2v2_smooth_downsample.  Eight output samples are formed
+ * at a time; the member and neighbor sums stay within 16 bits, and their
+ * scaled sum is done with a 16x16->32 bit multiply-add.
+ */
+{
+  int inrow, outrow;
+  JDIMENSION colctr;
+  JDIMENSION output_cols = compptr->width_in_blocks * compptr->DCT_h_scaled_size;
+  register JSAMPROW inptr0, inptr1, above_ptr, below_ptr, outptr;
+  INT32 membersum, neighsum, memberscale, neighscale;
+  __m128i mask, scale, round, v0, v1, member, edge, corner, neigh, lo, hi;
+
+  expand_right_edge(input_data - 1, cinfo->max_v_samp_factor + 2,
+		    cinfo->image_width, output_cols * 2);
+
+  memberscale = 16384 - cinfo->smoothing_factor * 80; /* scaled (1-5*SF)/4 */
+  neighscale = cinfo->smoothing_factor * 16; /* scaled SF/4 */
+
+  mask = _mm_set1_epi16(0xFF);
+  scale = _mm_set1_epi32((INT32) ((neighscale << 16) | memberscale));
+  round = _mm_set1_epi32(32768);
+
+  inrow = outrow = 0;
+  while (inrow < cinfo->max_v_samp_factor) {
+    outptr = output_data[outrow];
+    inptr0 = input_data[inrow];
+    inptr1 = input_data[inrow+1];
+    above_ptr = input_data[inrow-1];
+    below_ptr = input_data[inrow+2];
+
+    /* Special case for first column: pretend column -1 is same as column 0 */
+    membersum = GETJSAMPLE(*inptr0) + GETJSAMPLE(inptr0[1]) +
+		GETJSAMPLE(*inptr1) + GETJSAMPLE(inptr1[1]);
+    neighsum = GETJSAMPLE(*above_ptr) + GETJSAMPLE(above_ptr[1]) +
+	       GETJSAMPLE(*below_ptr) + GETJSAMPLE(below_ptr[1]) +
+	       GETJSAMPLE(*inptr0) + GETJSAMPLE(inptr0[2]) +
+	       GETJSAMPLE(*inptr1) + GETJSAMPLE(inptr1[2]);
+    neighsum += neighsum;
+    neighsum += GETJSAMPLE(*above_ptr) + GETJSAMPLE(above_ptr[2]) +
+		GETJSAMPLE(*below_ptr) + GETJSAMPLE(below_ptr[2]);
+    membersum = membersum * memberscale + neighsum * neighscale;
+    *outptr++ = (JSAMPLE) ((membersum + 32768) >> 16);
+    inptr0 += 2; inptr1 += 2; above_ptr += 2; below_ptr += 2;
+
+    /* Groups of eight; the loads reach 2 samples past the group, which
+     * is still within the row since the last column is done separately.
+     */
+    for (colctr = output_cols - 2; colctr >= 8; colctr -= 8) {
+      /* sums of pixels directly mapped to the output elements */
+      v0 = LOAD_SSE2(inptr0);
+      v1 = LOAD_SSE2(inptr1);
+      member = _mm_add_epi16(_mm_add_epi16(EVEN_SSE2(v0), ODD_SSE2(v0)),
+			     _mm_add_epi16(EVEN_SSE2(v1), ODD_SSE2(v1)));
+      /* sums of edge-neighbor pixels */
+      v0 = LOAD_SSE2(above_ptr);
+      v1 = LOAD_SSE2(below_ptr);
+      edge = _mm_add_epi16(_mm_add_epi16(EVEN_SSE2(v0), ODD_SSE2(v0)),
+			   _mm_add_epi16(EVEN_SSE2(v1), ODD_SSE2(v1)));
+      v0 = LOAD_SSE2(inptr0 - 1);
+      v1 = LOAD_SSE2(inptr1 - 1);
+      edge = _mm_add_epi16(edge, _mm_add_epi16(EVEN_SSE2(v0),
+					       EVEN_SSE2(v1)));
+      v0 = LOAD_SSE2(inptr0 + 2);
+      v1 = LOAD_SSE2(inptr1 + 2);
+      edge = _mm_add_epi16(edge, _mm_add_epi16(EVEN_SSE2(v0),
+					       EVEN_SSE2(v1)));
+      /* sums of corner-neighbor pixels */
+      v0 = LOAD_SSE2(above_ptr - 1);
+      v1 = LOAD_SSE2(below_ptr - 1);
+      corner = _mm_add_epi16(EVEN_SSE2(v0), EVEN_SSE2(v1));
+      v0 = LOAD_SSE2(above_ptr + 2);
+      v1 = LOAD_SSE2(below_ptr + 2);
+      corner = _mm_add_epi16(corner, _mm_add_epi16(EVEN_SSE2(v0),
+						   EVEN_SSE2(v1)));
+      /* The edge-neighbors count twice as much as corner-neighbors */
+      neigh = _mm_add_epi16(_mm_add_epi16(edge, edge), corner);
+      /* form final outputs scaled up by 2^16, round and descale them */
+      lo = _mm_madd_epi16(_mm_unpacklo_epi16(member, neigh), scale);
+      hi = _mm_madd_epi16(_mm_unpackhi_epi16(member, neigh), scale);
+      lo = _mm_srai_epi32(_mm_add_epi32(lo, round), 16);
+      hi = _mm_srai_epi32(_mm_add_epi32(hi, round), 16);
+      lo = _mm_packs_epi32(lo, hi);
+      _mm_storel_epi64((__m128i *) outptr, _mm_packus_epi16(lo, lo));
+      outptr += 8;
+      inptr0 += 16; inptr1 += 16; above_ptr += 16; below_ptr += 16;
+    }
+
+    for (; colctr > 0; colctr--) {
+      membersum = GETJSAMPLE(*inptr0) + GETJSAMPLE(inptr0[1]) +
+		  GETJSAMPLE(*inptr1) + GETJSAMPLE(inptr1[1]);
+      neighsum = GETJSAMPLE(*above_ptr) + GETJSAMPLE(above_ptr[1]) +
+		 GETJSAMPLE(*below_ptr) + GETJSAMPLE(below_ptr[1]) +
+		 GETJSAMPLE(inptr0[-1]) + GETJSAMPLE(inptr0[2]) +
+		 GETJSAMPLE(inptr1[-1]) + GETJSAMPLE(inptr1[2]);
+      neighsum += neighsum;
+      neighsum += GETJSAMPLE(above_ptr[-1]) + GETJSAMPLE(above_ptr[2]) +
+		  GETJSAMPLE(below_ptr[-1]) + GETJSAMPLE(below_ptr[2]);
+      membersum = membersum * memberscale + neighsum * neighscale;
+      *outptr++ = (JSAMPLE) ((membersum + 32768) >> 16);
+      inptr0 += 2; inptr1 += 2; above_ptr += 2; below_ptr += 2;
+    }
+
+    /* Special case for last column */
+    membersum = GETJSAMPLE(*inptr0) + GETJSAMPLE(inptr0[1]) +
+		GETJSAMPLE(*inptr1) + GETJSAMPLE(inptr1[1]);
+    neighsum = GETJSAMPLE(*above_ptr) + GETJSAMPLE(above_ptr[1]) +
+	       GETJSAMPLE(*below_ptr) + GETJSAMPLE(below_ptr[1]) +
+	       GETJSAMPLE(inptr0[-1]) + GETJSAMPLE(inptr0[1]) +
+	       GETJSAMPLE(inptr1[-1]) + GETJSAMPLE(inptr1[1]);
+    neighsum += neighsum;
+    neighsum += GETJSAMPLE(above_ptr[-1]) + GETJSAMPLE(above_ptr[1]) +
+		GETJSAMPLE(below_ptr[-1]) + GETJSAMPLE(below_ptr[1]);
+    membersum = membersum * memberscale + neighsum * neighscale;
+    *outptr = (JSAMPLE) ((membersum + 32768) >> 16);
+
+    inrow += 2;
+    outrow++;
+  }
+}
+
+#endif /* INPUT_SMOOTHING_SUPPORTED */
+
+#endif /* SAMPLE_SSE2_SUPPORTED */
+
+
 /*
  * Module initialization routine for downsampling.
  * Note that we must select a routine for each component.
@@ -519,15 +776,31 @@ jinit_downsampler (j_compress_ptr cinfo)
 	       v_in_group == v_out_group) {
       smoothok = FALSE;
       downsample->methods[ci] = h2v1_downsample;
+#ifdef SAMPLE_SSE2_SUPPORTED
+      if (jsimd_flags() & JSIMD_FLAG_SSE2)
+	downsample->methods[ci] = h2v1_downsample_sse2;
+#endif
     } else if (h_in_group == h_out_group * 2 &&
 	       v_in_group == v_out_group * 2) {
 #ifdef INPUT_SMOOTHING_SUPPORTED
       if (cinfo->smoothing_factor) {
 	downsample->methods[ci] = h2v2_smooth_downsample;
+#ifdef SAMPLE_SSE2_SUPPORTED
+	/* The SSE2 version needs the scale factors to fit in 16 bits */
+	if ((jsimd_flags() & JSIMD_FLAG_SSE2) &&
+	    cinfo->smoothing_factor <= 100)
+	  downsample->methods[ci] = h2v2_smooth_downsample_sse2;
+#endif
 	downsample->pub.need_context_rows = TRUE;
       } else
 #endif
+      {
 	downsample->methods[ci] = h2v2_downsample;
+#ifdef SAMPLE_SSE2_SUPPORTED
+	if (jsimd_flags() & JSIMD_FLAG_SSE2)
+	  downsample->methods[ci] = h2v2_downsample_sse2;
+#endif
+      }
     } else if ((h_in_group % h_out_group) == 0 &&
 	       (v_in_group % v_out_group) == 0) {
       smoothok = FALSE;
@@ -42,9 +42,8 @@ jpeg_write_coefficients (j_compress_ptr cinfo, jvirt_barray_ptr * coef_arrays)
     ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
   /* Mark all tables to be written */
   jpeg_suppress_tables(cinfo, FALSE);
-  /* (Re)initialize error mgr and destination modules */
+  /* (Re)initialize error mgr; the destination follows master control */
   (*cinfo->err->reset_error_mgr) ((j_common_ptr) cinfo);
-  (*cinfo->dest->init_destination) (cinfo);
   /* Perform master selection of active modules */
   transencode_master_selection(cinfo, coef_arrays);
   /* Wait for jpeg_finish_compress() call */
@@ -169,6 +168,9 @@ transencode_master_selection (j_compress_ptr cinfo,
   /* Initialize master control (includes parameter checking/processing) */
   jinit_c_master_control(cinfo, TRUE /* transcode only */);
 
+  /* (Re)initialize the destination, which may hook into master control */
+  (*cinfo->dest->init_destination) (cinfo);
+
   /* Entropy encoding: either Huffman or arithmetic coding. */
   if (cinfo->arith_code)
     jinit_arith_encoder(cinfo);
@@ -344,6 +346,9 @@ compress_output (j_compress_ptr cinfo, JSAMPIMAGE input_buf)
   /* Completed the iMCU row, advance counters for next one */
   coef->iMCU_row_num++;
   start_iMCU_row(cinfo);
+  /* Let a streaming destination pass on the data */
+  if (cinfo->master->iMCU_row_done != NULL)
+    (*cinfo->master->iMCU_row_done) (cinfo);
   return TRUE;
 }
 
@@ -782,6 +782,10 @@ jinit_arith_decoder (j_decompress_ptr cinfo)
   /* Initialize index for fixed probability estimation */
   entropy->fixed_bin[0] = 113;
 
+  /* Block sparsity is not tracked */
+  for (i = 0; i < D_MAX_BLOCKS_IN_MCU; i++)
+    entropy->pub.block_last[i] = DCTSIZE2-1;
+
   if (cinfo->progressive_mode) {
     /* Create progression status table */
     int *coef_bit_ptr, ci;
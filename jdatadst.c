@@ -7,7 +7,8 @@
  * For conditions of distribution and use, see the accompanying README file.
  *
  * This file contains compression data destination routines for the case of
- * emitting JPEG data to memory or to a file (or any stdio stream).
+ * emitting JPEG data to memory, to a file (or any stdio stream), or to an
+ * application callback.
  * While these routines are sufficient for most applications,
  * some will want to use a different destination manager.
  * IMPORTANT: we assume that fwrite() will correctly transcribe an array of
@@ -15,7 +16,10 @@
  * than 8 bits on your machine, you may need to do some tweaking.
  */
 
-/* this is not a core library module, so it doesn't define JPEG_INTERNALS */
+/* This is not a core library module, but the callback manager hooks into
+ * the compression master control, so it needs the internal declarations.
+ */
+#define JPEG_INTERNALS
 #include "jinclude.h"
 #include "jpeglib.h"
 #include "jerror.h"
@@ -55,6 +59,20 @@ typedef struct {
 typedef my_mem_destination_mgr * my_mem_dest_ptr;
 
 
+/* Expanded data destination object for callback output */
+
+typedef struct {
+  struct jpeg_destination_mgr pub; /* public fields */
+
+  jpeg_output_callback callback; /* receives the output data */
+  JOCTET * buffer;		/* start of buffer */
+  int flush_rows;		/* iMCU rows between flushes, 0 = none */
+  int rows_done;		/* iMCU rows since last flush */
+} my_callback_destination_mgr;
+
+typedef my_callback_destination_mgr * my_callback_dest_ptr;
+
+
 /*
  * Initialize destination --- called by jpeg_start_compress
  * before any data is actually written.
@@ -80,6 +98,25 @@ init_mem_destination (j_compress_ptr cinfo)
   /* no work necessary here */
 }
 
+METHODDEF(void) callback_iMCU_row_done JPP((j_compress_ptr cinfo));
+
+METHODDEF(void)
+init_callback_destination (j_compress_ptr cinfo)
+{
+  my_callback_dest_ptr dest = (my_callback_dest_ptr) cinfo->dest;
+
+  /* Allocate the output buffer --- it will be released when done with image */
+  dest->buffer = (JOCTET *)
+      (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+				  OUTPUT_BUF_SIZE * SIZEOF(JOCTET));
+
+  dest->pub.next_output_byte = dest->buffer;
+  dest->pub.free_in_buffer = OUTPUT_BUF_SIZE;
+  dest->rows_done = 0;
+  if (dest->flush_rows > 0)
+    cinfo->master->iMCU_row_done = callback_iMCU_row_done;
+}
+
 
 /*
  * Empty the output buffer --- called whenever buffer fills up.
@@ -149,6 +186,48 @@ empty_mem_output_buffer (j_compress_ptr cinfo)
   return TRUE;
 }
 
+METHODDEF(boolean)
+empty_callback_output_buffer (j_compress_ptr cinfo)
+{
+  my_callback_dest_ptr dest = (my_callback_dest_ptr) cinfo->dest;
+
+  if (! (*dest->callback) (cinfo, dest->buffer, OUTPUT_BUF_SIZE))
+    ERREXIT(cinfo, JERR_FILE_WRITE);
+
+  dest->pub.next_output_byte = dest->buffer;
+  dest->pub.free_in_buffer = OUTPUT_BUF_SIZE;
+
+  return TRUE;
+}
+
+
+/*
+ * Pass on buffered data early --- called by the coefficient controller
+ * after each iMCU row, so that a consumer of callback output sees the image
+ * as it is produced instead of in OUTPUT_BUF_SIZE chunks.
+ * The entropy encoder may still hold a few bits of the last MCU; those go
+ * out with the next row.
+ */
+
+METHODDEF(void)
+callback_iMCU_row_done (j_compress_ptr cinfo)
+{
+  my_callback_dest_ptr dest = (my_callback_dest_ptr) cinfo->dest;
+  size_t datacount;
+
+  if (++dest->rows_done < dest->flush_rows)
+    return;
+  dest->rows_done = 0;
+
+  datacount = OUTPUT_BUF_SIZE - dest->pub.free_in_buffer;
+  if (datacount > 0) {
+    if (! (*dest->callback) (cinfo, dest->buffer, datacount))
+      ERREXIT(cinfo, JERR_FILE_WRITE);
+    dest->pub.next_output_byte = dest->buffer;
+    dest->pub.free_in_buffer = OUTPUT_BUF_SIZE;
+  }
+}
+
 
 /*
  * Terminate destination --- called by jpeg_finish_compress
@@ -185,6 +264,19 @@ term_mem_destination (j_compress_ptr cinfo)
   *dest->outsize = dest->bufsize - dest->pub.free_in_buffer;
 }
 
+METHODDEF(void)
+term_callback_destination (j_compress_ptr cinfo)
+{
+  my_callback_dest_ptr dest = (my_callback_dest_ptr) cinfo->dest;
+  size_t datacount = OUTPUT_BUF_SIZE - dest->pub.free_in_buffer;
+
+  /* Pass on any data remaining in the buffer */
+  if (datacount > 0) {
+    if (! (*dest->callback) (cinfo, dest->buffer, datacount))
+      ERREXIT(cinfo, JERR_FILE_WRITE);
+  }
+}
+
 
 /*
  * Prepare for output to a stdio stream.
@@ -199,11 +291,12 @@ jpeg_stdio_dest (j_compress_ptr cinfo, FILE * outfile)
 
   /* The destination object is made permanent so that multiple JPEG images
    * can be written to the same file without re-executing jpeg_stdio_dest.
-   * This makes it dangerous to use this manager and a different destination
-   * manager serially with the same JPEG object, because their private object
-   * sizes may be different.  Caveat programmer.
+   * The managers in this file differ in private object size, so if the
+   * object was last used with a different destination manager, we make a
+   * new one rather than reuse it.
    */
-  if (cinfo->dest == NULL) {	/* first time for this JPEG object? */
+  if (cinfo->dest == NULL ||	/* first time for this JPEG object? */
+      cinfo->dest->init_destination != init_destination) {
     cinfo->dest = (struct jpeg_destination_mgr *)
       (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_PERMANENT,
 				  SIZEOF(my_destination_mgr));
@@ -242,8 +335,10 @@ jpeg_mem_dest (j_compress_ptr cinfo,
 
   /* The destination object is made permanent so that multiple JPEG images
    * can be written to the same buffer without re-executing jpeg_mem_dest.
+   * As in jpeg_stdio_dest, a manager of another type is not reused.
    */
-  if (cinfo->dest == NULL) {	/* first time for this JPEG object? */
+  if (cinfo->dest == NULL ||	/* first time for this JPEG object? */
+      cinfo->dest->init_destination != init_mem_destination) {
     cinfo->dest = (struct jpeg_destination_mgr *)
       (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_PERMANENT,
 				  SIZEOF(my_mem_destination_mgr));
@@ -268,3 +363,42 @@ jpeg_mem_dest (j_compress_ptr cinfo,
   dest->pub.next_output_byte = dest->buffer = *outbuffer;
   dest->pub.free_in_buffer = dest->bufsize = *outsize;
 }
+
+
+/*
+ * Prepare for output to an application callback.
+ * The callback receives the compressed data in order, in pieces of up to
+ * OUTPUT_BUF_SIZE bytes; it returns FALSE to signal a write error.
+ * Application state can be reached through cinfo->client_data.
+ * If flush_rows is positive, buffered data is also passed on after every
+ * flush_rows iMCU rows, which keeps latency low for streaming consumers.
+ * The callback is responsible for any flushing of its own sink.
+ */
+
+GLOBAL(void)
+jpeg_callback_dest (j_compress_ptr cinfo,
+		    jpeg_output_callback callback, int flush_rows)
+{
+  my_callback_dest_ptr dest;
+
+  if (callback == NULL)		/* sanity check */
+    ERREXIT(cinfo, JERR_BUFFER_SIZE);
+
+  /* The destination object is made permanent so that multiple JPEG images
+   * can be written without re-executing jpeg_callback_dest.
+   * As in jpeg_stdio_dest, a manager of another type is not reused.
+   */
+  if (cinfo->dest == NULL ||	/* first time for this JPEG object? */
+      cinfo->dest->init_destination != init_callback_destination) {
+    cinfo->dest = (struct jpeg_destination_mgr *)
+      (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_PERMANENT,
+				  SIZEOF(my_callback_destination_mgr));
+  }
+
+  dest = (my_callback_dest_ptr) cinfo->dest;
+  dest->pub.init_destination = init_callback_destination;
+  dest->pub.empty_output_buffer = empty_callback_output_buffer;
+  dest->pub.term_destination = term_callback_destination;
+  dest->callback = callback;
+  dest->flush_rows = flush_rows;
+}
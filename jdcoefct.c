@@ -18,6 +18,7 @@
 #define JPEG_INTERNALS
 #include "jinclude.h"
 #include "jpeglib.h"
+#include "jdct.h"		/* for the DC-only output path */
 
 /* Block smoothing is only applicable for progressive JPEG, so: */
 #ifndef D_PROGRESSIVE_SUPPORTED
@@ -65,6 +66,11 @@ typedef my_coef_controller * my_coef_ptr;
 /* Forward declarations */
 METHODDEF(int) decompress_onepass
 	JPP((j_decompress_ptr cinfo, JSAMPIMAGE output_buf));
+#ifdef IDCT_SCALING_SUPPORTED
+LOCAL(boolean) dc_only_ok JPP((j_decompress_ptr cinfo));
+METHODDEF(int) decompress_dc_only
+	JPP((j_decompress_ptr cinfo, JSAMPIMAGE output_buf));
+#endif
 #ifdef D_MULTISCAN_FILES_SUPPORTED
 METHODDEF(int) decompress_data
 	JPP((j_decompress_ptr cinfo, JSAMPIMAGE output_buf));
@@ -119,9 +125,11 @@ start_input_pass (j_decompress_ptr cinfo)
 METHODDEF(void)
 start_output_pass (j_decompress_ptr cinfo)
 {
-#ifdef BLOCK_SMOOTHING_SUPPORTED
+#if defined(BLOCK_SMOOTHING_SUPPORTED) || defined(IDCT_SCALING_SUPPORTED)
   my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
+#endif
 
+#ifdef BLOCK_SMOOTHING_SUPPORTED
   /* If multipass, check to see whether to use block smoothing on this pass */
   if (coef->pub.coef_arrays != NULL) {
     if (cinfo->do_block_smoothing && smoothing_ok(cinfo))
@@ -129,6 +137,15 @@ start_output_pass (j_decompress_ptr cinfo)
     else
       coef->pub.decompress_data = decompress_data;
   }
+#endif
+#ifdef IDCT_SCALING_SUPPORTED
+  /* If single-pass, check to see whether only DC values are needed */
+  if (coef->pub.coef_arrays == NULL) {
+    if (dc_only_ok(cinfo))
+      coef->pub.decompress_data = decompress_dc_only;
+    else
+      coef->pub.decompress_data = decompress_onepass;
+  }
 #endif
   cinfo->output_iMCU_row = 0;
 }
@@ -155,19 +172,23 @@ decompress_onepass (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
   JSAMPARRAY output_ptr;
   JDIMENSION start_col, output_col;
   jpeg_component_info *compptr;
-  inverse_DCT_method_ptr inverse_DCT;
+  inverse_DCT_method_ptr inverse_DCT, inverse_DCT_dc, inverse_DCT_low;
+  JCOEFPTR block;
+  int last, k;
 
   /* Loop to process as much as one whole iMCU row */
   for (yoffset = coef->MCU_vert_offset; yoffset < coef->MCU_rows_per_iMCU_row;
        yoffset++) {
     for (MCU_col_num = coef->MCU_ctr; MCU_col_num <= last_MCU_col;
 	 MCU_col_num++) {
-      /* Try to fetch an MCU.  Entropy decoder expects buffer to be zeroed. */
-      if (cinfo->lim_Se)	/* can bypass in DC only case */
-	FMEMZERO((void FAR *) coef->MCU_buffer[0],
-		 (size_t) (cinfo->blocks_in_MCU * SIZEOF(JBLOCK)));
+      /* Try to fetch an MCU.  Entropy decoder expects buffer to be zeroed;
+       * we clear it after use below, when we know where the data went.
+       */
       if (! (*cinfo->entropy->decode_mcu) (cinfo, coef->MCU_buffer)) {
-	/* Suspension forced; update state counters and exit */
+	/* Suspension forced; discard partial data, update counters and exit */
+	if (cinfo->lim_Se)
+	  FMEMZERO((void FAR *) coef->MCU_buffer[0],
+		   (size_t) (cinfo->blocks_in_MCU * SIZEOF(JBLOCK)));
 	coef->MCU_vert_offset = yoffset;
 	coef->MCU_ctr = MCU_col_num;
 	return JPEG_SUSPENDED;
@@ -186,6 +207,8 @@ decompress_onepass (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
 	  continue;
 	}
 	inverse_DCT = cinfo->idct->inverse_DCT[compptr->component_index];
+	inverse_DCT_dc = cinfo->idct->inverse_DCT_dc[compptr->component_index];
+	inverse_DCT_low = cinfo->idct->inverse_DCT_low[compptr->component_index];
 	useful_width = (MCU_col_num < last_MCU_col) ? compptr->MCU_width
 						    : compptr->last_col_width;
 	output_ptr = output_buf[compptr->component_index] +
@@ -196,9 +219,18 @@ decompress_onepass (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
 	      yoffset+yindex < compptr->last_row_height) {
 	    output_col = start_col;
 	    for (xindex = 0; xindex < useful_width; xindex++) {
-	      (*inverse_DCT) (cinfo, compptr,
-			      (JCOEFPTR) coef->MCU_buffer[blkn+xindex],
-			      output_ptr, output_col);
+	      /* Use a cheaper routine if the block is sparse enough */
+	      block = (JCOEFPTR) coef->MCU_buffer[blkn+xindex];
+	      last = cinfo->entropy->block_last[blkn+xindex];
+	      if (last == 0 && inverse_DCT_dc != NULL)
+		(*inverse_DCT_dc) (cinfo, compptr, block,
+				   output_ptr, output_col);
+	      else if (last <= IDCT_LOW_LAST && inverse_DCT_low != NULL)
+		(*inverse_DCT_low) (cinfo, compptr, block,
+				    output_ptr, output_col);
+	      else
+		(*inverse_DCT) (cinfo, compptr, block,
+				output_ptr, output_col);
 	      output_col += compptr->DCT_h_scaled_size;
 	    }
 	  }
@@ -206,6 +238,20 @@ decompress_onepass (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
 	  output_ptr += compptr->DCT_v_scaled_size;
 	}
       }
+      /* Clear the buffer for the next MCU (can bypass in DC only case).
+       * Only the positions the entropy decoder may have written need it.
+       */
+      if (cinfo->lim_Se) {
+	for (blkn = 0; blkn < cinfo->blocks_in_MCU; blkn++) {
+	  last = cinfo->entropy->block_last[blkn];
+	  if (last < 16) {
+	    block = (JCOEFPTR) coef->MCU_buffer[blkn];
+	    for (k = 0; k <= last; k++)
+	      block[jpeg_natural_order[k]] = 0;
+	  } else
+	    FMEMZERO((void FAR *) coef->MCU_buffer[blkn], SIZEOF(JBLOCK));
+	}
+      }
     }
     /* Completed an MCU row, but perhaps not an iMCU row */
     coef->MCU_ctr = 0;
@@ -222,6 +268,122 @@ decompress_onepass (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
 }
 
 
+#ifdef IDCT_SCALING_SUPPORTED
+
+/*
+ * Determine whether the DC-only variant of decompress_onepass can be used.
+ * This is so when every component we output is scaled down to one sample
+ * per block (1/8 scaling), so that its IDCT is jpeg_idct_1x1.
+ */
+
+LOCAL(boolean)
+dc_only_ok (j_decompress_ptr cinfo)
+{
+  int ci;
+  jpeg_component_info *compptr;
+
+  for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+       ci++, compptr++) {
+    if (compptr->component_needed &&
+	(compptr->DCT_h_scaled_size != 1 || compptr->DCT_v_scaled_size != 1))
+      return FALSE;
+  }
+  return TRUE;
+}
+
+
+/*
+ * Variant of decompress_onepass for the DC-only case.
+ * The entropy decoder stores just the DC coefficient of each block, and
+ * we turn it into the output sample right here, exactly as jpeg_idct_1x1
+ * would, rather than making an IDCT call per block.  Only the DC entries
+ * of the MCU buffer are ever used, so only they need clearing.
+ */
+
+METHODDEF(int)
+decompress_dc_only (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
+{
+  my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
+  JDIMENSION MCU_col_num;	/* index of current MCU within row */
+  JDIMENSION last_MCU_col = cinfo->MCUs_per_row - 1;
+  JDIMENSION last_iMCU_row = cinfo->total_iMCU_rows - 1;
+  int blkn, ci, xindex, yindex, yoffset, useful_width;
+  JSAMPROW output_row;
+  JDIMENSION output_col;
+  jpeg_component_info *compptr;
+  ISLOW_MULT_TYPE dcquant;
+  JCOEFPTR block;
+  int dcval;
+  JSAMPLE *range_limit = IDCT_range_limit(cinfo);
+  SHIFT_TEMPS
+
+  /* Loop to process as much as one whole iMCU row */
+  for (yoffset = coef->MCU_vert_offset; yoffset < coef->MCU_rows_per_iMCU_row;
+       yoffset++) {
+    for (MCU_col_num = coef->MCU_ctr; MCU_col_num <= last_MCU_col;
+	 MCU_col_num++) {
+      /* Try to fetch an MCU. */
+      if (! (*cinfo->entropy->decode_mcu) (cinfo, coef->MCU_buffer)) {
+	/* Suspension forced; discard partial data, update counters and exit */
+	for (blkn = 0; blkn < cinfo->blocks_in_MCU; blkn++)
+	  coef->MCU_buffer[blkn][0][0] = 0;
+	coef->MCU_vert_offset = yoffset;
+	coef->MCU_ctr = MCU_col_num;
+	return JPEG_SUSPENDED;
+      }
+      /* Determine where data should go in output_buf and emit the samples.
+       * We skip dummy blocks at the right and bottom edges (but blkn gets
+       * incremented past them!).  Each block yields one sample, so the
+       * output row and column advance by one per block.
+       */
+      blkn = 0;			/* index of current DCT block within MCU */
+      for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+	compptr = cinfo->cur_comp_info[ci];
+	/* Don't bother with an uninteresting component. */
+	if (! compptr->component_needed) {
+	  blkn += compptr->MCU_blocks;
+	  continue;
+	}
+	dcquant = ((ISLOW_MULT_TYPE *) compptr->dct_table)[0];
+	useful_width = (MCU_col_num < last_MCU_col) ? compptr->MCU_width
+						    : compptr->last_col_width;
+	for (yindex = 0; yindex < compptr->MCU_height; yindex++) {
+	  if (cinfo->input_iMCU_row < last_iMCU_row ||
+	      yoffset+yindex < compptr->last_row_height) {
+	    output_row = output_buf[compptr->component_index][yoffset+yindex];
+	    output_col = MCU_col_num * compptr->MCU_sample_width;
+	    for (xindex = 0; xindex < useful_width; xindex++) {
+	      block = (JCOEFPTR) coef->MCU_buffer[blkn+xindex];
+	      /* Same arithmetic as jpeg_idct_1x1 */
+	      dcval = (int) (((ISLOW_MULT_TYPE) block[0]) * dcquant);
+	      dcval = (int) DESCALE((INT32) dcval, 3);
+	      output_row[output_col++] = range_limit[dcval & RANGE_MASK];
+	    }
+	  }
+	  blkn += compptr->MCU_width;
+	}
+      }
+      /* Clear the DC entries for the next MCU */
+      for (blkn = 0; blkn < cinfo->blocks_in_MCU; blkn++)
+	coef->MCU_buffer[blkn][0][0] = 0;
+    }
+    /* Completed an MCU row, but perhaps not an iMCU row */
+    coef->MCU_ctr = 0;
+  }
+  /* Completed the iMCU row, advance counters for next one */
+  cinfo->output_iMCU_row++;
+  if (++(cinfo->input_iMCU_row) < cinfo->total_iMCU_rows) {
+    start_iMCU_row(cinfo);
+    return JPEG_ROW_COMPLETED;
+  }
+  /* Completed the scan */
+  (*cinfo->inputctl->finish_input_pass) (cinfo);
+  return JPEG_SCAN_COMPLETED;
+}
+
+#endif /* IDCT_SCALING_SUPPORTED */
+
+
 /*
  * Dummy consume-input routine for single-pass operation.
  */
@@ -731,9 +893,9 @@ jinit_d_coef_controller (j_decompress_ptr cinfo, boolean need_full_buffer)
     for (i = 0; i < D_MAX_BLOCKS_IN_MCU; i++) {
       coef->MCU_buffer[i] = buffer + i;
     }
-    if (cinfo->lim_Se == 0)	/* DC only case: want to bypass later */
-      FMEMZERO((void FAR *) buffer,
-	       (size_t) (D_MAX_BLOCKS_IN_MCU * SIZEOF(JBLOCK)));
+    /* decompress_onepass clears blocks after use, so start out clear */
+    FMEMZERO((void FAR *) buffer,
+	     (size_t) (D_MAX_BLOCKS_IN_MCU * SIZEOF(JBLOCK)));
     coef->pub.consume_data = dummy_consume_data;
     coef->pub.decompress_data = decompress_onepass;
     coef->pub.coef_arrays = NULL; /* flag for no virtual arrays */
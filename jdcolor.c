@@ -13,6 +13,14 @@
 #include "jinclude.h"
 #include "jpeglib.h"
 
+/* The SSE2 code handles 8-bit samples in 3-byte RGB pixels */
+#ifdef JSIMD_SSE2
+#if BITS_IN_JSAMPLE == 8 && RGB_PIXELSIZE == 3
+#define COLOR_SSE2_SUPPORTED
+#include <emmintrin.h>
+#endif
+#endif
+
 
 /* Private subobject */
 
@@ -20,16 +28,22 @@ typedef struct {
   struct jpeg_color_deconverter pub; /* public fields */
 
   /* Private state for YCbCr->RGB and BG_YCC->RGB conversion */
-  int * Cr_r_tab;		/* => table for Cr to R conversion */
-  int * Cb_b_tab;		/* => table for Cb to B conversion */
-  INT32 * Cr_g_tab;		/* => table for Cr to G conversion */
-  INT32 * Cb_g_tab;		/* => table for Cb to G conversion */
+  const int * Cr_r_tab;		/* => table for Cr to R conversion */
+  const int * Cb_b_tab;		/* => table for Cb to B conversion */
+  const INT32 * Cr_g_tab;	/* => table for Cr to G conversion */
+  const INT32 * Cb_g_tab;	/* => table for Cb to G conversion */
 
   JSAMPLE * range_limit; /* pointer to normal sample range limit table, */
 		     /* or extended sample range limit table for BG_YCC */
 
   /* Private state for RGB->Y conversion */
-  INT32 * rgb_y_tab;		/* => table for RGB to Y conversion */
+  const INT32 * rgb_y_tab;	/* => table for RGB to Y conversion */
+
+#ifdef COLOR_SSE2_SUPPORTED
+  /* Cr=>R, Cb=>B, Cb=>G and Cr=>G multipliers for the SSE2 code */
+  short whole[4];		/* integral parts */
+  short frac[4];		/* remainders, scaled up by 2^16 */
+#endif
 } my_color_deconverter;
 
 typedef my_color_deconverter * my_cconvert_ptr;
@@ -89,14 +103,16 @@ typedef my_color_deconverter * my_cconvert_ptr;
  * The Cr=>R and Cb=>B values can be rounded to integers in advance; the
  * values for the G calculation are left scaled up, since we must add them
  * together before rounding.
+ * The tables do not depend on the image, so they are constants shared by
+ * all decompression objects.
  */
 
 #define SCALEBITS	16	/* speediest right-shift on some machines */
 #define ONE_HALF	((INT32) 1 << (SCALEBITS-1))
 #define FIX(x)		((INT32) ((x) * (1L<<SCALEBITS) + 0.5))
 
-/* We allocate one big table for RGB->Y conversion and divide it up into
- * three parts, instead of doing three alloc_small requests.  This lets us
+/* We use one big table for RGB->Y conversion and divide it up into
+ * three parts, instead of having three separate tables.  This lets us
  * use a single table base address, which can be held in a register in the
  * inner loops on many machines (more than can hold all three addresses,
  * anyway).
@@ -108,49 +124,110 @@ typedef my_color_deconverter * my_cconvert_ptr;
 #define TABLE_SIZE	(3*(MAXJSAMPLE+1))
 
 
+
+
 /*
- * Initialize tables for YCbCr->RGB and BG_YCC->RGB colorspace conversion.
+ * Conversion tables for YCbCr->RGB and BG_YCC->RGB colorspace conversion.
+ * The entries are written as constant expressions; CBCR_BIAS keeps the
+ * value being shifted nonnegative, so that the shift rounds down exactly
+ * as RIGHT_SHIFT does.
  */
 
-LOCAL(void)
-build_ycc_rgb_table (j_decompress_ptr cinfo)
+#define CBCR_BIAS	(2*(MAXJSAMPLE+1))	/* exceeds any |Cr=>R|, |Cb=>B| */
+
+/* Nearest int to k * x, x being the Cb or Cr value less CENTERJSAMPLE */
+#define ROUND_TAB(k,i) \
+  ((int) ((FIX(k) * ((INT32) (i) - CENTERJSAMPLE) + ONE_HALF + \
+	   ((INT32) CBCR_BIAS << SCALEBITS)) >> SCALEBITS) - CBCR_BIAS)
+/* Scaled-up k * x */
+#define SCALE_TAB(k,i)	(FIX(k) * ((INT32) (i) - CENTERJSAMPLE))
+
 /* Normal case, sYCC */
+#define CR_R(i)		ROUND_TAB(1.402, i)
+#define CB_B(i)		ROUND_TAB(1.772, i)
+#define CR_G(i)		(- SCALE_TAB(0.714136286, i))
+/* We also add in ONE_HALF so that need not do it in inner loop */
+#define CB_G(i)		(- SCALE_TAB(0.344136286, i) + ONE_HALF)
+
+const int jpeg_cr_r_tab[MAXJSAMPLE+1] = { JSAMPLE_TABLE(CR_R, 0) };
+const int jpeg_cb_b_tab[MAXJSAMPLE+1] = { JSAMPLE_TABLE(CB_B, 0) };
+const INT32 jpeg_cr_g_tab[MAXJSAMPLE+1] = { JSAMPLE_TABLE(CR_G, 0) };
+const INT32 jpeg_cb_g_tab[MAXJSAMPLE+1] = { JSAMPLE_TABLE(CB_G, 0) };
+
+/* Wide gamut case, bg-sYCC */
+#define BG_CR_R(i)	ROUND_TAB(2.804, i)
+#define BG_CB_B(i)	ROUND_TAB(3.544, i)
+#define BG_CR_G(i)	(- SCALE_TAB(1.428272572, i))
+#define BG_CB_G(i)	(- SCALE_TAB(0.688272572, i) + ONE_HALF)
+
+static const int bg_cr_r_tab[MAXJSAMPLE+1] = { JSAMPLE_TABLE(BG_CR_R, 0) };
+static const int bg_cb_b_tab[MAXJSAMPLE+1] = { JSAMPLE_TABLE(BG_CB_B, 0) };
+static const INT32 bg_cr_g_tab[MAXJSAMPLE+1] = { JSAMPLE_TABLE(BG_CR_G, 0) };
+static const INT32 bg_cb_g_tab[MAXJSAMPLE+1] = { JSAMPLE_TABLE(BG_CB_G, 0) };
+
+/* Cb and Cr portions can extend to double range in wide gamut case,
+ * so we need an extended range limit table.
+ */
+
+#define RL_ZERO(i)	0
+#define RL_SAME(i)	(i)
+#define RL_MAX(i)	MAXJSAMPLE
+
+static const JSAMPLE bg_range_limit_table[5 * (MAXJSAMPLE+1)] = {
+  /* First segment of range limit table: limit[x] = 0 for x < 0 */
+  JSAMPLE_TABLE(RL_ZERO, 0), JSAMPLE_TABLE(RL_ZERO, 0),
+  /* Main part of range limit table: limit[x] = x */
+  JSAMPLE_TABLE(RL_SAME, 0),
+  /* End of range limit table: limit[x] = MAXJSAMPLE for x > MAXJSAMPLE */
+  JSAMPLE_TABLE(RL_MAX, 0), JSAMPLE_TABLE(RL_MAX, 0)
+};
+
+
+#ifdef COLOR_SSE2_SUPPORTED
+
+LOCAL(void)
+split_multipliers (my_cconvert_ptr cconvert, INT32 cr_r, INT32 cb_b,
+		   INT32 cb_g, INT32 cr_g)
+/* Set up the YCC->RGB conversion constants for the SSE2 code below */
 {
-  my_cconvert_ptr cconvert = (my_cconvert_ptr) cinfo->cconvert;
+  INT32 k[4];
   int i;
-  INT32 x;
   SHIFT_TEMPS
 
-  cconvert->Cr_r_tab = (int *)
-    (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
-				(MAXJSAMPLE+1) * SIZEOF(int));
-  cconvert->Cb_b_tab = (int *)
-    (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
-				(MAXJSAMPLE+1) * SIZEOF(int));
-  cconvert->Cr_g_tab = (INT32 *)
-    (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
-				(MAXJSAMPLE+1) * SIZEOF(INT32));
-  cconvert->Cb_g_tab = (INT32 *)
-    (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
-				(MAXJSAMPLE+1) * SIZEOF(INT32));
+  k[0] = cr_r;
+  k[1] = cb_b;
+  k[2] = cb_g;
+  k[3] = cr_g;
+  for (i = 0; i < 4; i++) {
+    cconvert->whole[i] = (short) RIGHT_SHIFT(k[i] + ONE_HALF, SCALEBITS);
+    cconvert->frac[i] = (short)
+      (k[i] - (INT32) cconvert->whole[i] * ((INT32) 1 << SCALEBITS));
+  }
+}
+
+#endif
+
+
+/*
+ * Initialize for YCbCr->RGB and BG_YCC->RGB colorspace conversion.
+ */
+
+LOCAL(void)
+build_ycc_rgb_table (j_decompress_ptr cinfo)
+/* Normal case, sYCC */
+{
+  my_cconvert_ptr cconvert = (my_cconvert_ptr) cinfo->cconvert;
 
+  cconvert->Cr_r_tab = jpeg_cr_r_tab;
+  cconvert->Cb_b_tab = jpeg_cb_b_tab;
+  cconvert->Cr_g_tab = jpeg_cr_g_tab;
+  cconvert->Cb_g_tab = jpeg_cb_g_tab;
   cconvert->range_limit = cinfo->sample_range_limit;
 
-  for (i = 0, x = -CENTERJSAMPLE; i <= MAXJSAMPLE; i++, x++) {
-    /* i is the actual input pixel value, in the range 0..MAXJSAMPLE */
-    /* The Cb or Cr value we are thinking of is x = i - CENTERJSAMPLE */
-    /* Cr=>R value is nearest int to 1.402 * x */
-    cconvert->Cr_r_tab[i] = (int)
-		    RIGHT_SHIFT(FIX(1.402) * x + ONE_HALF, SCALEBITS);
-    /* Cb=>B value is nearest int to 1.772 * x */
-    cconvert->Cb_b_tab[i] = (int)
-		    RIGHT_SHIFT(FIX(1.772) * x + ONE_HALF, SCALEBITS);
-    /* Cr=>G value is scaled-up -0.714136286 * x */
-    cconvert->Cr_g_tab[i] = (- FIX(0.714136286)) * x;
-    /* Cb=>G value is scaled-up -0.344136286 * x */
-    /* We also add in ONE_HALF so that need not do it in inner loop */
-    cconvert->Cb_g_tab[i] = (- FIX(0.344136286)) * x + ONE_HALF;
-  }
+#ifdef COLOR_SSE2_SUPPORTED
+  split_multipliers(cconvert, FIX(1.402), FIX(1.772),
+		    - FIX(0.344136286), - FIX(0.714136286));
+#endif
 }
 
 
@@ -159,56 +236,18 @@ build_bg_ycc_rgb_table (j_decompress_ptr cinfo)
 /* Wide gamut case, bg-sYCC */
 {
   my_cconvert_ptr cconvert = (my_cconvert_ptr) cinfo->cconvert;
-  int i;
-  INT32 x;
-  SHIFT_TEMPS
-
-  cconvert->Cr_r_tab = (int *)
-    (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
-				(MAXJSAMPLE+1) * SIZEOF(int));
-  cconvert->Cb_b_tab = (int *)
-    (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
-				(MAXJSAMPLE+1) * SIZEOF(int));
-  cconvert->Cr_g_tab = (INT32 *)
-    (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
-				(MAXJSAMPLE+1) * SIZEOF(INT32));
-  cconvert->Cb_g_tab = (INT32 *)
-    (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
-				(MAXJSAMPLE+1) * SIZEOF(INT32));
-
-  cconvert->range_limit = (JSAMPLE *)
-    (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
-				5 * (MAXJSAMPLE+1) * SIZEOF(JSAMPLE));
-
-  for (i = 0, x = -CENTERJSAMPLE; i <= MAXJSAMPLE; i++, x++) {
-    /* i is the actual input pixel value, in the range 0..MAXJSAMPLE */
-    /* The Cb or Cr value we are thinking of is x = i - CENTERJSAMPLE */
-    /* Cr=>R value is nearest int to 2.804 * x */
-    cconvert->Cr_r_tab[i] = (int)
-		    RIGHT_SHIFT(FIX(2.804) * x + ONE_HALF, SCALEBITS);
-    /* Cb=>B value is nearest int to 3.544 * x */
-    cconvert->Cb_b_tab[i] = (int)
-		    RIGHT_SHIFT(FIX(3.544) * x + ONE_HALF, SCALEBITS);
-    /* Cr=>G value is scaled-up -1.428272572 * x */
-    cconvert->Cr_g_tab[i] = (- FIX(1.428272572)) * x;
-    /* Cb=>G value is scaled-up -0.688272572 * x */
-    /* We also add in ONE_HALF so that need not do it in inner loop */
-    cconvert->Cb_g_tab[i] = (- FIX(0.688272572)) * x + ONE_HALF;
-  }
-
-  /* Cb and Cr portions can extend to double range in wide gamut case,
-   * so we prepare an appropriate extended range limit table.
-   */
 
-  /* First segment of range limit table: limit[x] = 0 for x < 0 */
-  MEMZERO(cconvert->range_limit, 2 * (MAXJSAMPLE+1) * SIZEOF(JSAMPLE));
-  cconvert->range_limit += 2 * (MAXJSAMPLE+1);
-  /* Main part of range limit table: limit[x] = x */
-  for (i = 0; i <= MAXJSAMPLE; i++)
-    cconvert->range_limit[i] = (JSAMPLE) i;
-  /* End of range limit table: limit[x] = MAXJSAMPLE for x > MAXJSAMPLE */
-  for (; i < 3 * (MAXJSAMPLE+1); i++)
-    cconvert->range_limit[i] = MAXJSAMPLE;
+  cconvert->Cr_r_tab = bg_cr_r_tab;
+  cconvert->Cb_b_tab = bg_cb_b_tab;
+  cconvert->Cr_g_tab = bg_cr_g_tab;
+  cconvert->Cb_g_tab = bg_cb_g_tab;
+  cconvert->range_limit =
+    (JSAMPLE *) bg_range_limit_table + 2 * (MAXJSAMPLE+1);
+
+#ifdef COLOR_SSE2_SUPPORTED
+  split_multipliers(cconvert, FIX(2.804), FIX(3.544),
+		    - FIX(0.688272572), - FIX(1.428272572));
+#endif
 }
 
 
@@ -236,10 +275,10 @@ ycc_rgb_convert (j_decompress_ptr cinfo,
   JDIMENSION num_cols = cinfo->output_width;
   /* copy these pointers into registers if possible */
   register JSAMPLE * range_limit = cconvert->range_limit;
-  register int * Crrtab = cconvert->Cr_r_tab;
-  register int * Cbbtab = cconvert->Cb_b_tab;
-  register INT32 * Crgtab = cconvert->Cr_g_tab;
-  register INT32 * Cbgtab = cconvert->Cb_g_tab;
+  register const int * Crrtab = cconvert->Cr_r_tab;
+  register const int * Cbbtab = cconvert->Cb_b_tab;
+  register const INT32 * Crgtab = cconvert->Cr_g_tab;
+  register const INT32 * Cbgtab = cconvert->Cb_g_tab;
   SHIFT_TEMPS
 
   while (--num_rows >= 0) {
@@ -273,23 +312,21 @@ ycc_rgb_convert (j_decompress_ptr cinfo,
  * Initialize for RGB->grayscale colorspace conversion.
  */
 
+#define R_Y(i)		(FIX(0.299) * (i))
+#define G_Y(i)		(FIX(0.587) * (i))
+#define B_Y(i)		(FIX(0.114) * (i) + ONE_HALF)
+
+static const INT32 rgb_y_table[TABLE_SIZE] = {
+  JSAMPLE_TABLE(R_Y, 0), JSAMPLE_TABLE(G_Y, 0), JSAMPLE_TABLE(B_Y, 0)
+};
+
+
 LOCAL(void)
 build_rgb_y_table (j_decompress_ptr cinfo)
 {
   my_cconvert_ptr cconvert = (my_cconvert_ptr) cinfo->cconvert;
-  INT32 * rgb_y_tab;
-  INT32 i;
 
-  /* Allocate and fill in the conversion tables. */
-  cconvert->rgb_y_tab = rgb_y_tab = (INT32 *)
-    (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
-				(TABLE_SIZE * SIZEOF(INT32)));
-
-  for (i = 0; i <= MAXJSAMPLE; i++) {
-    rgb_y_tab[i+R_Y_OFF] = FIX(0.299) * i;
-    rgb_y_tab[i+G_Y_OFF] = FIX(0.587) * i;
-    rgb_y_tab[i+B_Y_OFF] = FIX(0.114) * i + ONE_HALF;
-  }
+  cconvert->rgb_y_tab = rgb_y_table;
 }
 
 
@@ -303,7 +340,7 @@ rgb_gray_convert (j_decompress_ptr cinfo,
 		  JSAMPARRAY output_buf, int num_rows)
 {
   my_cconvert_ptr cconvert = (my_cconvert_ptr) cinfo->cconvert;
-  register INT32 * ctab = cconvert->rgb_y_tab;
+  register const INT32 * ctab = cconvert->rgb_y_tab;
   register int r, g, b;
   register JSAMPROW outptr;
   register JSAMPROW inptr0, inptr1, inptr2;
@@ -381,7 +418,7 @@ rgb1_gray_convert (j_decompress_ptr cinfo,
 		   JSAMPARRAY output_buf, int num_rows)
 {
   my_cconvert_ptr cconvert = (my_cconvert_ptr) cinfo->cconvert;
-  register INT32 * ctab = cconvert->rgb_y_tab;
+  register const INT32 * ctab = cconvert->rgb_y_tab;
   register int r, g, b;
   register JSAMPROW outptr;
   register JSAMPROW inptr0, inptr1, inptr2;
@@ -540,10 +577,10 @@ ycck_cmyk_convert (j_decompress_ptr cinfo,
   JDIMENSION num_cols = cinfo->output_width;
   /* copy these pointers into registers if possible */
   register JSAMPLE * range_limit = cinfo->sample_range_limit;
-  register int * Crrtab = cconvert->Cr_r_tab;
-  register int * Cbbtab = cconvert->Cb_b_tab;
-  register INT32 * Crgtab = cconvert->Cr_g_tab;
-  register INT32 * Cbgtab = cconvert->Cb_g_tab;
+  register const int * Crrtab = cconvert->Cr_r_tab;
+  register const int * Cbbtab = cconvert->Cb_b_tab;
+  register const INT32 * Crgtab = cconvert->Cr_g_tab;
+  register const INT32 * Cbgtab = cconvert->Cb_g_tab;
   SHIFT_TEMPS
 
   while (--num_rows >= 0) {
@@ -573,6 +610,289 @@ ycck_cmyk_convert (j_decompress_ptr cinfo,
 }
 
 
+#ifdef COLOR_SSE2_SUPPORTED
+
+/*
+ * SSE2 versions of the YCC->RGB, RGB->Y and inverse color transform
+ * conversions above, which work on 16 pixels at a time.
+ *
+ * Instead of table lookups the YCC->RGB code multiplies by the constants
+ * directly.  Each constant (scaled up by 2^16) is split into an integral
+ * part and a remainder that fits in 16 bits, so that e.g. for Cr=>R
+ *	RIGHT_SHIFT(K * x + ONE_HALF, SCALEBITS)
+ *	  = whole * x + RIGHT_SHIFT(frac * x + ONE_HALF, SCALEBITS)
+ * exactly.  The range limit tables simply clamp the possible sums, so
+ * saturating to 0..MAXJSAMPLE does the same.  The results are exactly
+ * those of the table versions.  A partial group at the end of a row goes
+ * through a small buffer.
+ */
+
+/* A pair of multipliers, repeated for _mm_madd_epi16 */
+#define PAIR_SSE2(a,b) \
+  _mm_setr_epi16((short) (a), (short) (b), (short) (a), (short) (b), \
+		 (short) (a), (short) (b), (short) (a), (short) (b))
+
+
+INLINE
+LOCAL(void)
+store_rgb_sse2 (JSAMPROW outptr, __m128i * rgb)
+/* Interleave the planes rgb[0..2] into 16 pixels.  Each round below
+ * gathers the even bytes of the 48 and then the odd ones; after four
+ * rounds every third byte comes from the same plane.
+ */
+{
+  __m128i t0, t1, t2;
+  __m128i mask = _mm_set1_epi16(0xFF);
+  int i;
+
+  for (i = 0; i < 4; i++) {
+    t0 = _mm_packus_epi16(_mm_and_si128(rgb[0], mask),
+			  _mm_and_si128(rgb[1], mask));
+    t1 = _mm_packus_epi16(_mm_and_si128(rgb[2], mask),
+			  _mm_srli_epi16(rgb[0], 8));
+    t2 = _mm_packus_epi16(_mm_srli_epi16(rgb[1], 8),
+			  _mm_srli_epi16(rgb[2], 8));
+    rgb[0] = t0; rgb[1] = t1; rgb[2] = t2;
+  }
+  _mm_storeu_si128((__m128i *) outptr, rgb[0]);
+  _mm_storeu_si128((__m128i *) (outptr + 16), rgb[1]);
+  _mm_storeu_si128((__m128i *) (outptr + 32), rgb[2]);
+}
+
+
+INLINE
+LOCAL(__m128i)
+fraction_sse2 (__m128i x, short frac)
+/* RIGHT_SHIFT(frac * x + ONE_HALF, SCALEBITS) for eight 16-bit lanes:
+ * the high half of the product, plus one where the low half rounds up.
+ */
+{
+  __m128i mult = _mm_set1_epi16(frac);
+
+  return _mm_add_epi16(_mm_mulhi_epi16(x, mult),
+		       _mm_srli_epi16(_mm_mullo_epi16(x, mult), 15));
+}
+
+
+INLINE
+LOCAL(void)
+ycc_rgb_sse2 (my_cconvert_ptr cconvert, JSAMPROW inptr0, JSAMPROW inptr1,
+	      JSAMPROW inptr2, JSAMPROW outptr)
+/* Convert 16 pixels to RGB */
+{
+  __m128i y, cb, cr, zero, center, g, lo, hi;
+  __m128i red[2], green[2], blue[2], rgb[3];
+  int i;
+
+  zero = _mm_setzero_si128();
+  center = _mm_set1_epi16(CENTERJSAMPLE);
+  for (i = 0; i < 2; i++) {
+    y  = _mm_loadl_epi64((const __m128i *) (inptr0 + 8*i));
+    cb = _mm_loadl_epi64((const __m128i *) (inptr1 + 8*i));
+    cr = _mm_loadl_epi64((const __m128i *) (inptr2 + 8*i));
+    y  = _mm_unpacklo_epi8(y, zero);
+    cb = _mm_sub_epi16(_mm_unpacklo_epi8(cb, zero), center);
+    cr = _mm_sub_epi16(_mm_unpacklo_epi8(cr, zero), center);
+
+    red[i] = _mm_add_epi16(_mm_add_epi16(y, fraction_sse2(cr,
+							  cconvert->frac[0])),
+			   _mm_mullo_epi16(cr,
+					   _mm_set1_epi16(cconvert->whole[0])));
+    blue[i] = _mm_add_epi16(_mm_add_epi16(y, fraction_sse2(cb,
+							   cconvert->frac[1])),
+			    _mm_mullo_epi16(cb,
+					    _mm_set1_epi16(cconvert->whole[1])));
+
+    /* The G fractions are summed before rounding, as in the tables */
+    lo = _mm_madd_epi16(_mm_unpacklo_epi16(cb, cr),
+			PAIR_SSE2(cconvert->frac[2], cconvert->frac[3]));
+    hi = _mm_madd_epi16(_mm_unpackhi_epi16(cb, cr),
+			PAIR_SSE2(cconvert->frac[2], cconvert->frac[3]));
+    lo = _mm_srai_epi32(_mm_add_epi32(lo, _mm_set1_epi32(ONE_HALF)),
+			SCALEBITS);
+    hi = _mm_srai_epi32(_mm_add_epi32(hi, _mm_set1_epi32(ONE_HALF)),
+			SCALEBITS);
+    g = _mm_add_epi16(_mm_mullo_epi16(cb, _mm_set1_epi16(cconvert->whole[2])),
+		      _mm_mullo_epi16(cr, _mm_set1_epi16(cconvert->whole[3])));
+    green[i] = _mm_add_epi16(_mm_add_epi16(y, g), _mm_packs_epi32(lo, hi));
+  }
+  rgb[RGB_RED]   = _mm_packus_epi16(red[0], red[1]);
+  rgb[RGB_GREEN] = _mm_packus_epi16(green[0], green[1]);
+  rgb[RGB_BLUE]  = _mm_packus_epi16(blue[0], blue[1]);
+  store_rgb_sse2(outptr, rgb);
+}
+
+
+INLINE
+LOCAL(void)
+rgb_gray_sse2 (JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW inptr2,
+	       JSAMPROW outptr)
+/* Convert 16 pixels to grayscale.  FIX(0.587) does not fit in a signed
+ * 16-bit multiplier, so G is multiplied by two halves of it.
+ */
+{
+  __m128i r, g, b, zero, rg, bg, y[4];
+  int i;
+
+  zero = _mm_setzero_si128();
+  for (i = 0; i < 2; i++) {
+    r = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)
+					  (inptr0 + 8*i)), zero);
+    g = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)
+					  (inptr1 + 8*i)), zero);
+    b = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)
+					  (inptr2 + 8*i)), zero);
+    rg = _mm_unpacklo_epi16(r, g);
+    bg = _mm_unpacklo_epi16(b, g);
+    y[2*i] = _mm_add_epi32(
+      _mm_madd_epi16(rg, PAIR_SSE2(FIX(0.299), FIX(0.587) - FIX(0.587)/2)),
+      _mm_madd_epi16(bg, PAIR_SSE2(FIX(0.114), FIX(0.587)/2)));
+    rg = _mm_unpackhi_epi16(r, g);
+    bg = _mm_unpackhi_epi16(b, g);
+    y[2*i+1] = _mm_add_epi32(
+      _mm_madd_epi16(rg, PAIR_SSE2(FIX(0.299), FIX(0.587) - FIX(0.587)/2)),
+      _mm_madd_epi16(bg, PAIR_SSE2(FIX(0.114), FIX(0.587)/2)));
+  }
+  for (i = 0; i < 4; i++)
+    y[i] = _mm_srli_epi32(_mm_add_epi32(y[i], _mm_set1_epi32(ONE_HALF)),
+			  SCALEBITS);
+  _mm_storeu_si128((__m128i *) outptr,
+		   _mm_packus_epi16(_mm_packs_epi32(y[0], y[1]),
+				    _mm_packs_epi32(y[2], y[3])));
+}
+
+
+INLINE
+LOCAL(void)
+rgb1_rgb_sse2 (JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW inptr2,
+	       JSAMPROW outptr)
+/* Apply the inverse color transform to 16 pixels */
+{
+  __m128i rgb[3], g;
+  __m128i center = _mm_set1_epi8((char) CENTERJSAMPLE);
+
+  g = _mm_loadu_si128((const __m128i *) inptr1);
+  /* Byte arithmetic wraps around modulo MAXJSAMPLE+1 */
+  rgb[RGB_RED] = _mm_sub_epi8(
+    _mm_add_epi8(_mm_loadu_si128((const __m128i *) inptr0), g), center);
+  rgb[RGB_GREEN] = g;
+  rgb[RGB_BLUE] = _mm_sub_epi8(
+    _mm_add_epi8(_mm_loadu_si128((const __m128i *) inptr2), g), center);
+  store_rgb_sse2(outptr, rgb);
+}
+
+
+METHODDEF(void)
+ycc_rgb_convert_sse2 (j_decompress_ptr cinfo,
+		      JSAMPIMAGE input_buf, JDIMENSION input_row,
+		      JSAMPARRAY output_buf, int num_rows)
+/* SSE2 version of ycc_rgb_convert */
+{
+  my_cconvert_ptr cconvert = (my_cconvert_ptr) cinfo->cconvert;
+  JSAMPLE inbuf[3][16];
+  JSAMPLE outbuf[16 * RGB_PIXELSIZE];
+  JSAMPROW inptr0, inptr1, inptr2;
+  JSAMPROW outptr;
+  JDIMENSION col, rest;
+  JDIMENSION num_cols = cinfo->output_width;
+
+  while (--num_rows >= 0) {
+    inptr0 = input_buf[0][input_row];
+    inptr1 = input_buf[1][input_row];
+    inptr2 = input_buf[2][input_row];
+    input_row++;
+    outptr = *output_buf++;
+    for (col = 0; col + 16 <= num_cols; col += 16) {
+      ycc_rgb_sse2(cconvert, inptr0 + col, inptr1 + col, inptr2 + col, outptr);
+      outptr += 16 * RGB_PIXELSIZE;
+    }
+    if (col < num_cols) {
+      rest = num_cols - col;
+      MEMZERO(inbuf, SIZEOF(inbuf));
+      MEMCOPY(inbuf[0], inptr0 + col, rest * SIZEOF(JSAMPLE));
+      MEMCOPY(inbuf[1], inptr1 + col, rest * SIZEOF(JSAMPLE));
+      MEMCOPY(inbuf[2], inptr2 + col, rest * SIZEOF(JSAMPLE));
+      ycc_rgb_sse2(cconvert, inbuf[0], inbuf[1], inbuf[2], outbuf);
+      MEMCOPY(outptr, outbuf, rest * RGB_PIXELSIZE * SIZEOF(JSAMPLE));
+    }
+  }
+}
+
+
+METHODDEF(void)
+rgb_gray_convert_sse2 (j_decompress_ptr cinfo,
+		       JSAMPIMAGE input_buf, JDIMENSION input_row,
+		       JSAMPARRAY output_buf, int num_rows)
+/* SSE2 version of rgb_gray_convert */
+{
+  JSAMPLE inbuf[3][16];
+  JSAMPLE outbuf[16];
+  JSAMPROW inptr0, inptr1, inptr2;
+  JSAMPROW outptr;
+  JDIMENSION col, rest;
+  JDIMENSION num_cols = cinfo->output_width;
+
+  while (--num_rows >= 0) {
+    inptr0 = input_buf[0][input_row];
+    inptr1 = input_buf[1][input_row];
+    inptr2 = input_buf[2][input_row];
+    input_row++;
+    outptr = *output_buf++;
+    for (col = 0; col + 16 <= num_cols; col += 16) {
+      rgb_gray_sse2(inptr0 + col, inptr1 + col, inptr2 + col, outptr);
+      outptr += 16;
+    }
+    if (col < num_cols) {
+      rest = num_cols - col;
+      MEMZERO(inbuf, SIZEOF(inbuf));
+      MEMCOPY(inbuf[0], inptr0 + col, rest * SIZEOF(JSAMPLE));
+      MEMCOPY(inbuf[1], inptr1 + col, rest * SIZEOF(JSAMPLE));
+      MEMCOPY(inbuf[2], inptr2 + col, rest * SIZEOF(JSAMPLE));
+      rgb_gray_sse2(inbuf[0], inbuf[1], inbuf[2], outbuf);
+      MEMCOPY(outptr, outbuf, rest * SIZEOF(JSAMPLE));
+    }
+  }
+}
+
+
+METHODDEF(void)
+rgb1_rgb_convert_sse2 (j_decompress_ptr cinfo,
+		       JSAMPIMAGE input_buf, JDIMENSION input_row,
+		       JSAMPARRAY output_buf, int num_rows)
+/* SSE2 version of rgb1_rgb_convert */
+{
+  JSAMPLE inbuf[3][16];
+  JSAMPLE outbuf[16 * RGB_PIXELSIZE];
+  JSAMPROW inptr0, inptr1, inptr2;
+  JSAMPROW outptr;
+  JDIMENSION col, rest;
+  JDIMENSION num_cols = cinfo->output_width;
+
+  while (--num_rows >= 0) {
+    inptr0 = input_buf[0][input_row];
+    inptr1 = input_buf[1][input_row];
+    inptr2 = input_buf[2][input_row];
+    input_row++;
+    outptr = *output_buf++;
+    for (col = 0; col + 16 <= num_cols; col += 16) {
+      rgb1_rgb_sse2(inptr0 + col, inptr1 + col, inptr2 + col, outptr);
+      outptr += 16 * RGB_PIXELSIZE;
+    }
+    if (col < num_cols) {
+      rest = num_cols - col;
+      MEMZERO(inbuf, SIZEOF(inbuf));
+      MEMCOPY(inbuf[0], inptr0 + col, rest * SIZEOF(JSAMPLE));
+      MEMCOPY(inbuf[1], inptr1 + col, rest * SIZEOF(JSAMPLE));
+      MEMCOPY(inbuf[2], inptr2 + col, rest * SIZEOF(JSAMPLE));
+      rgb1_rgb_sse2(inbuf[0], inbuf[1], inbuf[2], outbuf);
+      MEMCOPY(outptr, outbuf, rest * RGB_PIXELSIZE * SIZEOF(JSAMPLE));
+    }
+  }
+}
+
+#endif /* COLOR_SSE2_SUPPORTED */
+
+
 /*
  * Empty method for start_pass.
  */
@@ -654,6 +974,10 @@ jinit_color_deconverter (j_decompress_ptr cinfo)
       switch (cinfo->color_transform) {
       case JCT_NONE:
 	cconvert->pub.color_convert = rgb_gray_convert;
+#ifdef COLOR_SSE2_SUPPORTED
+	if (jsimd_flags() & JSIMD_FLAG_SSE2)
+	  cconvert->pub.color_convert = rgb_gray_convert_sse2;
+#endif
 	break;
       case JCT_SUBTRACT_GREEN:
 	cconvert->pub.color_convert = rgb1_gray_convert;
@@ -676,10 +1000,18 @@ jinit_color_deconverter (j_decompress_ptr cinfo)
       break;
     case JCS_YCbCr:
       cconvert->pub.color_convert = ycc_rgb_convert;
+#ifdef COLOR_SSE2_SUPPORTED
+      if (jsimd_flags() & JSIMD_FLAG_SSE2)
+	cconvert->pub.color_convert = ycc_rgb_convert_sse2;
+#endif
       build_ycc_rgb_table(cinfo);
       break;
     case JCS_BG_YCC:
       cconvert->pub.color_convert = ycc_rgb_convert;
+#ifdef COLOR_SSE2_SUPPORTED
+      if (jsimd_flags() & JSIMD_FLAG_SSE2)
+	cconvert->pub.color_convert = ycc_rgb_convert_sse2;
+#endif
       build_bg_ycc_rgb_table(cinfo);
       break;
     case JCS_RGB:
@@ -689,6 +1021,10 @@ jinit_color_deconverter (j_decompress_ptr cinfo)
 	break;
       case JCT_SUBTRACT_GREEN:
 	cconvert->pub.color_convert = rgb1_rgb_convert;
+#ifdef COLOR_SSE2_SUPPORTED
+	if (jsimd_flags() & JSIMD_FLAG_SSE2)
+	  cconvert->pub.color_convert = rgb1_rgb_convert_sse2;
+#endif
 	break;
       default:
 	ERREXIT(cinfo, JERR_CONVERSION_NOTIMPL);
@@ -708,6 +1044,10 @@ jinit_color_deconverter (j_decompress_ptr cinfo)
 	break;
       case JCT_SUBTRACT_GREEN:
 	cconvert->pub.color_convert = rgb1_rgb_convert;
+#ifdef COLOR_SSE2_SUPPORTED
+	if (jsimd_flags() & JSIMD_FLAG_SSE2)
+	  cconvert->pub.color_convert = rgb1_rgb_convert_sse2;
+#endif
 	break;
       default:
 	ERREXIT(cinfo, JERR_CONVERSION_NOTIMPL);
@@ -86,11 +86,29 @@ typedef FAST_FLOAT FLOAT_MULT_TYPE; /* preferred floating type */
 
 #define RANGE_MASK  (MAXJSAMPLE * 4 + 3) /* 2 bits wider than legal samples */
 
+/*
+ * The SSE2 IDCT routines do the range limiting arithmetically, which is
+ * equivalent to the table set up by jdmaster.c for 8-bit samples.  The
+ * SSE2 FDCT routine needs 8-bit samples to keep its intermediate values
+ * within 16 bits.  Both match the C routines only with the default (full
+ * width) MULTIPLY.
+ */
+
+#ifdef JSIMD_SSE2
+#if BITS_IN_JSAMPLE == 8
+#if !defined(SHORTxSHORT_32) && !defined(SHORTxLCONST_32)
+#define FDCT_SSE2_SUPPORTED
+#define IDCT_SSE2_SUPPORTED
+#endif
+#endif
+#endif
+
 
 /* Short forms of external names for systems with brain-damaged linkers. */
 
 #ifdef NEED_SHORT_EXTERNAL_NAMES
 #define jpeg_fdct_islow		jFDislow
+#define jpeg_fdct_islow_sse2	jFDislsx
 #define jpeg_fdct_ifast		jFDifast
 #define jpeg_fdct_float		jFDfloat
 #define jpeg_fdct_7x7		jFD7x7
@@ -125,12 +143,16 @@ typedef FAST_FLOAT FLOAT_MULT_TYPE; /* preferred floating type */
 #define jpeg_fdct_2x4		jFD2x4
 #define jpeg_fdct_1x2		jFD1x2
 #define jpeg_idct_islow		jRDislow
+#define jpeg_idct_islow_dc	jRDisldc
+#define jpeg_idct_islow_low	jRDisllo
+#define jpeg_idct_islow_sse2	jRDislsx
 #define jpeg_idct_ifast		jRDifast
 #define jpeg_idct_float		jRDfloat
 #define jpeg_idct_7x7		jRD7x7
 #define jpeg_idct_6x6		jRD6x6
 #define jpeg_idct_5x5		jRD5x5
 #define jpeg_idct_4x4		jRD4x4
+#define jpeg_idct_4x4_sse2	jRD4x4sx
 #define jpeg_idct_3x3		jRD3x3
 #define jpeg_idct_2x2		jRD2x2
 #define jpeg_idct_1x1		jRD1x1
@@ -142,6 +164,7 @@ typedef FAST_FLOAT FLOAT_MULT_TYPE; /* preferred floating type */
 #define jpeg_idct_14x14		jRD14x14
 #define jpeg_idct_15x15		jRD15x15
 #define jpeg_idct_16x16		jRD16x16
+#define jpeg_idct_16x16_sse2	jRD16x16sx
 #define jpeg_idct_16x8		jRD16x8
 #define jpeg_idct_14x7		jRD14x7
 #define jpeg_idct_12x6		jRD12x6
@@ -164,6 +187,8 @@ typedef FAST_FLOAT FLOAT_MULT_TYPE; /* preferred floating type */
 
 EXTERN(void) jpeg_fdct_islow
     JPP((DCTELEM * data, JSAMPARRAY sample_data, JDIMENSION start_col));
+EXTERN(void) jpeg_fdct_islow_sse2
+    JPP((DCTELEM * data, JSAMPARRAY sample_data, JDIMENSION start_col));
 EXTERN(void) jpeg_fdct_ifast
     JPP((DCTELEM * data, JSAMPARRAY sample_data, JDIMENSION start_col));
 EXTERN(void) jpeg_fdct_float
@@ -234,6 +259,15 @@ EXTERN(void) jpeg_fdct_1x2
 EXTERN(void) jpeg_idct_islow
     JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
 	 JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col));
+EXTERN(void) jpeg_idct_islow_dc
+    JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
+	 JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col));
+EXTERN(void) jpeg_idct_islow_low
+    JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
+	 JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col));
+EXTERN(void) jpeg_idct_islow_sse2
+    JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
+	 JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col));
 EXTERN(void) jpeg_idct_ifast
     JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
 	 JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col));
@@ -252,6 +286,9 @@ EXTERN(void) jpeg_idct_5x5
 EXTERN(void) jpeg_idct_4x4
     JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
 	 JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col));
+EXTERN(void) jpeg_idct_4x4_sse2
+    JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
+	 JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col));
 EXTERN(void) jpeg_idct_3x3
     JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
 	 JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col));
@@ -285,6 +322,9 @@ EXTERN(void) jpeg_idct_15x15
 EXTERN(void) jpeg_idct_16x16
     JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
 	 JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col));
+EXTERN(void) jpeg_idct_16x16_sse2
+    JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
+	 JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col));
 EXTERN(void) jpeg_idct_16x8
     JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
 	 JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col));
@@ -94,10 +94,14 @@ start_pass (j_decompress_ptr cinfo)
   jpeg_component_info *compptr;
   int method = 0;
   inverse_DCT_method_ptr method_ptr = NULL;
+  inverse_DCT_method_ptr dc_ptr, low_ptr;
   JQUANT_TBL * qtbl;
 
   for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
        ci++, compptr++) {
+    /* Sparse-block shortcuts exist only for some routines */
+    dc_ptr = NULL;
+    low_ptr = NULL;
     /* Select the proper IDCT routine for this component's scaling */
     switch ((compptr->DCT_h_scaled_size << 8) + compptr->DCT_v_scaled_size) {
 #ifdef IDCT_SCALING_SUPPORTED
@@ -115,6 +119,10 @@ start_pass (j_decompress_ptr cinfo)
       break;
     case ((4 << 8) + 4):
       method_ptr = jpeg_idct_4x4;
+#ifdef IDCT_SSE2_SUPPORTED
+      if (jsimd_flags() & JSIMD_FLAG_SSE2)
+	method_ptr = jpeg_idct_4x4_sse2;
+#endif
       method = JDCT_ISLOW;	/* jidctint uses islow-style table */
       break;
     case ((5 << 8) + 5):
@@ -159,6 +167,10 @@ start_pass (j_decompress_ptr cinfo)
       break;
     case ((16 << 8) + 16):
       method_ptr = jpeg_idct_16x16;
+#ifdef IDCT_SSE2_SUPPORTED
+      if (jsimd_flags() & JSIMD_FLAG_SSE2)
+	method_ptr = jpeg_idct_16x16_sse2;
+#endif
       method = JDCT_ISLOW;	/* jidctint uses islow-style table */
       break;
     case ((16 << 8) + 8):
@@ -231,6 +243,12 @@ start_pass (j_decompress_ptr cinfo)
 #ifdef DCT_ISLOW_SUPPORTED
       case JDCT_ISLOW:
 	method_ptr = jpeg_idct_islow;
+#ifdef IDCT_SSE2_SUPPORTED
+	if (jsimd_flags() & JSIMD_FLAG_SSE2)
+	  method_ptr = jpeg_idct_islow_sse2;
+#endif
+	dc_ptr = jpeg_idct_islow_dc;
+	low_ptr = jpeg_idct_islow_low;
 	method = JDCT_ISLOW;
 	break;
 #endif
@@ -257,6 +275,8 @@ start_pass (j_decompress_ptr cinfo)
       break;
     }
     idct->pub.inverse_DCT[ci] = method_ptr;
+    idct->pub.inverse_DCT_dc[ci] = dc_ptr;
+    idct->pub.inverse_DCT_low[ci] = low_ptr;
     /* Create multiplier table from quant table.
      * However, we can skip this if the component is uninteresting
      * or if we already built the table.  Also, if no quant table
@@ -1225,7 +1225,7 @@ decode_mcu (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
       JBLOCKROW block = MCU_data[blkn];
       d_derived_tbl * htbl;
       register int s, k, r;
-      int coef_limit, ci;
+      int coef_limit, ci, last;
 
       /* Decode a single block's worth of coefficients */
 
@@ -1235,6 +1235,7 @@ decode_mcu (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
 
       htbl = entropy->ac_cur_tbls[blkn];
       k = 1;
+      last = 0;
       coef_limit = entropy->coef_limit[blkn];
       if (coef_limit) {
 	/* Convert DC difference to actual value, update last_dc_val */
@@ -1267,6 +1268,7 @@ decode_mcu (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
 	     * if k >= DCTSIZE2, which could happen if the data is corrupted.
 	     */
 	    (*block)[jpeg_natural_order[k]] = (JCOEF) s;
+	    last = k;
 	  } else {
 	    if (r != 15)
 	      goto EndOfBlock;
@@ -1299,12 +1301,118 @@ decode_mcu (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
 	}
       }
 
-      EndOfBlock: ;
+      EndOfBlock:
+      entropy->pub.block_last[blkn] = last;
+    }
+
+    /* Completed MCU, so update state */
+    BITREAD_SAVE_STATE(cinfo,entropy->bitstate);
+    ASSIGN_STATE(entropy->saved, state);
+  } else {
+    for (blkn = 0; blkn < cinfo->blocks_in_MCU; blkn++)
+      entropy->pub.block_last[blkn] = 0;
+  }
+
+  /* Account for restart interval (no-op if not using restarts) */
+  entropy->restarts_to_go--;
+
+  return TRUE;
+}
+
+
+/*
+ * Decode one MCU's worth of Huffman-compressed coefficients,
+ * DC values only.
+ * This is used when no block needs more than its DC coefficient, which is
+ * the case when the output is scaled down to one sample per block (1/8).
+ * The AC coefficients are skipped without being stored, and the per-block
+ * coefficient limit tests of decode_mcu are avoided.
+ */
+
+METHODDEF(boolean)
+decode_mcu_dc (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
+{
+  huff_entropy_ptr entropy = (huff_entropy_ptr) cinfo->entropy;
+  int Se, blkn;
+  BITREAD_STATE_VARS;
+  savable_state state;
+
+  /* Process restart marker if needed; may have to suspend */
+  if (cinfo->restart_interval) {
+    if (entropy->restarts_to_go == 0)
+      if (! process_restart(cinfo))
+	return FALSE;
+  }
+
+  /* If we've run out of data, just leave the MCU set to zeroes.
+   * This way, we return uniform gray for the remainder of the segment.
+   */
+  if (! entropy->insufficient_data) {
+
+    Se = cinfo->lim_Se;
+
+    /* Load up working state */
+    BITREAD_LOAD_STATE(cinfo,entropy->bitstate);
+    ASSIGN_STATE(state, entropy->saved);
+
+    /* Outer loop handles each block in the MCU */
+
+    for (blkn = 0; blkn < cinfo->blocks_in_MCU; blkn++) {
+      d_derived_tbl * htbl;
+      register int s, k, r;
+      int ci;
+
+      /* Section F.2.2.1: decode the DC coefficient difference */
+      htbl = entropy->dc_cur_tbls[blkn];
+      HUFF_DECODE(s, br_state, htbl, return FALSE, label1);
+
+      if (entropy->coef_limit[blkn]) {
+	/* Convert DC difference to actual value, update last_dc_val */
+	if (s) {
+	  CHECK_BIT_BUFFER(br_state, s, return FALSE);
+	  r = GET_BITS(s);
+	  s = HUFF_EXTEND(r, s);
+	}
+	ci = cinfo->MCU_membership[blkn];
+	s += state.last_dc_val[ci];
+	state.last_dc_val[ci] = s;
+	/* Output the DC coefficient */
+	MCU_data[blkn][0][0] = (JCOEF) s;
+      } else {
+	if (s) {
+	  CHECK_BIT_BUFFER(br_state, s, return FALSE);
+	  DROP_BITS(s);
+	}
+      }
+
+      /* Section F.2.2.2: skip over the AC coefficients */
+      htbl = entropy->ac_cur_tbls[blkn];
+      for (k = 1; k <= Se; k++) {
+	HUFF_DECODE(s, br_state, htbl, return FALSE, label2);
+
+	r = s >> 4;
+	s &= 15;
+
+	if (s) {
+	  k += r;
+	  CHECK_BIT_BUFFER(br_state, s, return FALSE);
+	  DROP_BITS(s);
+	} else {
+	  if (r != 15)
+	    break;
+	  k += 15;
+	}
+      }
+
+      entropy->pub.block_last[blkn] = 0;
     }
 
     /* Completed MCU, so update state */
     BITREAD_SAVE_STATE(cinfo,entropy->bitstate);
     ASSIGN_STATE(entropy->saved, state);
+  } else {
+    for (blkn = 0; blkn < cinfo->blocks_in_MCU; blkn++)
+      entropy->pub.block_last[blkn] = 0;
   }
 
   /* Account for restart interval (no-op if not using restarts) */
@@ -1501,6 +1609,13 @@ start_pass_huff_decoder (j_decompress_ptr cinfo)
 	entropy->coef_limit[blkn] = 0;
       }
     }
+
+    /* If no block needs AC coefficients, use the DC-only decoder */
+    for (blkn = 0; blkn < cinfo->blocks_in_MCU; blkn++)
+      if (entropy->coef_limit[blkn] > 1)
+	break;
+    if (blkn == cinfo->blocks_in_MCU)
+      entropy->pub.decode_mcu = decode_mcu_dc;
   }
 
   /* Initialize bitread state variables */
@@ -1510,6 +1625,10 @@ start_pass_huff_decoder (j_decompress_ptr cinfo)
 
   /* Initialize restart counter */
   entropy->restarts_to_go = cinfo->restart_interval;
+
+  /* Only the full-block sequential decoder tracks block sparsity */
+  for (blkn = 0; blkn < D_MAX_BLOCKS_IN_MCU; blkn++)
+    entropy->pub.block_last[blkn] = DCTSIZE2-1;
 }
 
 
@@ -224,36 +224,35 @@ jpeg_calc_output_dimensions (j_decompress_ptr cinfo)
  * with the simpler range limiting table.  The post-IDCT table begins at
  * sample_range_limit + CENTERJSAMPLE.
  *
- * Note that the table is allocated in near data space on PCs; it's small
- * enough and used often enough to justify this.
+ * The table is the same for every decompression object, so it is a
+ * constant shared by all of them rather than being built for each image.
+ * transupp.c uses it too.
  */
 
-LOCAL(void)
-prepare_range_limit_table (j_decompress_ptr cinfo)
-/* Allocate and fill in the sample_range_limit table */
-{
-  JSAMPLE * table;
-  int i;
-
-  table = (JSAMPLE *)
-    (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
-		(5 * (MAXJSAMPLE+1) + CENTERJSAMPLE) * SIZEOF(JSAMPLE));
-  table += (MAXJSAMPLE+1);	/* allow negative subscripts of simple table */
-  cinfo->sample_range_limit = table;
+#define RL_ZERO(i)	0
+#define RL_SAME(i)	(i)
+#define RL_MAX(i)	MAXJSAMPLE
+
+const JSAMPLE jpeg_range_limit_table[5 * (MAXJSAMPLE+1) + CENTERJSAMPLE] = {
   /* First segment of "simple" table: limit[x] = 0 for x < 0 */
-  MEMZERO(table - (MAXJSAMPLE+1), (MAXJSAMPLE+1) * SIZEOF(JSAMPLE));
+  JSAMPLE_TABLE(RL_ZERO, 0),
   /* Main part of "simple" table: limit[x] = x */
-  for (i = 0; i <= MAXJSAMPLE; i++)
-    table[i] = (JSAMPLE) i;
-  table += CENTERJSAMPLE;	/* Point to where post-IDCT table starts */
+  JSAMPLE_TABLE(RL_SAME, 0),
   /* End of simple table, rest of first half of post-IDCT table */
-  for (i = CENTERJSAMPLE; i < 2*(MAXJSAMPLE+1); i++)
-    table[i] = MAXJSAMPLE;
+  JSAMPLE_TABLE(RL_MAX, 0), JSAMPLE_HALF_TABLE(RL_MAX, 0),
   /* Second half of post-IDCT table */
-  MEMZERO(table + (2 * (MAXJSAMPLE+1)),
-	  (2 * (MAXJSAMPLE+1) - CENTERJSAMPLE) * SIZEOF(JSAMPLE));
-  MEMCOPY(table + (4 * (MAXJSAMPLE+1) - CENTERJSAMPLE),
-	  cinfo->sample_range_limit, CENTERJSAMPLE * SIZEOF(JSAMPLE));
+  JSAMPLE_TABLE(RL_ZERO, 0), JSAMPLE_HALF_TABLE(RL_ZERO, 0),
+  JSAMPLE_HALF_TABLE(RL_SAME, 0)
+};
+
+
+LOCAL(void)
+prepare_range_limit_table (j_decompress_ptr cinfo)
+/* Set up the sample_range_limit pointer */
+{
+  /* allow negative subscripts of simple table */
+  cinfo->sample_range_limit =
+    (JSAMPLE *) jpeg_range_limit_table + (MAXJSAMPLE+1);
 }
 
 
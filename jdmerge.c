@@ -39,6 +39,14 @@
 
 #ifdef UPSAMPLE_MERGING_SUPPORTED
 
+/* The SSE2 code handles 8-bit samples in 3-byte RGB pixels */
+#ifdef JSIMD_SSE2
+#if BITS_IN_JSAMPLE == 8 && RGB_PIXELSIZE == 3
+#define MERGED_SSE2_SUPPORTED
+#include <emmintrin.h>
+#endif
+#endif
+
 
 /* Private subobject */
 
@@ -51,10 +59,16 @@ typedef struct {
 			   JSAMPARRAY output_buf));
 
   /* Private state for YCC->RGB conversion */
-  int * Cr_r_tab;		/* => table for Cr to R conversion */
-  int * Cb_b_tab;		/* => table for Cb to B conversion */
-  INT32 * Cr_g_tab;		/* => table for Cr to G conversion */
-  INT32 * Cb_g_tab;		/* => table for Cb to G conversion */
+  const int * Cr_r_tab;		/* => table for Cr to R conversion */
+  const int * Cb_b_tab;		/* => table for Cb to B conversion */
+  const INT32 * Cr_g_tab;	/* => table for Cr to G conversion */
+  const INT32 * Cb_g_tab;	/* => table for Cb to G conversion */
+
+#ifdef MERGED_SSE2_SUPPORTED
+  /* Cr=>R, Cb=>B, Cb=>G and Cr=>G multipliers for the SSE2 code */
+  short whole[4];		/* integral parts */
+  short frac[4];		/* remainders, scaled up by 2^16 */
+#endif
 
   /* For 2:1 vertical sampling, we produce two output rows at a time.
    * We need a "spare" row buffer to hold the second output row if the
@@ -76,46 +90,37 @@ typedef my_upsampler * my_upsample_ptr;
 
 
 /*
- * Initialize tables for YCC->RGB colorspace conversion.
- * This is taken directly from jdcolor.c; see that file for more info.
+ * Initialize for YCC->RGB colorspace conversion.
+ * The conversion tables are the constant ones of jdcolor.c.
  */
 
 LOCAL(void)
 build_ycc_rgb_table (j_decompress_ptr cinfo)
 {
   my_upsample_ptr upsample = (my_upsample_ptr) cinfo->upsample;
+#ifdef MERGED_SSE2_SUPPORTED
+  INT32 k[4];
   int i;
-  INT32 x;
   SHIFT_TEMPS
-
-  upsample->Cr_r_tab = (int *)
-    (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
-				(MAXJSAMPLE+1) * SIZEOF(int));
-  upsample->Cb_b_tab = (int *)
-    (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
-				(MAXJSAMPLE+1) * SIZEOF(int));
-  upsample->Cr_g_tab = (INT32 *)
-    (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
-				(MAXJSAMPLE+1) * SIZEOF(INT32));
-  upsample->Cb_g_tab = (INT32 *)
-    (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
-				(MAXJSAMPLE+1) * SIZEOF(INT32));
-
-  for (i = 0, x = -CENTERJSAMPLE; i <= MAXJSAMPLE; i++, x++) {
-    /* i is the actual input pixel value, in the range 0..MAXJSAMPLE */
-    /* The Cb or Cr value we are thinking of is x = i - CENTERJSAMPLE */
-    /* Cr=>R value is nearest int to 1.402 * x */
-    upsample->Cr_r_tab[i] = (int)
-		    RIGHT_SHIFT(FIX(1.402) * x + ONE_HALF, SCALEBITS);
-    /* Cb=>B value is nearest int to 1.772 * x */
-    upsample->Cb_b_tab[i] = (int)
-		    RIGHT_SHIFT(FIX(1.772) * x + ONE_HALF, SCALEBITS);
-    /* Cr=>G value is scaled-up -0.714136286 * x */
-    upsample->Cr_g_tab[i] = (- FIX(0.714136286)) * x;
-    /* Cb=>G value is scaled-up -0.344136286 * x */
-    /* We also add in ONE_HALF so that need not do it in inner loop */
-    upsample->Cb_g_tab[i] = (- FIX(0.344136286)) * x + ONE_HALF;
+#endif
+
+  upsample->Cr_r_tab = jpeg_cr_r_tab;
+  upsample->Cb_b_tab = jpeg_cb_b_tab;
+  upsample->Cr_g_tab = jpeg_cr_g_tab;
+  upsample->Cb_g_tab = jpeg_cb_g_tab;
+
+#ifdef MERGED_SSE2_SUPPORTED
+  /* Split the multipliers as jdcolor.c does for its SSE2 code */
+  k[0] = FIX(1.402);
+  k[1] = FIX(1.772);
+  k[2] = - FIX(0.344136286);
+  k[3] = - FIX(0.714136286);
+  for (i = 0; i < 4; i++) {
+    upsample->whole[i] = (short) RIGHT_SHIFT(k[i] + ONE_HALF, SCALEBITS);
+    upsample->frac[i] = (short)
+      (k[i] - (INT32) upsample->whole[i] * ((INT32) 1 << SCALEBITS));
   }
+#endif
 }
 
 
@@ -236,10 +241,10 @@ h2v1_merged_upsample (j_decompress_ptr cinfo,
   JDIMENSION col;
   /* copy these pointers into registers if possible */
   register JSAMPLE * range_limit = cinfo->sample_range_limit;
-  int * Crrtab = upsample->Cr_r_tab;
-  int * Cbbtab = upsample->Cb_b_tab;
-  INT32 * Crgtab = upsample->Cr_g_tab;
-  INT32 * Cbgtab = upsample->Cb_g_tab;
+  const int * Crrtab = upsample->Cr_r_tab;
+  const int * Cbbtab = upsample->Cb_b_tab;
+  const INT32 * Crgtab = upsample->Cr_g_tab;
+  const INT32 * Cbgtab = upsample->Cb_g_tab;
   SHIFT_TEMPS
 
   inptr0 = input_buf[0][in_row_group_ctr];
@@ -298,10 +303,10 @@ h2v2_merged_upsample (j_decompress_ptr cinfo,
   JDIMENSION col;
   /* copy these pointers into registers if possible */
   register JSAMPLE * range_limit = cinfo->sample_range_limit;
-  int * Crrtab = upsample->Cr_r_tab;
-  int * Cbbtab = upsample->Cb_b_tab;
-  INT32 * Crgtab = upsample->Cr_g_tab;
-  INT32 * Cbgtab = upsample->Cb_g_tab;
+  const int * Crrtab = upsample->Cr_r_tab;
+  const int * Cbbtab = upsample->Cb_b_tab;
+  const INT32 * Crgtab = upsample->Cr_g_tab;
+  const INT32 * Cbgtab = upsample->Cb_g_tab;
   SHIFT_TEMPS
 
   inptr00 = input_buf[0][in_row_group_ctr*2];
@@ -359,6 +364,200 @@ h2v2_merged_upsample (j_decompress_ptr cinfo,
 }
 
 
+#ifdef MERGED_SSE2_SUPPORTED
+
+/*
+ * SSE2 versions of the routines above, which make 16 output pixels (two
+ * rows of them for 2:1 vertical sampling) from 8 pairs of chroma samples
+ * at a time.  The chroma terms are computed as in the SSE2 code of
+ * jdcolor.c, which see, so the results are exactly those of the tables.
+ * A partial group at the end of a row goes through a small buffer.
+ */
+
+/* A pair of multipliers, repeated for _mm_madd_epi16 */
+#define PAIR_SSE2(a,b) \
+  _mm_setr_epi16((short) (a), (short) (b), (short) (a), (short) (b), \
+		 (short) (a), (short) (b), (short) (a), (short) (b))
+
+
+INLINE
+LOCAL(__m128i)
+fraction_sse2 (__m128i x, short frac)
+/* RIGHT_SHIFT(frac * x + ONE_HALF, SCALEBITS) for eight 16-bit lanes */
+{
+  __m128i mult = _mm_set1_epi16(frac);
+
+  return _mm_add_epi16(_mm_mulhi_epi16(x, mult),
+		       _mm_srli_epi16(_mm_mullo_epi16(x, mult), 15));
+}
+
+
+INLINE
+LOCAL(void)
+chroma_sse2 (my_upsample_ptr upsample, JSAMPROW inptr1, JSAMPROW inptr2,
+	     __m128i chroma[3][2])
+/* Compute the R, G and B chroma terms of 8 pairs of Cb,Cr samples,
+ * each repeated for the two horizontally adjacent output pixels.
+ */
+{
+  __m128i cb, cr, zero, center, lo, hi, term[3];
+  int i;
+
+  zero = _mm_setzero_si128();
+  center = _mm_set1_epi16(CENTERJSAMPLE);
+  cb = _mm_loadl_epi64((const __m128i *) inptr1);
+  cr = _mm_loadl_epi64((const __m128i *) inptr2);
+  cb = _mm_sub_epi16(_mm_unpacklo_epi8(cb, zero), center);
+  cr = _mm_sub_epi16(_mm_unpacklo_epi8(cr, zero), center);
+
+  term[0] = _mm_add_epi16(fraction_sse2(cr, upsample->frac[0]),
+			  _mm_mullo_epi16(cr,
+					  _mm_set1_epi16(upsample->whole[0])));
+  term[2] = _mm_add_epi16(fraction_sse2(cb, upsample->frac[1]),
+			  _mm_mullo_epi16(cb,
+					  _mm_set1_epi16(upsample->whole[1])));
+  /* The G fractions are summed before rounding, as in the tables */
+  lo = _mm_madd_epi16(_mm_unpacklo_epi16(cb, cr),
+		      PAIR_SSE2(upsample->frac[2], upsample->frac[3]));
+  hi = _mm_madd_epi16(_mm_unpackhi_epi16(cb, cr),
+		      PAIR_SSE2(upsample->frac[2], upsample->frac[3]));
+  lo = _mm_srai_epi32(_mm_add_epi32(lo, _mm_set1_epi32(ONE_HALF)), SCALEBITS);
+  hi = _mm_srai_epi32(_mm_add_epi32(hi, _mm_set1_epi32(ONE_HALF)), SCALEBITS);
+  term[1] = _mm_add_epi16(
+    _mm_add_epi16(_mm_mullo_epi16(cb, _mm_set1_epi16(upsample->whole[2])),
+		  _mm_mullo_epi16(cr, _mm_set1_epi16(upsample->whole[3]))),
+    _mm_packs_epi32(lo, hi));
+
+  for (i = 0; i < 3; i++) {
+    chroma[i][0] = _mm_unpacklo_epi16(term[i], term[i]);
+    chroma[i][1] = _mm_unpackhi_epi16(term[i], term[i]);
+  }
+}
+
+
+INLINE
+LOCAL(void)
+emit_sse2 (JSAMPROW inptr0, __m128i chroma[3][2], JSAMPROW outptr)
+/* Add 16 Y values to the chroma terms and emit 16 RGB pixels.
+ * The planes are interleaved as in store_rgb_sse2 in jdcolor.c.
+ */
+{
+  __m128i y, ylo, yhi, zero, mask, t0, t1, t2, rgb[3];
+  int i;
+
+  zero = _mm_setzero_si128();
+  y = _mm_loadu_si128((const __m128i *) inptr0);
+  ylo = _mm_unpacklo_epi8(y, zero);
+  yhi = _mm_unpackhi_epi8(y, zero);
+  /* Saturation does the work of the range limit table */
+  rgb[RGB_RED]   = _mm_packus_epi16(_mm_add_epi16(ylo, chroma[0][0]),
+				    _mm_add_epi16(yhi, chroma[0][1]));
+  rgb[RGB_GREEN] = _mm_packus_epi16(_mm_add_epi16(ylo, chroma[1][0]),
+				    _mm_add_epi16(yhi, chroma[1][1]));
+  rgb[RGB_BLUE]  = _mm_packus_epi16(_mm_add_epi16(ylo, chroma[2][0]),
+				    _mm_add_epi16(yhi, chroma[2][1]));
+
+  mask = _mm_set1_epi16(0xFF);
+  for (i = 0; i < 4; i++) {
+    t0 = _mm_packus_epi16(_mm_and_si128(rgb[0], mask),
+			  _mm_and_si128(rgb[1], mask));
+    t1 = _mm_packus_epi16(_mm_and_si128(rgb[2], mask),
+			  _mm_srli_epi16(rgb[0], 8));
+    t2 = _mm_packus_epi16(_mm_srli_epi16(rgb[1], 8),
+			  _mm_srli_epi16(rgb[2], 8));
+    rgb[0] = t0; rgb[1] = t1; rgb[2] = t2;
+  }
+  _mm_storeu_si128((__m128i *) outptr, rgb[0]);
+  _mm_storeu_si128((__m128i *) (outptr + 16), rgb[1]);
+  _mm_storeu_si128((__m128i *) (outptr + 32), rgb[2]);
+}
+
+
+METHODDEF(void)
+h2v1_merged_upsample_sse2 (j_decompress_ptr cinfo,
+			   JSAMPIMAGE input_buf, JDIMENSION in_row_group_ctr,
+			   JSAMPARRAY output_buf)
+/* SSE2 version of h2v1_merged_upsample */
+{
+  my_upsample_ptr upsample = (my_upsample_ptr) cinfo->upsample;
+  __m128i chroma[3][2];
+  JSAMPLE inbuf[3][16];
+  JSAMPLE outbuf[16 * RGB_PIXELSIZE];
+  JSAMPROW outptr;
+  JSAMPROW inptr0, inptr1, inptr2;
+  JDIMENSION col, rest, half;
+  JDIMENSION num_cols = cinfo->output_width;
+
+  inptr0 = input_buf[0][in_row_group_ctr];
+  inptr1 = input_buf[1][in_row_group_ctr];
+  inptr2 = input_buf[2][in_row_group_ctr];
+  outptr = output_buf[0];
+  for (col = 0; col + 16 <= num_cols; col += 16) {
+    chroma_sse2(upsample, inptr1 + (col >> 1), inptr2 + (col >> 1), chroma);
+    emit_sse2(inptr0 + col, chroma, outptr);
+    outptr += 16 * RGB_PIXELSIZE;
+  }
+  if (col < num_cols) {
+    rest = num_cols - col;
+    half = (rest + 1) >> 1;
+    MEMZERO(inbuf, SIZEOF(inbuf));
+    MEMCOPY(inbuf[0], inptr0 + col, rest * SIZEOF(JSAMPLE));
+    MEMCOPY(inbuf[1], inptr1 + (col >> 1), half * SIZEOF(JSAMPLE));
+    MEMCOPY(inbuf[2], inptr2 + (col >> 1), half * SIZEOF(JSAMPLE));
+    chroma_sse2(upsample, inbuf[1], inbuf[2], chroma);
+    emit_sse2(inbuf[0], chroma, outbuf);
+    MEMCOPY(outptr, outbuf, rest * RGB_PIXELSIZE * SIZEOF(JSAMPLE));
+  }
+}
+
+
+METHODDEF(void)
+h2v2_merged_upsample_sse2 (j_decompress_ptr cinfo,
+			   JSAMPIMAGE input_buf, JDIMENSION in_row_group_ctr,
+			   JSAMPARRAY output_buf)
+/* SSE2 version of h2v2_merged_upsample */
+{
+  my_upsample_ptr upsample = (my_upsample_ptr) cinfo->upsample;
+  __m128i chroma[3][2];
+  JSAMPLE inbuf[4][16];
+  JSAMPLE outbuf[16 * RGB_PIXELSIZE];
+  JSAMPROW outptr0, outptr1;
+  JSAMPROW inptr00, inptr01, inptr1, inptr2;
+  JDIMENSION col, rest, half;
+  JDIMENSION num_cols = cinfo->output_width;
+
+  inptr00 = input_buf[0][in_row_group_ctr*2];
+  inptr01 = input_buf[0][in_row_group_ctr*2 + 1];
+  inptr1 = input_buf[1][in_row_group_ctr];
+  inptr2 = input_buf[2][in_row_group_ctr];
+  outptr0 = output_buf[0];
+  outptr1 = output_buf[1];
+  for (col = 0; col + 16 <= num_cols; col += 16) {
+    chroma_sse2(upsample, inptr1 + (col >> 1), inptr2 + (col >> 1), chroma);
+    emit_sse2(inptr00 + col, chroma, outptr0);
+    emit_sse2(inptr01 + col, chroma, outptr1);
+    outptr0 += 16 * RGB_PIXELSIZE;
+    outptr1 += 16 * RGB_PIXELSIZE;
+  }
+  if (col < num_cols) {
+    rest = num_cols - col;
+    half = (rest + 1) >> 1;
+    MEMZERO(inbuf, SIZEOF(inbuf));
+    MEMCOPY(inbuf[0], inptr00 + col, rest * SIZEOF(JSAMPLE));
+    MEMCOPY(inbuf[1], inptr01 + col, rest * SIZEOF(JSAMPLE));
+    MEMCOPY(inbuf[2], inptr1 + (col >> 1), half * SIZEOF(JSAMPLE));
+    MEMCOPY(inbuf[3], inptr2 + (col >> 1), half * SIZEOF(JSAMPLE));
+    chroma_sse2(upsample, inbuf[2], inbuf[3], chroma);
+    emit_sse2(inbuf[0], chroma, outbuf);
+    MEMCOPY(outptr0, outbuf, rest * RGB_PIXELSIZE * SIZEOF(JSAMPLE));
+    emit_sse2(inbuf[1], chroma, outbuf);
+    MEMCOPY(outptr1, outbuf, rest * RGB_PIXELSIZE * SIZEOF(JSAMPLE));
+  }
+}
+
+#endif /* MERGED_SSE2_SUPPORTED */
+
+
 /*
  * Module initialization routine for merged upsampling/color conversion.
  *
@@ -384,6 +583,10 @@ jinit_merged_upsampler (j_decompress_ptr cinfo)
   if (cinfo->max_v_samp_factor == 2) {
     upsample->pub.upsample = merged_2v_upsample;
     upsample->upmethod = h2v2_merged_upsample;
+#ifdef MERGED_SSE2_SUPPORTED
+    if (jsimd_flags() & JSIMD_FLAG_SSE2)
+      upsample->upmethod = h2v2_merged_upsample_sse2;
+#endif
     /* Allocate a spare row buffer */
     upsample->spare_row = (JSAMPROW)
       (*cinfo->mem->alloc_large) ((j_common_ptr) cinfo, JPOOL_IMAGE,
@@ -391,6 +594,10 @@ jinit_merged_upsampler (j_decompress_ptr cinfo)
   } else {
     upsample->pub.upsample = merged_1v_upsample;
     upsample->upmethod = h2v1_merged_upsample;
+#ifdef MERGED_SSE2_SUPPORTED
+    if (jsimd_flags() & JSIMD_FLAG_SSE2)
+      upsample->upmethod = h2v1_merged_upsample_sse2;
+#endif
     /* No spare row needed */
     upsample->spare_row = NULL;
   }
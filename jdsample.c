@@ -23,6 +23,14 @@
 #include "jinclude.h"
 #include "jpeglib.h"
 
+/* The SSE2 code handles 8-bit samples */
+#ifdef JSIMD_SSE2
+#if BITS_IN_JSAMPLE == 8
+#define SAMPLE_SSE2_SUPPORTED
+#include <emmintrin.h>
+#endif
+#endif
+
 
 /* Pointer to routine to upsample a single component */
 typedef JMETHOD(void, upsample1_ptr,
@@ -286,6 +294,92 @@ h2v2_upsample (j_decompress_ptr cinfo, jpeg_component_info * compptr,
 }
 
 
+#ifdef SAMPLE_SSE2_SUPPORTED
+
+/*
+ * SSE2 versions of the 2:1 upsampling routines above.  Each group of 16
+ * input samples is doubled by interleaving it with itself; samples left
+ * over at the end of a row are done as in the C versions.
+ */
+
+METHODDEF(void)
+h2v1_upsample_sse2 (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		    JSAMPARRAY input_data, JSAMPARRAY * output_data_ptr)
+/* SSE2 version of h2v1_upsample */
+{
+  JSAMPARRAY output_data = *output_data_ptr;
+  register JSAMPROW inptr, outptr;
+  register JSAMPLE invalue;
+  JSAMPROW outend;
+  int outrow;
+  __m128i in;
+
+  for (outrow = 0; outrow < cinfo->max_v_samp_factor; outrow++) {
+    inptr = input_data[outrow];
+    outptr = output_data[outrow];
+    outend = outptr + cinfo->output_width;
+    while (outend - outptr >= 32) {
+      in = _mm_loadu_si128((const __m128i *) inptr);
+      _mm_storeu_si128((__m128i *) outptr, _mm_unpacklo_epi8(in, in));
+      _mm_storeu_si128((__m128i *) (outptr + 16), _mm_unpackhi_epi8(in, in));
+      inptr += 16;
+      outptr += 32;
+    }
+    while (outptr < outend) {
+      invalue = *inptr++;	/* don't need GETJSAMPLE() here */
+      *outptr++ = invalue;
+      *outptr++ = invalue;
+    }
+  }
+}
+
+
+METHODDEF(void)
+h2v2_upsample_sse2 (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		    JSAMPARRAY input_data, JSAMPARRAY * output_data_ptr)
+/* SSE2 version of h2v2_upsample; it stores both output rows directly
+ * rather than copying the first one.
+ */
+{
+  JSAMPARRAY output_data = *output_data_ptr;
+  register JSAMPROW inptr, outptr0, outptr1;
+  register JSAMPLE invalue;
+  JSAMPROW outend;
+  int inrow, outrow;
+  __m128i in, lo, hi;
+
+  inrow = outrow = 0;
+  while (outrow < cinfo->max_v_samp_factor) {
+    inptr = input_data[inrow];
+    outptr0 = output_data[outrow];
+    outptr1 = output_data[outrow+1];
+    outend = outptr0 + cinfo->output_width;
+    while (outend - outptr0 >= 32) {
+      in = _mm_loadu_si128((const __m128i *) inptr);
+      lo = _mm_unpacklo_epi8(in, in);
+      hi = _mm_unpackhi_epi8(in, in);
+      _mm_storeu_si128((__m128i *) outptr0, lo);
+      _mm_storeu_si128((__m128i *) (outptr0 + 16), hi);
+      _mm_storeu_si128((__m128i *) outptr1, lo);
+      _mm_storeu_si128((__m128i *) (outptr1 + 16), hi);
+      inptr += 16;
+      outptr0 += 32; outptr1 += 32;
+    }
+    while (outptr0 < outend) {
+      invalue = *inptr++;	/* don't need GETJSAMPLE() here */
+      *outptr0++ = invalue;
+      *outptr0++ = invalue;
+      *outptr1++ = invalue;
+      *outptr1++ = invalue;
+    }
+    inrow++;
+    outrow += 2;
+  }
+}
+
+#endif /* SAMPLE_SSE2_SUPPORTED */
+
+
 /*
  * Module initialization routine for upsampling.
  */
@@ -338,10 +432,18 @@ jinit_upsampler (j_decompress_ptr cinfo)
 	       v_in_group == v_out_group) {
       /* Special case for 2h1v upsampling */
       upsample->methods[ci] = h2v1_upsample;
+#ifdef SAMPLE_SSE2_SUPPORTED
+      if (jsimd_flags() & JSIMD_FLAG_SSE2)
+	upsample->methods[ci] = h2v1_upsample_sse2;
+#endif
     } else if (h_in_group * 2 == h_out_group &&
 	       v_in_group * 2 == v_out_group) {
       /* Special case for 2h2v upsampling */
       upsample->methods[ci] = h2v2_upsample;
+#ifdef SAMPLE_SSE2_SUPPORTED
+      if (jsimd_flags() & JSIMD_FLAG_SSE2)
+	upsample->methods[ci] = h2v2_upsample_sse2;
+#endif
     } else if ((h_out_group % h_in_group) == 0 &&
 	       (v_out_group % v_in_group) == 0) {
       /* Generic integral-factors upsampling method */
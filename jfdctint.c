@@ -46,6 +46,10 @@
 #include "jpeglib.h"
 #include "jdct.h"		/* Private declarations for DCT subsystem */
 
+#ifdef FDCT_SSE2_SUPPORTED
+#include <emmintrin.h>
+#endif
+
 #ifdef DCT_ISLOW_SUPPORTED
 
 
@@ -324,6 +328,223 @@ jpeg_fdct_islow (DCTELEM * data, JSAMPARRAY sample_data, JDIMENSION start_col)
   }
 }
 
+#ifdef FDCT_SSE2_SUPPORTED
+
+/*
+ * SSE2 version of jpeg_fdct_islow.
+ *
+ * For 8-bit samples every value in pass 1 and every input of pass 2 fits
+ * in 16 bits (the row outputs are within +-4096), and the pass 2 sums of
+ * products fit in 32 bits.  So we can transform eight rows or columns at
+ * a time, using the 16x16->32 bit multiply-add of SSE2 on regrouped
+ * products, and get exactly what the C code gets.
+ */
+
+/* A pair of multipliers, repeated for _mm_madd_epi16 */
+#define PAIR_SSE2(a,b) \
+  _mm_setr_epi16((short) (a), (short) (b), (short) (a), (short) (b), \
+		 (short) (a), (short) (b), (short) (a), (short) (b))
+
+
+INLINE
+LOCAL(void)
+transpose_sse2 (__m128i * x)
+/* Transpose an 8x8 matrix of 16-bit elements (same as in jidctint.c) */
+{
+  __m128i a0, a1, a2, a3, a4, a5, a6, a7;
+  __m128i b0, b1, b2, b3, b4, b5, b6, b7;
+
+  a0 = _mm_unpacklo_epi16(x[0], x[1]);
+  a1 = _mm_unpackhi_epi16(x[0], x[1]);
+  a2 = _mm_unpacklo_epi16(x[2], x[3]);
+  a3 = _mm_unpackhi_epi16(x[2], x[3]);
+  a4 = _mm_unpacklo_epi16(x[4], x[5]);
+  a5 = _mm_unpackhi_epi16(x[4], x[5]);
+  a6 = _mm_unpacklo_epi16(x[6], x[7]);
+  a7 = _mm_unpackhi_epi16(x[6], x[7]);
+
+  b0 = _mm_unpacklo_epi32(a0, a2);
+  b1 = _mm_unpackhi_epi32(a0, a2);
+  b2 = _mm_unpacklo_epi32(a1, a3);
+  b3 = _mm_unpackhi_epi32(a1, a3);
+  b4 = _mm_unpacklo_epi32(a4, a6);
+  b5 = _mm_unpackhi_epi32(a4, a6);
+  b6 = _mm_unpacklo_epi32(a5, a7);
+  b7 = _mm_unpackhi_epi32(a5, a7);
+
+  x[0] = _mm_unpacklo_epi64(b0, b4);
+  x[1] = _mm_unpackhi_epi64(b0, b4);
+  x[2] = _mm_unpacklo_epi64(b1, b5);
+  x[3] = _mm_unpackhi_epi64(b1, b5);
+  x[4] = _mm_unpacklo_epi64(b2, b6);
+  x[5] = _mm_unpackhi_epi64(b2, b6);
+  x[6] = _mm_unpacklo_epi64(b3, b7);
+  x[7] = _mm_unpackhi_epi64(b3, b7);
+}
+
+
+/*
+ * The multiplications of the 8-point 1-D FDCT on four lanes.  The inputs
+ * come as interleaved 16-bit pairs (tmp10,tmp11) and (tmp12,tmp13) of the
+ * even part and (tmp0,tmp1), (tmp2,tmp3) of the odd part; each odd output
+ * is the C code's sum of terms expanded over them.  Outputs 0 and 4 are
+ * left as the plain sum and difference of tmp10 and tmp11, for the caller
+ * to scale.
+ */
+
+INLINE
+LOCAL(void)
+fdct8_sse2 (__m128i p1011, __m128i p1213, __m128i p01, __m128i p23,
+	    __m128i fudge, int shift, __m128i * out)
+{
+  __m128i count = _mm_cvtsi32_si128(shift);
+
+  /* Even part */
+
+  out[0] = _mm_madd_epi16(p1011, PAIR_SSE2(1, 1));
+  out[4] = _mm_madd_epi16(p1011, PAIR_SSE2(1, -1));
+
+  out[2] = _mm_madd_epi16(p1213, PAIR_SSE2(FIX_0_541196100 + FIX_0_765366865,
+					   FIX_0_541196100));
+  out[6] = _mm_madd_epi16(p1213, PAIR_SSE2(FIX_0_541196100,
+					   FIX_0_541196100 - FIX_1_847759065));
+
+  /* Odd part */
+
+  out[1] = _mm_add_epi32(
+    _mm_madd_epi16(p01, PAIR_SSE2(FIX_1_501321110 - FIX_0_899976223 -
+				  FIX_0_390180644 + FIX_1_175875602,
+				  FIX_1_175875602)),
+    _mm_madd_epi16(p23, PAIR_SSE2(FIX_1_175875602 - FIX_0_390180644,
+				  FIX_1_175875602 - FIX_0_899976223)));
+  out[3] = _mm_add_epi32(
+    _mm_madd_epi16(p01, PAIR_SSE2(FIX_1_175875602,
+				  FIX_3_072711026 - FIX_2_562915447 -
+				  FIX_1_961570560 + FIX_1_175875602)),
+    _mm_madd_epi16(p23, PAIR_SSE2(FIX_1_175875602 - FIX_2_562915447,
+				  FIX_1_175875602 - FIX_1_961570560)));
+  out[5] = _mm_add_epi32(
+    _mm_madd_epi16(p01, PAIR_SSE2(FIX_1_175875602 - FIX_0_390180644,
+				  FIX_1_175875602 - FIX_2_562915447)),
+    _mm_madd_epi16(p23, PAIR_SSE2(FIX_2_053119869 - FIX_2_562915447 -
+				  FIX_0_390180644 + FIX_1_175875602,
+				  FIX_1_175875602)));
+  out[7] = _mm_add_epi32(
+    _mm_madd_epi16(p01, PAIR_SSE2(FIX_1_175875602 - FIX_0_899976223,
+				  FIX_1_175875602 - FIX_1_961570560)),
+    _mm_madd_epi16(p23, PAIR_SSE2(FIX_1_175875602,
+				  FIX_0_298631336 - FIX_0_899976223 -
+				  FIX_1_961570560 + FIX_1_175875602)));
+
+  /* Descale all but outputs 0 and 4 */
+
+  out[1] = _mm_sra_epi32(_mm_add_epi32(out[1], fudge), count);
+  out[2] = _mm_sra_epi32(_mm_add_epi32(out[2], fudge), count);
+  out[3] = _mm_sra_epi32(_mm_add_epi32(out[3], fudge), count);
+  out[5] = _mm_sra_epi32(_mm_add_epi32(out[5], fudge), count);
+  out[6] = _mm_sra_epi32(_mm_add_epi32(out[6], fudge), count);
+  out[7] = _mm_sra_epi32(_mm_add_epi32(out[7], fudge), count);
+}
+
+
+INLINE
+LOCAL(void)
+fdct8x8_sse2 (__m128i * x, __m128i fudge, int shift,
+	      __m128i * lo, __m128i * hi)
+/* Do the 1-D FDCT of x[0..7] on eight lanes, into 32-bit lo[] and hi[] */
+{
+  __m128i tmp0, tmp1, tmp2, tmp3;
+  __m128i tmp10, tmp11, tmp12, tmp13;
+
+  tmp0 = _mm_add_epi16(x[0], x[7]);
+  tmp1 = _mm_add_epi16(x[1], x[6]);
+  tmp2 = _mm_add_epi16(x[2], x[5]);
+  tmp3 = _mm_add_epi16(x[3], x[4]);
+
+  tmp10 = _mm_add_epi16(tmp0, tmp3);
+  tmp12 = _mm_sub_epi16(tmp0, tmp3);
+  tmp11 = _mm_add_epi16(tmp1, tmp2);
+  tmp13 = _mm_sub_epi16(tmp1, tmp2);
+
+  tmp0 = _mm_sub_epi16(x[0], x[7]);
+  tmp1 = _mm_sub_epi16(x[1], x[6]);
+  tmp2 = _mm_sub_epi16(x[2], x[5]);
+  tmp3 = _mm_sub_epi16(x[3], x[4]);
+
+  fdct8_sse2(_mm_unpacklo_epi16(tmp10, tmp11),
+	     _mm_unpacklo_epi16(tmp12, tmp13),
+	     _mm_unpacklo_epi16(tmp0, tmp1), _mm_unpacklo_epi16(tmp2, tmp3),
+	     fudge, shift, lo);
+  fdct8_sse2(_mm_unpackhi_epi16(tmp10, tmp11),
+	     _mm_unpackhi_epi16(tmp12, tmp13),
+	     _mm_unpackhi_epi16(tmp0, tmp1), _mm_unpackhi_epi16(tmp2, tmp3),
+	     fudge, shift, hi);
+}
+
+
+GLOBAL(void)
+jpeg_fdct_islow_sse2 (DCTELEM * data, JSAMPARRAY sample_data,
+		      JDIMENSION start_col)
+{
+  __m128i x[DCTSIZE];		/* eight 16-bit rows or columns */
+  __m128i lo[DCTSIZE], hi[DCTSIZE]; /* 32-bit results for lanes 0-3, 4-7 */
+  __m128i zero = _mm_setzero_si128();
+  int ctr;
+
+  /* Pass 1: process rows.
+   * The rows are transposed first, so that each lane works on one row.
+   */
+
+  for (ctr = 0; ctr < DCTSIZE; ctr++)
+    x[ctr] = _mm_unpacklo_epi8(
+      _mm_loadl_epi64((const __m128i *) (sample_data[ctr] + start_col)),
+      zero);
+  transpose_sse2(x);
+
+  fdct8x8_sse2(x, _mm_set1_epi32(ONE << (CONST_BITS-PASS1_BITS-1)),
+	       CONST_BITS-PASS1_BITS, lo, hi);
+
+  /* Apply unsigned->signed conversion */
+  lo[0] = _mm_add_epi32(lo[0], _mm_set1_epi32(- 8 * CENTERJSAMPLE));
+  hi[0] = _mm_add_epi32(hi[0], _mm_set1_epi32(- 8 * CENTERJSAMPLE));
+  lo[0] = _mm_slli_epi32(lo[0], PASS1_BITS);
+  hi[0] = _mm_slli_epi32(hi[0], PASS1_BITS);
+  lo[4] = _mm_slli_epi32(lo[4], PASS1_BITS);
+  hi[4] = _mm_slli_epi32(hi[4], PASS1_BITS);
+
+  for (ctr = 0; ctr < DCTSIZE; ctr++)
+    x[ctr] = _mm_packs_epi32(lo[ctr], hi[ctr]);
+  transpose_sse2(x);
+
+  /* Pass 2: process columns, one in each lane.
+   * We remove the PASS1_BITS scaling, but leave the results scaled up
+   * by an overall factor of 8.
+   */
+
+  fdct8x8_sse2(x, _mm_set1_epi32(ONE << (CONST_BITS+PASS1_BITS-1)),
+	       CONST_BITS+PASS1_BITS, lo, hi);
+
+  lo[0] = _mm_srai_epi32(_mm_add_epi32(lo[0],
+				       _mm_set1_epi32(ONE << (PASS1_BITS-1))),
+			 PASS1_BITS);
+  hi[0] = _mm_srai_epi32(_mm_add_epi32(hi[0],
+				       _mm_set1_epi32(ONE << (PASS1_BITS-1))),
+			 PASS1_BITS);
+  lo[4] = _mm_srai_epi32(_mm_add_epi32(lo[4],
+				       _mm_set1_epi32(ONE << (PASS1_BITS-1))),
+			 PASS1_BITS);
+  hi[4] = _mm_srai_epi32(_mm_add_epi32(hi[4],
+				       _mm_set1_epi32(ONE << (PASS1_BITS-1))),
+			 PASS1_BITS);
+
+  for (ctr = 0; ctr < DCTSIZE; ctr++) {
+    _mm_storeu_si128((__m128i *) (data + DCTSIZE*ctr), lo[ctr]);
+    _mm_storeu_si128((__m128i *) (data + DCTSIZE*ctr + 4), hi[ctr]);
+  }
+}
+
+#endif /* FDCT_SSE2_SUPPORTED */
+
 #ifdef DCT_SCALING_SUPPORTED
 
 
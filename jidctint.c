@@ -53,6 +53,10 @@
 #include "jpeglib.h"
 #include "jdct.h"		/* Private declarations for DCT subsystem */
 
+#ifdef IDCT_SSE2_SUPPORTED
+#include <emmintrin.h>
+#endif
+
 #ifdef DCT_ISLOW_SUPPORTED
 
 
@@ -419,6 +423,535 @@ jpeg_idct_islow (j_decompress_ptr cinfo, jpeg_component_info * compptr,
   }
 }
 
+
+/*
+ * Equivalents of jpeg_idct_islow for sparse blocks, chosen by the
+ * coefficient controller from what the entropy decoder tells it.
+ * They give exactly the same results; they just skip the arithmetic
+ * on coefficients known to be zero.
+ *
+ * Block with only a DC coefficient: both passes reduce to the DC term,
+ * so the output is a constant.
+ */
+
+GLOBAL(void)
+jpeg_idct_islow_dc (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		    JCOEFPTR coef_block,
+		    JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+  ISLOW_MULT_TYPE * quantptr = (ISLOW_MULT_TYPE *) compptr->dct_table;
+  JSAMPLE *range_limit = IDCT_range_limit(cinfo);
+  int dcval = DEQUANTIZE(coef_block[0], quantptr[0]) << PASS1_BITS;
+  JSAMPLE outval;
+  JSAMPROW outptr;
+  int ctr;
+  SHIFT_TEMPS
+
+  outval = range_limit[(int) DESCALE((INT32) dcval, PASS1_BITS+3)
+		       & RANGE_MASK];
+  for (ctr = 0; ctr < DCTSIZE; ctr++) {
+    outptr = output_buf[ctr] + output_col;
+    outptr[0] = outval;
+    outptr[1] = outval;
+    outptr[2] = outval;
+    outptr[3] = outval;
+    outptr[4] = outval;
+    outptr[5] = outval;
+    outptr[6] = outval;
+    outptr[7] = outval;
+  }
+}
+
+
+/*
+ * Block whose nonzero coefficients lie in the upper left 4x4 (the first
+ * IDCT_LOW_LAST+1 in zigzag order).  Inputs 4..7 of every 1-D transform
+ * are zero, so their terms drop out, and columns 4..7 need no pass 1.
+ */
+
+GLOBAL(void)
+jpeg_idct_islow_low (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		     JCOEFPTR coef_block,
+		     JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+  INT32 tmp0, tmp1, tmp2, tmp3;
+  INT32 tmp10, tmp11, tmp12, tmp13;
+  INT32 z1, z2, z3;
+  JCOEFPTR inptr;
+  ISLOW_MULT_TYPE * quantptr;
+  int * wsptr;
+  JSAMPROW outptr;
+  JSAMPLE *range_limit = IDCT_range_limit(cinfo);
+  int ctr;
+  int workspace[DCTSIZE2];	/* buffers data between passes */
+  SHIFT_TEMPS
+
+  /* Pass 1: process columns 0..3 from input, store into work array. */
+
+  inptr = coef_block;
+  quantptr = (ISLOW_MULT_TYPE *) compptr->dct_table;
+  wsptr = workspace;
+  for (ctr = 0; ctr < 4; ctr++) {
+    if (inptr[DCTSIZE*1] == 0 && inptr[DCTSIZE*2] == 0 &&
+	inptr[DCTSIZE*3] == 0) {
+      /* AC terms all zero */
+      int dcval = DEQUANTIZE(inptr[DCTSIZE*0], quantptr[DCTSIZE*0]) << PASS1_BITS;
+
+      wsptr[DCTSIZE*0] = dcval;
+      wsptr[DCTSIZE*1] = dcval;
+      wsptr[DCTSIZE*2] = dcval;
+      wsptr[DCTSIZE*3] = dcval;
+      wsptr[DCTSIZE*4] = dcval;
+      wsptr[DCTSIZE*5] = dcval;
+      wsptr[DCTSIZE*6] = dcval;
+      wsptr[DCTSIZE*7] = dcval;
+
+      inptr++;			/* advance pointers to next column */
+      quantptr++;
+      wsptr++;
+      continue;
+    }
+
+    /* Even part: inputs 4 and 6 are zero. */
+
+    z2 = DEQUANTIZE(inptr[DCTSIZE*2], quantptr[DCTSIZE*2]);
+
+    z1 = MULTIPLY(z2, FIX_0_541196100);            /* c6 */
+    tmp2 = z1 + MULTIPLY(z2, FIX_0_765366865);     /* c2-c6 */
+    tmp3 = z1;
+
+    z2 = DEQUANTIZE(inptr[DCTSIZE*0], quantptr[DCTSIZE*0]);
+    z2 <<= CONST_BITS;
+    /* Add fudge factor here for final descale. */
+    z2 += ONE << (CONST_BITS-PASS1_BITS-1);
+
+    tmp10 = z2 + tmp2;
+    tmp13 = z2 - tmp2;
+    tmp11 = z2 + tmp3;
+    tmp12 = z2 - tmp3;
+
+    /* Odd part: inputs 5 and 7 are zero. */
+
+    tmp2 = DEQUANTIZE(inptr[DCTSIZE*3], quantptr[DCTSIZE*3]);
+    tmp3 = DEQUANTIZE(inptr[DCTSIZE*1], quantptr[DCTSIZE*1]);
+
+    z1 = MULTIPLY(tmp2 + tmp3, FIX_1_175875602);   /*  c3 */
+    z2 = MULTIPLY(tmp2, - FIX_1_961570560);        /* -c3-c5 */
+    z3 = MULTIPLY(tmp3, - FIX_0_390180644);        /* -c3+c5 */
+    z2 += z1;
+    z3 += z1;
+
+    z1 = MULTIPLY(tmp3, - FIX_0_899976223);        /* -c3+c7 */
+    tmp0 = z1 + z2;
+    tmp3 = MULTIPLY(tmp3, FIX_1_501321110);        /*  c1+c3-c5-c7 */
+    tmp3 += z1 + z3;
+
+    z1 = MULTIPLY(tmp2, - FIX_2_562915447);        /* -c1-c3 */
+    tmp1 = z1 + z3;
+    tmp2 = MULTIPLY(tmp2, FIX_3_072711026);        /*  c1+c3+c5-c7 */
+    tmp2 += z1 + z2;
+
+    /* Final output stage: inputs are tmp10..tmp13, tmp0..tmp3 */
+
+    wsptr[DCTSIZE*0] = (int) RIGHT_SHIFT(tmp10 + tmp3, CONST_BITS-PASS1_BITS);
+    wsptr[DCTSIZE*7] = (int) RIGHT_SHIFT(tmp10 - tmp3, CONST_BITS-PASS1_BITS);
+    wsptr[DCTSIZE*1] = (int) RIGHT_SHIFT(tmp11 + tmp2, CONST_BITS-PASS1_BITS);
+    wsptr[DCTSIZE*6] = (int) RIGHT_SHIFT(tmp11 - tmp2, CONST_BITS-PASS1_BITS);
+    wsptr[DCTSIZE*2] = (int) RIGHT_SHIFT(tmp12 + tmp1, CONST_BITS-PASS1_BITS);
+    wsptr[DCTSIZE*5] = (int) RIGHT_SHIFT(tmp12 - tmp1, CONST_BITS-PASS1_BITS);
+    wsptr[DCTSIZE*3] = (int) RIGHT_SHIFT(tmp13 + tmp0, CONST_BITS-PASS1_BITS);
+    wsptr[DCTSIZE*4] = (int) RIGHT_SHIFT(tmp13 - tmp0, CONST_BITS-PASS1_BITS);
+
+    inptr++;			/* advance pointers to next column */
+    quantptr++;
+    wsptr++;
+  }
+
+  /* Pass 2: process rows from work array, store into output array.
+   * Entries 4..7 of each row are zero (columns 4..7 were never written).
+   */
+
+  wsptr = workspace;
+  for (ctr = 0; ctr < DCTSIZE; ctr++) {
+    outptr = output_buf[ctr] + output_col;
+
+    if (wsptr[1] == 0 && wsptr[2] == 0 && wsptr[3] == 0) {
+      /* AC terms all zero */
+      JSAMPLE dcval = range_limit[(int) DESCALE((INT32) wsptr[0], PASS1_BITS+3)
+				  & RANGE_MASK];
+
+      outptr[0] = dcval;
+      outptr[1] = dcval;
+      outptr[2] = dcval;
+      outptr[3] = dcval;
+      outptr[4] = dcval;
+      outptr[5] = dcval;
+      outptr[6] = dcval;
+      outptr[7] = dcval;
+
+      wsptr += DCTSIZE;		/* advance pointer to next row */
+      continue;
+    }
+
+    /* Even part */
+
+    z2 = (INT32) wsptr[2];
+
+    z1 = MULTIPLY(z2, FIX_0_541196100);            /* c6 */
+    tmp2 = z1 + MULTIPLY(z2, FIX_0_765366865);     /* c2-c6 */
+    tmp3 = z1;
+
+    /* Add fudge factor here for final descale. */
+    z2 = (INT32) wsptr[0] + (ONE << (PASS1_BITS+2));
+    z2 <<= CONST_BITS;
+
+    tmp10 = z2 + tmp2;
+    tmp13 = z2 - tmp2;
+    tmp11 = z2 + tmp3;
+    tmp12 = z2 - tmp3;
+
+    /* Odd part */
+
+    tmp2 = (INT32) wsptr[3];
+    tmp3 = (INT32) wsptr[1];
+
+    z1 = MULTIPLY(tmp2 + tmp3, FIX_1_175875602);   /*  c3 */
+    z2 = MULTIPLY(tmp2, - FIX_1_961570560);        /* -c3-c5 */
+    z3 = MULTIPLY(tmp3, - FIX_0_390180644);        /* -c3+c5 */
+    z2 += z1;
+    z3 += z1;
+
+    z1 = MULTIPLY(tmp3, - FIX_0_899976223);        /* -c3+c7 */
+    tmp0 = z1 + z2;
+    tmp3 = MULTIPLY(tmp3, FIX_1_501321110);        /*  c1+c3-c5-c7 */
+    tmp3 += z1 + z3;
+
+    z1 = MULTIPLY(tmp2, - FIX_2_562915447);        /* -c1-c3 */
+    tmp1 = z1 + z3;
+    tmp2 = MULTIPLY(tmp2, FIX_3_072711026);        /*  c1+c3+c5-c7 */
+    tmp2 += z1 + z2;
+
+    /* Final output stage: inputs are tmp10..tmp13, tmp0..tmp3 */
+
+    outptr[0] = range_limit[(int) RIGHT_SHIFT(tmp10 + tmp3,
+					      CONST_BITS+PASS1_BITS+3)
+			    & RANGE_MASK];
+    outptr[7] = range_limit[(int) RIGHT_SHIFT(tmp10 - tmp3,
+					      CONST_BITS+PASS1_BITS+3)
+			    & RANGE_MASK];
+    outptr[1] = range_limit[(int) RIGHT_SHIFT(tmp11 + tmp2,
+					      CONST_BITS+PASS1_BITS+3)
+			    & RANGE_MASK];
+    outptr[6] = range_limit[(int) RIGHT_SHIFT(tmp11 - tmp2,
+					      CONST_BITS+PASS1_BITS+3)
+			    & RANGE_MASK];
+    outptr[2] = range_limit[(int) RIGHT_SHIFT(tmp12 + tmp1,
+					      CONST_BITS+PASS1_BITS+3)
+			    & RANGE_MASK];
+    outptr[5] = range_limit[(int) RIGHT_SHIFT(tmp12 - tmp1,
+					      CONST_BITS+PASS1_BITS+3)
+			    & RANGE_MASK];
+    outptr[3] = range_limit[(int) RIGHT_SHIFT(tmp13 + tmp0,
+					      CONST_BITS+PASS1_BITS+3)
+			    & RANGE_MASK];
+    outptr[4] = range_limit[(int) RIGHT_SHIFT(tmp13 - tmp0,
+					      CONST_BITS+PASS1_BITS+3)
+			    & RANGE_MASK];
+
+    wsptr += DCTSIZE;		/* advance pointer to next row */
+  }
+}
+
+
+#ifdef IDCT_SSE2_SUPPORTED
+
+/*
+ * SSE2 versions of jpeg_idct_islow and jpeg_idct_4x4.
+ *
+ * As noted above, the inputs of each pass are no more than 16 bits wide
+ * for valid 8-bit data, and then every result fits in 32 bits before it
+ * is descaled.  So we can work on eight 16-bit inputs at a time, use the
+ * 16x16->32 bit multiply-add of SSE2 and regroup the products, and still
+ * get exactly what the C code gets.  INT32 may be wider than 32 bits,
+ * though, so a block with larger values (only corrupt data has them) is
+ * handed to the C routine.  The zero column and row shortcuts are kept,
+ * as lane selects, since they do not round quite like the full path.
+ *
+ * Range limiting takes the low 10 bits of each result as a signed value,
+ * adds CENTERJSAMPLE and saturates, which is what the range_limit table
+ * does.
+ */
+
+/* A pair of multipliers, repeated for _mm_madd_epi16 */
+#define PAIR_SSE2(a,b) \
+  _mm_setr_epi16((short) (a), (short) (b), (short) (a), (short) (b), \
+		 (short) (a), (short) (b), (short) (a), (short) (b))
+
+/* Nonzero in each 32-bit lane holding a value that needs more than 16 bits */
+#define WIDE_SSE2(var) \
+  _mm_srli_epi32(_mm_add_epi32(var, _mm_set1_epi32(32768)), 16)
+#define ANY_SET_SSE2(var) \
+  (_mm_movemask_epi8(_mm_cmpeq_epi8(var, _mm_setzero_si128())) != 0xFFFF)
+
+#define SELECT_SSE2(mask,a,b) \
+  _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b))
+
+
+INLINE
+LOCAL(__m128i)
+dequantize_sse2 (__m128i coef, ISLOW_MULT_TYPE * quantptr, __m128i * wide)
+/* Dequantize eight coefficients into 16-bit lanes, flagging overflow
+ * in the corresponding lanes of *wide.
+ */
+{
+  __m128i qlo, qhi, quant, lo, hi;
+
+  qlo = _mm_setr_epi32((int) quantptr[0], (int) quantptr[1],
+		       (int) quantptr[2], (int) quantptr[3]);
+  qhi = _mm_setr_epi32((int) quantptr[4], (int) quantptr[5],
+		       (int) quantptr[6], (int) quantptr[7]);
+  quant = _mm_packs_epi32(qlo, qhi);
+  lo = _mm_mullo_epi16(coef, quant);
+  hi = _mm_mulhi_epi16(coef, quant);
+  /* Flag multipliers that do not fit, and products that do not */
+  *wide = _mm_or_si128(*wide, _mm_packs_epi32(_mm_srli_epi32(qlo, 15),
+					      _mm_srli_epi32(qhi, 15)));
+  *wide = _mm_or_si128(*wide, _mm_xor_si128(hi, _mm_srai_epi16(lo, 15)));
+  return lo;
+}
+
+
+INLINE
+LOCAL(__m128i)
+range_limit_sse2 (__m128i x)
+/* Same as range_limit[x & RANGE_MASK], still in 32-bit lanes */
+{
+  x = _mm_srai_epi32(_mm_slli_epi32(x, 22), 22);
+  return _mm_add_epi32(x, _mm_set1_epi32(CENTERJSAMPLE));
+}
+
+
+INLINE
+LOCAL(void)
+transpose_sse2 (__m128i * x)
+/* Transpose an 8x8 matrix of 16-bit elements */
+{
+  __m128i a0, a1, a2, a3, a4, a5, a6, a7;
+  __m128i b0, b1, b2, b3, b4, b5, b6, b7;
+
+  a0 = _mm_unpacklo_epi16(x[0], x[1]);
+  a1 = _mm_unpackhi_epi16(x[0], x[1]);
+  a2 = _mm_unpacklo_epi16(x[2], x[3]);
+  a3 = _mm_unpackhi_epi16(x[2], x[3]);
+  a4 = _mm_unpacklo_epi16(x[4], x[5]);
+  a5 = _mm_unpackhi_epi16(x[4], x[5]);
+  a6 = _mm_unpacklo_epi16(x[6], x[7]);
+  a7 = _mm_unpackhi_epi16(x[6], x[7]);
+
+  b0 = _mm_unpacklo_epi32(a0, a2);
+  b1 = _mm_unpackhi_epi32(a0, a2);
+  b2 = _mm_unpacklo_epi32(a1, a3);
+  b3 = _mm_unpackhi_epi32(a1, a3);
+  b4 = _mm_unpacklo_epi32(a4, a6);
+  b5 = _mm_unpackhi_epi32(a4, a6);
+  b6 = _mm_unpacklo_epi32(a5, a7);
+  b7 = _mm_unpackhi_epi32(a5, a7);
+
+  x[0] = _mm_unpacklo_epi64(b0, b4);
+  x[1] = _mm_unpackhi_epi64(b0, b4);
+  x[2] = _mm_unpacklo_epi64(b1, b5);
+  x[3] = _mm_unpackhi_epi64(b1, b5);
+  x[4] = _mm_unpacklo_epi64(b2, b6);
+  x[5] = _mm_unpackhi_epi64(b2, b6);
+  x[6] = _mm_unpacklo_epi64(b3, b7);
+  x[7] = _mm_unpackhi_epi64(b3, b7);
+}
+
+
+/*
+ * The 8-point 1-D IDCT of jpeg_idct_islow on four lanes.  The inputs come
+ * as interleaved 16-bit pairs (x0,x4), (x2,x6), (x7,x5), (x3,x1); each
+ * multiply-add below is one of the C code's terms expanded over them.
+ * The C code adds its rounding fudge factor before the CONST_BITS scaling
+ * in pass 2 and after it in pass 1, but that comes to the same thing.
+ */
+
+INLINE
+LOCAL(void)
+idct8_sse2 (__m128i p04, __m128i p26, __m128i p75, __m128i p31,
+	    __m128i fudge, int shift, __m128i * out)
+{
+  __m128i tmp0, tmp1, tmp2, tmp3;
+  __m128i tmp10, tmp11, tmp12, tmp13;
+  __m128i count = _mm_cvtsi32_si128(shift);
+
+  /* Even part */
+
+  tmp2 = _mm_madd_epi16(p26, PAIR_SSE2(FIX_0_541196100 + FIX_0_765366865,
+				       FIX_0_541196100));
+  tmp3 = _mm_madd_epi16(p26, PAIR_SSE2(FIX_0_541196100,
+				       FIX_0_541196100 - FIX_1_847759065));
+
+  tmp0 = _mm_add_epi32(_mm_madd_epi16(p04, PAIR_SSE2(ONE << CONST_BITS,
+						     ONE << CONST_BITS)),
+		       fudge);
+  tmp1 = _mm_add_epi32(_mm_madd_epi16(p04, PAIR_SSE2(ONE << CONST_BITS,
+						     - (ONE << CONST_BITS))),
+		       fudge);
+
+  tmp10 = _mm_add_epi32(tmp0, tmp2);
+  tmp13 = _mm_sub_epi32(tmp0, tmp2);
+  tmp11 = _mm_add_epi32(tmp1, tmp3);
+  tmp12 = _mm_sub_epi32(tmp1, tmp3);
+
+  /* Odd part */
+
+  tmp0 = _mm_add_epi32(
+    _mm_madd_epi16(p75, PAIR_SSE2(FIX_0_298631336 - FIX_0_899976223 -
+				  FIX_1_961570560 + FIX_1_175875602,
+				  FIX_1_175875602)),
+    _mm_madd_epi16(p31, PAIR_SSE2(FIX_1_175875602 - FIX_1_961570560,
+				  FIX_1_175875602 - FIX_0_899976223)));
+  tmp1 = _mm_add_epi32(
+    _mm_madd_epi16(p75, PAIR_SSE2(FIX_1_175875602,
+				  FIX_2_053119869 - FIX_2_562915447 -
+				  FIX_0_390180644 + FIX_1_175875602)),
+    _mm_madd_epi16(p31, PAIR_SSE2(FIX_1_175875602 - FIX_2_562915447,
+				  FIX_1_175875602 - FIX_0_390180644)));
+  tmp2 = _mm_add_epi32(
+    _mm_madd_epi16(p75, PAIR_SSE2(FIX_1_175875602 - FIX_1_961570560,
+				  FIX_1_175875602 - FIX_2_562915447)),
+    _mm_madd_epi16(p31, PAIR_SSE2(FIX_3_072711026 - FIX_2_562915447 -
+				  FIX_1_961570560 + FIX_1_175875602,
+				  FIX_1_175875602)));
+  tmp3 = _mm_add_epi32(
+    _mm_madd_epi16(p75, PAIR_SSE2(FIX_1_175875602 - FIX_0_899976223,
+				  FIX_1_175875602 - FIX_0_390180644)),
+    _mm_madd_epi16(p31, PAIR_SSE2(FIX_1_175875602,
+				  FIX_1_501321110 - FIX_0_899976223 -
+				  FIX_0_390180644 + FIX_1_175875602)));
+
+  /* Final output stage */
+
+  out[0] = _mm_sra_epi32(_mm_add_epi32(tmp10, tmp3), count);
+  out[7] = _mm_sra_epi32(_mm_sub_epi32(tmp10, tmp3), count);
+  out[1] = _mm_sra_epi32(_mm_add_epi32(tmp11, tmp2), count);
+  out[6] = _mm_sra_epi32(_mm_sub_epi32(tmp11, tmp2), count);
+  out[2] = _mm_sra_epi32(_mm_add_epi32(tmp12, tmp1), count);
+  out[5] = _mm_sra_epi32(_mm_sub_epi32(tmp12, tmp1), count);
+  out[3] = _mm_sra_epi32(_mm_add_epi32(tmp13, tmp0), count);
+  out[4] = _mm_sra_epi32(_mm_sub_epi32(tmp13, tmp0), count);
+}
+
+
+GLOBAL(void)
+jpeg_idct_islow_sse2 (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		      JCOEFPTR coef_block,
+		      JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+  __m128i x[DCTSIZE];		/* eight 16-bit rows or columns */
+  __m128i lo[DCTSIZE], hi[DCTSIZE]; /* 32-bit results for lanes 0-3, 4-7 */
+  __m128i ac, zero, dcval, wide;
+  ISLOW_MULT_TYPE * quantptr = (ISLOW_MULT_TYPE *) compptr->dct_table;
+  int ctr;
+
+  /* Pass 1: process columns from input, store into x[] by rows. */
+
+  ac = _mm_setzero_si128();
+  wide = _mm_setzero_si128();
+  for (ctr = 0; ctr < DCTSIZE; ctr++) {
+    x[ctr] = _mm_loadu_si128((const __m128i *) (coef_block + DCTSIZE*ctr));
+    if (ctr > 0)
+      ac = _mm_or_si128(ac, x[ctr]);
+    x[ctr] = dequantize_sse2(x[ctr], quantptr + DCTSIZE*ctr, &wide);
+  }
+  if (ANY_SET_SSE2(wide)) {
+    jpeg_idct_islow(cinfo, compptr, coef_block, output_buf, output_col);
+    return;
+  }
+
+  idct8_sse2(_mm_unpacklo_epi16(x[0], x[4]), _mm_unpacklo_epi16(x[2], x[6]),
+	     _mm_unpacklo_epi16(x[7], x[5]), _mm_unpacklo_epi16(x[3], x[1]),
+	     _mm_set1_epi32(ONE << (CONST_BITS-PASS1_BITS-1)),
+	     CONST_BITS-PASS1_BITS, lo);
+  idct8_sse2(_mm_unpackhi_epi16(x[0], x[4]), _mm_unpackhi_epi16(x[2], x[6]),
+	     _mm_unpackhi_epi16(x[7], x[5]), _mm_unpackhi_epi16(x[3], x[1]),
+	     _mm_set1_epi32(ONE << (CONST_BITS-PASS1_BITS-1)),
+	     CONST_BITS-PASS1_BITS, hi);
+
+  /* Columns with all AC terms zero get the DC value instead */
+  zero = _mm_cmpeq_epi16(ac, _mm_setzero_si128());
+  dcval = _mm_slli_epi32(_mm_srai_epi32(_mm_unpacklo_epi16(x[0], x[0]), 16),
+			 PASS1_BITS);
+  ac = _mm_unpacklo_epi16(zero, zero);
+  for (ctr = 0; ctr < DCTSIZE; ctr++) {
+    lo[ctr] = SELECT_SSE2(ac, dcval, lo[ctr]);
+    wide = _mm_or_si128(wide, WIDE_SSE2(lo[ctr]));
+  }
+  dcval = _mm_slli_epi32(_mm_srai_epi32(_mm_unpackhi_epi16(x[0], x[0]), 16),
+			 PASS1_BITS);
+  ac = _mm_unpackhi_epi16(zero, zero);
+  for (ctr = 0; ctr < DCTSIZE; ctr++) {
+    hi[ctr] = SELECT_SSE2(ac, dcval, hi[ctr]);
+    wide = _mm_or_si128(wide, WIDE_SSE2(hi[ctr]));
+  }
+  if (ANY_SET_SSE2(wide)) {
+    jpeg_idct_islow(cinfo, compptr, coef_block, output_buf, output_col);
+    return;
+  }
+
+  for (ctr = 0; ctr < DCTSIZE; ctr++)
+    x[ctr] = _mm_packs_epi32(lo[ctr], hi[ctr]);
+  transpose_sse2(x);
+
+  /* Pass 2: process rows from x[] (now by columns), store into output. */
+
+  idct8_sse2(_mm_unpacklo_epi16(x[0], x[4]), _mm_unpacklo_epi16(x[2], x[6]),
+	     _mm_unpacklo_epi16(x[7], x[5]), _mm_unpacklo_epi16(x[3], x[1]),
+	     _mm_set1_epi32((ONE << (PASS1_BITS+2)) << CONST_BITS),
+	     CONST_BITS+PASS1_BITS+3, lo);
+  idct8_sse2(_mm_unpackhi_epi16(x[0], x[4]), _mm_unpackhi_epi16(x[2], x[6]),
+	     _mm_unpackhi_epi16(x[7], x[5]), _mm_unpackhi_epi16(x[3], x[1]),
+	     _mm_set1_epi32((ONE << (PASS1_BITS+2)) << CONST_BITS),
+	     CONST_BITS+PASS1_BITS+3, hi);
+
+#ifndef NO_ZERO_ROW_TEST
+  /* Rows with all AC terms zero get the DC value instead */
+  ac = _mm_or_si128(_mm_or_si128(_mm_or_si128(x[1], x[2]),
+				 _mm_or_si128(x[3], x[4])),
+		    _mm_or_si128(_mm_or_si128(x[5], x[6]), x[7]));
+  zero = _mm_cmpeq_epi16(ac, _mm_setzero_si128());
+  dcval = _mm_srai_epi32(_mm_unpacklo_epi16(x[0], x[0]), 16);
+  dcval = _mm_srai_epi32(_mm_add_epi32(dcval,
+				       _mm_set1_epi32(ONE << (PASS1_BITS+2))),
+			 PASS1_BITS+3);
+  ac = _mm_unpacklo_epi16(zero, zero);
+  for (ctr = 0; ctr < DCTSIZE; ctr++)
+    lo[ctr] = SELECT_SSE2(ac, dcval, lo[ctr]);
+  dcval = _mm_srai_epi32(_mm_unpackhi_epi16(x[0], x[0]), 16);
+  dcval = _mm_srai_epi32(_mm_add_epi32(dcval,
+				       _mm_set1_epi32(ONE << (PASS1_BITS+2))),
+			 PASS1_BITS+3);
+  ac = _mm_unpackhi_epi16(zero, zero);
+  for (ctr = 0; ctr < DCTSIZE; ctr++)
+    hi[ctr] = SELECT_SSE2(ac, dcval, hi[ctr]);
+#endif
+
+  for (ctr = 0; ctr < DCTSIZE; ctr++)
+    x[ctr] = _mm_packs_epi32(range_limit_sse2(lo[ctr]),
+			     range_limit_sse2(hi[ctr]));
+  transpose_sse2(x);
+
+  for (ctr = 0; ctr < DCTSIZE; ctr += 2) {
+    ac = _mm_packus_epi16(x[ctr], x[ctr+1]);
+    _mm_storel_epi64((__m128i *) (output_buf[ctr] + output_col), ac);
+    _mm_storel_epi64((__m128i *) (output_buf[ctr+1] + output_col),
+		     _mm_srli_si128(ac, 8));
+  }
+}
+
+#endif /* IDCT_SSE2_SUPPORTED */
+
 #ifdef IDCT_SCALING_SUPPORTED
 
 
@@ -911,6 +1444,132 @@ jpeg_idct_4x4 (j_decompress_ptr cinfo, jpeg_component_info * compptr,
   }
 }
 
+#ifdef IDCT_SSE2_SUPPORTED
+
+/*
+ * SSE2 version of jpeg_idct_4x4.  See the notes on jpeg_idct_islow_sse2.
+ * Four columns, then four rows, fill only half of each register.
+ */
+
+GLOBAL(void)
+jpeg_idct_4x4_sse2 (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		    JCOEFPTR coef_block,
+		    JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+  __m128i tmp0, tmp2, tmp10, tmp12;
+  __m128i x[4], p02, p13, wide;
+  ISLOW_MULT_TYPE * quantptr = (ISLOW_MULT_TYPE *) compptr->dct_table;
+  int ctr, outval;
+
+  /* Pass 1: process columns from input. */
+
+  wide = _mm_setzero_si128();
+  for (ctr = 0; ctr < 4; ctr++)
+    x[ctr] = dequantize_sse2(_mm_loadu_si128((const __m128i *)
+					     (coef_block + DCTSIZE*ctr)),
+			     quantptr + DCTSIZE*ctr, &wide);
+  /* Only the low half of each row matters */
+  if (ANY_SET_SSE2(_mm_unpacklo_epi64(wide, _mm_setzero_si128()))) {
+    jpeg_idct_4x4(cinfo, compptr, coef_block, output_buf, output_col);
+    return;
+  }
+  p02 = _mm_unpacklo_epi16(x[0], x[2]);
+  p13 = _mm_unpacklo_epi16(x[1], x[3]);
+
+  /* Even part */
+
+  tmp10 = _mm_madd_epi16(p02, PAIR_SSE2(ONE << PASS1_BITS,
+					ONE << PASS1_BITS));
+  tmp12 = _mm_madd_epi16(p02, PAIR_SSE2(ONE << PASS1_BITS,
+					- (ONE << PASS1_BITS)));
+
+  /* Odd part */
+  /* Same rotation as in the even part of the 8x8 LL&M IDCT */
+
+  tmp0 = _mm_madd_epi16(p13, PAIR_SSE2(FIX_0_541196100 + FIX_0_765366865,
+				       FIX_0_541196100));
+  tmp2 = _mm_madd_epi16(p13, PAIR_SSE2(FIX_0_541196100,
+				       FIX_0_541196100 - FIX_1_847759065));
+  /* Add fudge factor here for final descale. */
+  tmp0 = _mm_srai_epi32(_mm_add_epi32(tmp0,
+			_mm_set1_epi32(ONE << (CONST_BITS-PASS1_BITS-1))),
+			CONST_BITS-PASS1_BITS);
+  tmp2 = _mm_srai_epi32(_mm_add_epi32(tmp2,
+			_mm_set1_epi32(ONE << (CONST_BITS-PASS1_BITS-1))),
+			CONST_BITS-PASS1_BITS);
+
+  /* Final output stage */
+
+  x[0] = _mm_add_epi32(tmp10, tmp0);
+  x[3] = _mm_sub_epi32(tmp10, tmp0);
+  x[1] = _mm_add_epi32(tmp12, tmp2);
+  x[2] = _mm_sub_epi32(tmp12, tmp2);
+
+  wide = _mm_setzero_si128();
+  for (ctr = 0; ctr < 4; ctr++)
+    wide = _mm_or_si128(wide, WIDE_SSE2(x[ctr]));
+  if (ANY_SET_SSE2(wide)) {
+    jpeg_idct_4x4(cinfo, compptr, coef_block, output_buf, output_col);
+    return;
+  }
+
+  /* Transpose, then pair up columns 0 with 2 and 1 with 3 */
+
+  p02 = _mm_packs_epi32(x[0], x[1]);	/* rows 0, 1 */
+  p13 = _mm_packs_epi32(x[2], x[3]);	/* rows 2, 3 */
+  tmp0 = _mm_unpacklo_epi16(p02, p13);
+  tmp2 = _mm_unpackhi_epi16(p02, p13);
+  tmp10 = _mm_unpacklo_epi16(tmp0, tmp2); /* columns 0, 1 */
+  tmp12 = _mm_unpackhi_epi16(tmp0, tmp2); /* columns 2, 3 */
+  p02 = _mm_unpacklo_epi16(tmp10, tmp12);
+  p13 = _mm_unpackhi_epi16(tmp10, tmp12);
+
+  /* Pass 2: process 4 rows. */
+
+  /* Even part */
+
+  /* Add fudge factor here for final descale. */
+  tmp10 = _mm_add_epi32(_mm_madd_epi16(p02, PAIR_SSE2(ONE << CONST_BITS,
+						      ONE << CONST_BITS)),
+			_mm_set1_epi32((ONE << (PASS1_BITS+2)) << CONST_BITS));
+  tmp12 = _mm_add_epi32(_mm_madd_epi16(p02, PAIR_SSE2(ONE << CONST_BITS,
+						      - (ONE << CONST_BITS))),
+			_mm_set1_epi32((ONE << (PASS1_BITS+2)) << CONST_BITS));
+
+  /* Odd part */
+
+  tmp0 = _mm_madd_epi16(p13, PAIR_SSE2(FIX_0_541196100 + FIX_0_765366865,
+				       FIX_0_541196100));
+  tmp2 = _mm_madd_epi16(p13, PAIR_SSE2(FIX_0_541196100,
+				       FIX_0_541196100 - FIX_1_847759065));
+
+  /* Final output stage, back to rows and down to bytes */
+
+  x[0] = range_limit_sse2(_mm_srai_epi32(_mm_add_epi32(tmp10, tmp0),
+					 CONST_BITS+PASS1_BITS+3));
+  x[3] = range_limit_sse2(_mm_srai_epi32(_mm_sub_epi32(tmp10, tmp0),
+					 CONST_BITS+PASS1_BITS+3));
+  x[1] = range_limit_sse2(_mm_srai_epi32(_mm_add_epi32(tmp12, tmp2),
+					 CONST_BITS+PASS1_BITS+3));
+  x[2] = range_limit_sse2(_mm_srai_epi32(_mm_sub_epi32(tmp12, tmp2),
+					 CONST_BITS+PASS1_BITS+3));
+
+  p02 = _mm_packs_epi32(x[0], x[2]);	/* columns 0, 2 of rows 0..3 */
+  p13 = _mm_packs_epi32(x[1], x[3]);	/* columns 1, 3 */
+  tmp0 = _mm_unpacklo_epi16(p02, p13);	/* rows 0..3: columns 0, 1 */
+  tmp2 = _mm_unpackhi_epi16(p02, p13);	/* rows 0..3: columns 2, 3 */
+  x[0] = _mm_packus_epi16(_mm_unpacklo_epi32(tmp0, tmp2),
+			  _mm_unpackhi_epi32(tmp0, tmp2));
+
+  for (ctr = 0; ctr < 4; ctr++) {
+    outval = _mm_cvtsi128_si32(x[0]);
+    MEMCOPY(output_buf[ctr] + output_col, &outval, 4);
+    x[0] = _mm_srli_si128(x[0], 4);
+  }
+}
+
+#endif /* IDCT_SSE2_SUPPORTED */
+
 
 /*
  * Perform dequantization and inverse DCT on one block of coefficients,
@@ -2816,6 +3475,216 @@ jpeg_idct_16x16 (j_decompress_ptr cinfo, jpeg_component_info * compptr,
   }
 }
 
+#ifdef IDCT_SSE2_SUPPORTED
+
+/*
+ * SSE2 version of jpeg_idct_16x16.  See the notes on jpeg_idct_islow_sse2.
+ *
+ * Each 1-D output is a sum of the eight inputs times combinations of the
+ * C code's constants; summed with madd pairs, that reaches twice the range
+ * of the 8-point IDCT.  To keep every sum within 32 bits, blocks whose
+ * inputs to either pass need more than 15 bits go to the C routine (valid
+ * 8-bit data stays well below that).
+ */
+
+/* Nonzero in each 32-bit lane holding a value that needs more than 15 bits */
+#define WIDE15_SSE2(var) \
+  _mm_srli_epi32(_mm_add_epi32(var, _mm_set1_epi32(1 << 14)), 15)
+
+
+/*
+ * The 16-point 1-D IDCT of jpeg_idct_16x16 on four lanes.  The inputs come
+ * as interleaved 16-bit pairs (x0,x4), (x2,x6), (x1,x3), (x5,x7); each
+ * multiply-add gathers the terms of one of the C code's intermediate
+ * values over a pair, with the constants expanded as in the C comments.
+ */
+
+INLINE
+LOCAL(void)
+idct16_sse2 (__m128i p04, __m128i p26, __m128i p13, __m128i p57,
+	     __m128i fudge, int shift, __m128i * out)
+{
+  __m128i tmp0, tmp1, tmp2, tmp3, tmp10, tmp11, tmp12, tmp13;
+  __m128i tmp20, tmp21, tmp22, tmp23, tmp24, tmp25, tmp26, tmp27;
+  __m128i count = _mm_cvtsi32_si128(shift);
+
+  /* Even part */
+
+  tmp10 = _mm_add_epi32(_mm_madd_epi16(p04, PAIR_SSE2(ONE << CONST_BITS,
+						      FIX(1.306562965))),
+			fudge);
+  tmp11 = _mm_add_epi32(_mm_madd_epi16(p04, PAIR_SSE2(ONE << CONST_BITS,
+						      - FIX(1.306562965))),
+			fudge);
+  tmp12 = _mm_add_epi32(_mm_madd_epi16(p04, PAIR_SSE2(ONE << CONST_BITS,
+						      FIX_0_541196100)),
+			fudge);
+  tmp13 = _mm_add_epi32(_mm_madd_epi16(p04, PAIR_SSE2(ONE << CONST_BITS,
+						      - FIX_0_541196100)),
+			fudge);
+
+  tmp0 = _mm_madd_epi16(p26, PAIR_SSE2(FIX(1.387039845),
+				       FIX_2_562915447 - FIX(1.387039845)));
+  tmp1 = _mm_madd_epi16(p26, PAIR_SSE2(FIX(0.275899379) + FIX_0_899976223,
+				       - FIX(0.275899379)));
+  tmp2 = _mm_madd_epi16(p26, PAIR_SSE2(FIX(1.387039845) - FIX(0.601344887),
+				       - FIX(1.387039845)));
+  tmp3 = _mm_madd_epi16(p26, PAIR_SSE2(FIX(0.275899379),
+				       - FIX(0.275899379) - FIX(0.509795579)));
+
+  tmp20 = _mm_add_epi32(tmp10, tmp0);
+  tmp27 = _mm_sub_epi32(tmp10, tmp0);
+  tmp21 = _mm_add_epi32(tmp12, tmp1);
+  tmp26 = _mm_sub_epi32(tmp12, tmp1);
+  tmp22 = _mm_add_epi32(tmp13, tmp2);
+  tmp25 = _mm_sub_epi32(tmp13, tmp2);
+  tmp23 = _mm_add_epi32(tmp11, tmp3);
+  tmp24 = _mm_sub_epi32(tmp11, tmp3);
+
+  /* Odd part */
+
+  tmp0 = _mm_add_epi32(
+    _mm_madd_epi16(p13, PAIR_SSE2(FIX(1.353318001) + FIX(1.247225013) +
+				  FIX(1.093201867) - FIX(2.286341144),
+				  FIX(1.353318001))),
+    _mm_madd_epi16(p57, PAIR_SSE2(FIX(1.247225013), FIX(1.093201867))));
+  tmp1 = _mm_add_epi32(
+    _mm_madd_epi16(p13, PAIR_SSE2(FIX(1.353318001),
+				  FIX(1.353318001) + FIX(0.138617169) +
+				  FIX(0.071888074) - FIX(0.666655658))),
+    _mm_madd_epi16(p57, PAIR_SSE2(FIX(0.138617169), - FIX(0.666655658))));
+  tmp2 = _mm_add_epi32(
+    _mm_madd_epi16(p13, PAIR_SSE2(FIX(1.247225013), FIX(0.138617169))),
+    _mm_madd_epi16(p57, PAIR_SSE2(FIX(1.247225013) + FIX(0.138617169) -
+				  FIX(1.125726048) - FIX(1.353318001),
+				  - FIX(1.353318001))));
+  tmp3 = _mm_add_epi32(
+    _mm_madd_epi16(p13, PAIR_SSE2(FIX(1.093201867), - FIX(0.666655658))),
+    _mm_madd_epi16(p57, PAIR_SSE2(- FIX(1.353318001),
+				  FIX(1.093201867) - FIX(0.666655658) +
+				  FIX(1.065388962) - FIX(1.353318001))));
+  tmp10 = _mm_add_epi32(
+    _mm_madd_epi16(p13, PAIR_SSE2(FIX(0.897167586), - FIX(1.247225013))),
+    _mm_madd_epi16(p57, PAIR_SSE2(- FIX(0.410524528),
+				  FIX(3.141271809) - FIX(0.897167586) -
+				  FIX(1.247225013) + FIX(0.410524528))));
+  tmp11 = _mm_add_epi32(
+    _mm_madd_epi16(p13, PAIR_SSE2(FIX(0.666655658), - FIX(1.407403738))),
+    _mm_madd_epi16(p57, PAIR_SSE2(FIX(0.666655658) + FIX(1.407403738) -
+				  FIX(0.766367282) - FIX(0.410524528),
+				  FIX(0.410524528))));
+  tmp12 = _mm_add_epi32(
+    _mm_madd_epi16(p13, PAIR_SSE2(FIX(0.410524528),
+				  FIX(1.971951411) - FIX(0.410524528) -
+				  FIX(1.407403738) - FIX(1.247225013))),
+    _mm_madd_epi16(p57, PAIR_SSE2(FIX(1.407403738), - FIX(1.247225013))));
+  tmp13 = _mm_add_epi32(
+    _mm_madd_epi16(p13, PAIR_SSE2(FIX(0.897167586) + FIX(0.666655658) +
+				  FIX(0.410524528) - FIX(1.835730603),
+				  - FIX(0.410524528))),
+    _mm_madd_epi16(p57, PAIR_SSE2(FIX(0.666655658), - FIX(0.897167586))));
+
+  /* Final output stage */
+
+  out[0]  = _mm_sra_epi32(_mm_add_epi32(tmp20, tmp0),  count);
+  out[15] = _mm_sra_epi32(_mm_sub_epi32(tmp20, tmp0),  count);
+  out[1]  = _mm_sra_epi32(_mm_add_epi32(tmp21, tmp1),  count);
+  out[14] = _mm_sra_epi32(_mm_sub_epi32(tmp21, tmp1),  count);
+  out[2]  = _mm_sra_epi32(_mm_add_epi32(tmp22, tmp2),  count);
+  out[13] = _mm_sra_epi32(_mm_sub_epi32(tmp22, tmp2),  count);
+  out[3]  = _mm_sra_epi32(_mm_add_epi32(tmp23, tmp3),  count);
+  out[12] = _mm_sra_epi32(_mm_sub_epi32(tmp23, tmp3),  count);
+  out[4]  = _mm_sra_epi32(_mm_add_epi32(tmp24, tmp10), count);
+  out[11] = _mm_sra_epi32(_mm_sub_epi32(tmp24, tmp10), count);
+  out[5]  = _mm_sra_epi32(_mm_add_epi32(tmp25, tmp11), count);
+  out[10] = _mm_sra_epi32(_mm_sub_epi32(tmp25, tmp11), count);
+  out[6]  = _mm_sra_epi32(_mm_add_epi32(tmp26, tmp12), count);
+  out[9]  = _mm_sra_epi32(_mm_sub_epi32(tmp26, tmp12), count);
+  out[7]  = _mm_sra_epi32(_mm_add_epi32(tmp27, tmp13), count);
+  out[8]  = _mm_sra_epi32(_mm_sub_epi32(tmp27, tmp13), count);
+}
+
+
+GLOBAL(void)
+jpeg_idct_16x16_sse2 (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		      JCOEFPTR coef_block,
+		      JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+  __m128i x[DCTSIZE];		/* eight 16-bit rows or columns */
+  __m128i ws[16];		/* work array: 16 rows of 8 16-bit columns */
+  __m128i y[16];		/* 16 output columns, then 2 x 8 half rows */
+  __m128i lo[16], hi[16];	/* 32-bit results for lanes 0-3, 4-7 */
+  __m128i wide;
+  ISLOW_MULT_TYPE * quantptr = (ISLOW_MULT_TYPE *) compptr->dct_table;
+  int ctr, half;
+
+  /* Pass 1: process columns from input, store into ws[] by rows. */
+
+  wide = _mm_setzero_si128();
+  for (ctr = 0; ctr < DCTSIZE; ctr++) {
+    x[ctr] = dequantize_sse2(_mm_loadu_si128((const __m128i *)
+					     (coef_block + DCTSIZE*ctr)),
+			     quantptr + DCTSIZE*ctr, &wide);
+    wide = _mm_or_si128(wide, _mm_srli_epi16(_mm_add_epi16(x[ctr],
+				_mm_set1_epi16(1 << 14)), 15));
+  }
+  if (ANY_SET_SSE2(wide)) {
+    jpeg_idct_16x16(cinfo, compptr, coef_block, output_buf, output_col);
+    return;
+  }
+
+  idct16_sse2(_mm_unpacklo_epi16(x[0], x[4]), _mm_unpacklo_epi16(x[2], x[6]),
+	      _mm_unpacklo_epi16(x[1], x[3]), _mm_unpacklo_epi16(x[5], x[7]),
+	      _mm_set1_epi32(ONE << (CONST_BITS-PASS1_BITS-1)),
+	      CONST_BITS-PASS1_BITS, lo);
+  idct16_sse2(_mm_unpackhi_epi16(x[0], x[4]), _mm_unpackhi_epi16(x[2], x[6]),
+	      _mm_unpackhi_epi16(x[1], x[3]), _mm_unpackhi_epi16(x[5], x[7]),
+	      _mm_set1_epi32(ONE << (CONST_BITS-PASS1_BITS-1)),
+	      CONST_BITS-PASS1_BITS, hi);
+
+  for (ctr = 0; ctr < 16; ctr++)
+    wide = _mm_or_si128(wide, _mm_or_si128(WIDE15_SSE2(lo[ctr]),
+					   WIDE15_SSE2(hi[ctr])));
+  if (ANY_SET_SSE2(wide)) {
+    jpeg_idct_16x16(cinfo, compptr, coef_block, output_buf, output_col);
+    return;
+  }
+
+  for (ctr = 0; ctr < 16; ctr++)
+    ws[ctr] = _mm_packs_epi32(lo[ctr], hi[ctr]);
+
+  /* Pass 2: process 16 rows from ws[], eight at a time, store into output. */
+
+  for (half = 0; half < 16; half += 8) {
+    transpose_sse2(ws + half);	/* now by columns */
+
+    idct16_sse2(_mm_unpacklo_epi16(ws[half+0], ws[half+4]),
+		_mm_unpacklo_epi16(ws[half+2], ws[half+6]),
+		_mm_unpacklo_epi16(ws[half+1], ws[half+3]),
+		_mm_unpacklo_epi16(ws[half+5], ws[half+7]),
+		_mm_set1_epi32((ONE << (PASS1_BITS+2)) << CONST_BITS),
+		CONST_BITS+PASS1_BITS+3, lo);
+    idct16_sse2(_mm_unpackhi_epi16(ws[half+0], ws[half+4]),
+		_mm_unpackhi_epi16(ws[half+2], ws[half+6]),
+		_mm_unpackhi_epi16(ws[half+1], ws[half+3]),
+		_mm_unpackhi_epi16(ws[half+5], ws[half+7]),
+		_mm_set1_epi32((ONE << (PASS1_BITS+2)) << CONST_BITS),
+		CONST_BITS+PASS1_BITS+3, hi);
+
+    for (ctr = 0; ctr < 16; ctr++)
+      y[ctr] = _mm_packs_epi32(range_limit_sse2(lo[ctr]),
+			       range_limit_sse2(hi[ctr]));
+    transpose_sse2(y);		/* columns 0-7 of the eight rows */
+    transpose_sse2(y + 8);	/* columns 8-15 */
+
+    for (ctr = 0; ctr < 8; ctr++)
+      _mm_storeu_si128((__m128i *) (output_buf[half+ctr] + output_col),
+		       _mm_packus_epi16(y[ctr], y[ctr+8]));
+  }
+}
+
+#endif /* IDCT_SSE2_SUPPORTED */
+
 
 /*
  * Perform dequantization and inverse DCT on one block of coefficients,
@@ -74,10 +74,32 @@ extern char * getenv JPP((const char * name));
 #define ALIGN_TYPE  double
 #endif
 
+/*
+ * "Large" objects (sample and coefficient rows, mostly) are further aligned
+ * to LARGE_POOL_ALIGN bytes, by default the size of a cache line on most
+ * current machines, so that the rows start on a cache line boundary.
+ * LARGE_POOL_ALIGN must be a power of 2 and a multiple of
+ * SIZEOF(ALIGN_TYPE).  Defining it as SIZEOF(ALIGN_TYPE) turns the extra
+ * alignment off.  It is always off on machines that need FAR pointers,
+ * since there we cannot do arithmetic on addresses.
+ */
+
+#ifndef LARGE_POOL_ALIGN	/* so can override from jconfig.h */
+#define LARGE_POOL_ALIGN  64
+#endif
+
+#ifdef NEED_FAR_POINTERS
+#define LARGE_POOL_PAD  0
+#else
+/* Most padding needed to align a large pool's data area */
+#define LARGE_POOL_PAD  (LARGE_POOL_ALIGN - SIZEOF(ALIGN_TYPE))
+#endif
+
 
 /*
  * We allocate objects from "pools", where each pool is gotten with a single
- * request to jpeg_get_small() or jpeg_get_large().  There is no per-object
+ * request to jpeg_get_small() or jpeg_get_large(), or to the application's
+ * get_mem routine if it installed one.  There is no per-object
  * overhead within a pool, except for alignment padding.  Each pool has a
  * header with a link to the next pool of the same class.
  * Small and large pool headers are identical except that the latter's
@@ -94,6 +116,7 @@ typedef union small_pool_struct {
     small_pool_ptr next;	/* next in list of pools */
     size_t bytes_used;		/* how many bytes already used within pool */
     size_t bytes_left;		/* bytes still available in this pool */
+    boolean app_mem;		/* TRUE if obtained from the get_mem hook */
   } hdr;
   ALIGN_TYPE dummy;		/* included in union to ensure alignment */
 } small_pool_hdr;
@@ -105,10 +128,15 @@ typedef union large_pool_struct {
     large_pool_ptr next;	/* next in list of pools */
     size_t bytes_used;		/* how many bytes already used within pool */
     size_t bytes_left;		/* bytes still available in this pool */
+    size_t bytes_skipped;	/* alignment padding in front of header */
+    boolean app_mem;		/* TRUE if obtained from the get_mem hook */
   } hdr;
   ALIGN_TYPE dummy;		/* included in union to ensure alignment */
 } large_pool_hdr;
 
+/* Most space taken by a large pool besides its data */
+#define LARGE_POOL_OVERHEAD  (SIZEOF(large_pool_hdr) + LARGE_POOL_PAD)
+
 
 /*
  * Here is the full definition of a memory manager object.
@@ -129,7 +157,15 @@ typedef struct {
   jvirt_sarray_ptr virt_sarray_list;
   jvirt_barray_ptr virt_barray_list;
 
-  /* This counts total space obtained from jpeg_get_small/large */
+  /* Pools of a freed IMAGE pool class kept for reuse (see keep_image_pool);
+   * these are always empty.
+   */
+  small_pool_ptr spare_small_list;
+  large_pool_ptr spare_large_list;
+
+  /* This counts total space obtained from jpeg_get_small/large,
+   * not including spare pools
+   */
   long total_space_allocated;
 
   /* alloc_sarray and alloc_barray set this value for use by virtual
@@ -226,6 +262,41 @@ out_of_memory (j_common_ptr cinfo, int which)
 }
 
 
+/*
+ * Getting and releasing pool storage.
+ * The application may supply its own routines through the get_mem and
+ * free_mem hooks; pools remember where they came from, so the hooks can be
+ * installed at any time after the JPEG object is created.
+ */
+
+LOCAL(void FAR *)
+get_pool_mem (j_common_ptr cinfo, size_t sizeofobject, boolean large,
+	      boolean * app_mem)
+{
+  if (cinfo->mem->get_mem != NULL) {
+    *app_mem = TRUE;
+    return (*cinfo->mem->get_mem) (cinfo, sizeofobject);
+  }
+  *app_mem = FALSE;
+  if (large)
+    return jpeg_get_large(cinfo, sizeofobject);
+  return (void FAR *) jpeg_get_small(cinfo, sizeofobject);
+}
+
+
+LOCAL(void)
+free_pool_mem (j_common_ptr cinfo, void FAR * object, size_t sizeofobject,
+	       boolean large, boolean app_mem)
+{
+  if (app_mem)
+    (*cinfo->mem->free_mem) (cinfo, object, sizeofobject);
+  else if (large)
+    jpeg_free_large(cinfo, object, sizeofobject);
+  else
+    jpeg_free_small(cinfo, (void *) object, sizeofobject);
+}
+
+
 /*
  * Allocation of "small" objects.
  *
@@ -262,6 +333,7 @@ alloc_small (j_common_ptr cinfo, int pool_id, size_t sizeofobject)
   small_pool_ptr hdr_ptr, prev_hdr_ptr;
   char * data_ptr;
   size_t odd_bytes, min_request, slop;
+  boolean app_mem;
 
   /* Check for unsatisfiable request (do now to ensure no overflow below) */
   if (sizeofobject > (size_t) (MAX_ALLOC_CHUNK-SIZEOF(small_pool_hdr)))
@@ -284,6 +356,27 @@ alloc_small (j_common_ptr cinfo, int pool_id, size_t sizeofobject)
     hdr_ptr = hdr_ptr->hdr.next;
   }
 
+  /* If not, a spare pool kept from an earlier image may do */
+  if (hdr_ptr == NULL) {
+    small_pool_ptr * spare_link = & mem->spare_small_list;
+
+    while (*spare_link != NULL) {
+      if ((*spare_link)->hdr.bytes_left >= sizeofobject) {
+	hdr_ptr = *spare_link;
+	*spare_link = hdr_ptr->hdr.next;
+	mem->total_space_allocated += hdr_ptr->hdr.bytes_left +
+				      SIZEOF(small_pool_hdr);
+	hdr_ptr->hdr.next = NULL;
+	if (prev_hdr_ptr == NULL)	/* first pool in class? */
+	  mem->small_list[pool_id] = hdr_ptr;
+	else
+	  prev_hdr_ptr->hdr.next = hdr_ptr;
+	break;
+      }
+      spare_link = & (*spare_link)->hdr.next;
+    }
+  }
+
   /* Time to make a new pool? */
   if (hdr_ptr == NULL) {
     /* min_request is what we need now, slop is what will be leftover */
@@ -297,7 +390,8 @@ alloc_small (j_common_ptr cinfo, int pool_id, size_t sizeofobject)
       slop = (size_t) (MAX_ALLOC_CHUNK-min_request);
     /* Try to get space, if fail reduce slop and try again */
     for (;;) {
-      hdr_ptr = (small_pool_ptr) jpeg_get_small(cinfo, min_request + slop);
+      hdr_ptr = (small_pool_ptr)
+	get_pool_mem(cinfo, min_request + slop, FALSE, &app_mem);
       if (hdr_ptr != NULL)
 	break;
       slop /= 2;
@@ -309,6 +403,7 @@ alloc_small (j_common_ptr cinfo, int pool_id, size_t sizeofobject)
     hdr_ptr->hdr.next = NULL;
     hdr_ptr->hdr.bytes_used = 0;
     hdr_ptr->hdr.bytes_left = sizeofobject + slop;
+    hdr_ptr->hdr.app_mem = app_mem;
     if (prev_hdr_ptr == NULL)	/* first pool in class? */
       mem->small_list[pool_id] = hdr_ptr;
     else
@@ -333,7 +428,8 @@ alloc_small (j_common_ptr cinfo, int pool_id, size_t sizeofobject)
  * management heuristics are quite different.  We assume that each
  * request is large enough that it may as well be passed directly to
  * jpeg_get_large; the pool management just links everything together
- * so that we can free it all on demand.
+ * so that we can free it all on demand.  The data area of each large pool
+ * is aligned to LARGE_POOL_ALIGN bytes.
  * Note: the major use of "large" objects is in JSAMPARRAY and JBLOCKARRAY
  * structures.  The routines that create these structures (see below)
  * deliberately bunch rows together to ensure a large request size.
@@ -345,10 +441,14 @@ alloc_large (j_common_ptr cinfo, int pool_id, size_t sizeofobject)
 {
   my_mem_ptr mem = (my_mem_ptr) cinfo->mem;
   large_pool_ptr hdr_ptr;
-  size_t odd_bytes;
+  large_pool_ptr * spare_link;
+  large_pool_ptr * best_link;
+  char FAR * raw_ptr;
+  size_t odd_bytes, skip;
+  boolean app_mem;
 
   /* Check for unsatisfiable request (do now to ensure no overflow below) */
-  if (sizeofobject > (size_t) (MAX_ALLOC_CHUNK-SIZEOF(large_pool_hdr)))
+  if (sizeofobject > (size_t) (MAX_ALLOC_CHUNK-LARGE_POOL_OVERHEAD))
     out_of_memory(cinfo, 3);	/* request exceeds malloc's ability */
 
   /* Round up the requested size to a multiple of SIZEOF(ALIGN_TYPE) */
@@ -360,11 +460,37 @@ alloc_large (j_common_ptr cinfo, int pool_id, size_t sizeofobject)
   if (pool_id < 0 || pool_id >= JPOOL_NUMPOOLS)
     ERREXIT1(cinfo, JERR_BAD_POOL_ID, pool_id);	/* safety check */
 
-  hdr_ptr = (large_pool_ptr) jpeg_get_large(cinfo, sizeofobject +
-					    SIZEOF(large_pool_hdr));
-  if (hdr_ptr == NULL)
-    out_of_memory(cinfo, 4);	/* jpeg_get_large failed */
-  mem->total_space_allocated += sizeofobject + SIZEOF(large_pool_hdr);
+  /* Reuse the smallest spare pool that will hold the object, if any */
+  best_link = NULL;
+  for (spare_link = & mem->spare_large_list; *spare_link != NULL;
+       spare_link = & (*spare_link)->hdr.next) {
+    if ((*spare_link)->hdr.bytes_left >= sizeofobject &&
+	(best_link == NULL ||
+	 (*spare_link)->hdr.bytes_left < (*best_link)->hdr.bytes_left))
+      best_link = spare_link;
+  }
+  if (best_link != NULL) {
+    hdr_ptr = *best_link;
+    *best_link = hdr_ptr->hdr.next;
+  } else {
+    raw_ptr = (char FAR *) get_pool_mem(cinfo, sizeofobject +
+					LARGE_POOL_OVERHEAD, TRUE, &app_mem);
+    if (raw_ptr == NULL)
+      out_of_memory(cinfo, 4);	/* jpeg_get_large failed */
+    skip = 0;
+#ifndef NEED_FAR_POINTERS
+    skip = (size_t) (raw_ptr + SIZEOF(large_pool_hdr)) % LARGE_POOL_ALIGN;
+    if (skip > 0)
+      skip = LARGE_POOL_ALIGN - skip;
+#endif
+    hdr_ptr = (large_pool_ptr) (raw_ptr + skip);
+    hdr_ptr->hdr.bytes_skipped = skip;
+    hdr_ptr->hdr.bytes_left = sizeofobject + LARGE_POOL_PAD - skip;
+    hdr_ptr->hdr.app_mem = app_mem;
+  }
+  mem->total_space_allocated += hdr_ptr->hdr.bytes_left +
+				SIZEOF(large_pool_hdr) +
+				hdr_ptr->hdr.bytes_skipped;
 
   /* Success, initialize the new pool header and add to list */
   hdr_ptr->hdr.next = mem->large_list[pool_id];
@@ -372,7 +498,7 @@ alloc_large (j_common_ptr cinfo, int pool_id, size_t sizeofobject)
    * even though they are not needed for allocation.
    */
   hdr_ptr->hdr.bytes_used = sizeofobject;
-  hdr_ptr->hdr.bytes_left = 0;
+  hdr_ptr->hdr.bytes_left -= sizeofobject;
   mem->large_list[pool_id] = hdr_ptr;
 
   return (void FAR *) (hdr_ptr + 1); /* point to first data byte in pool */
@@ -404,7 +530,7 @@ alloc_sarray (j_common_ptr cinfo, int pool_id,
   long ltemp;
 
   /* Calculate max # of rows allowed in one allocation chunk */
-  ltemp = (MAX_ALLOC_CHUNK-SIZEOF(large_pool_hdr)) /
+  ltemp = (MAX_ALLOC_CHUNK-LARGE_POOL_OVERHEAD) /
 	  ((long) samplesperrow * SIZEOF(JSAMPLE));
   if (ltemp <= 0)
     ERREXIT(cinfo, JERR_WIDTH_OVERFLOW);
@@ -452,7 +578,7 @@ alloc_barray (j_common_ptr cinfo, int pool_id,
   long ltemp;
 
   /* Calculate max # of rows allowed in one allocation chunk */
-  ltemp = (MAX_ALLOC_CHUNK-SIZEOF(large_pool_hdr)) /
+  ltemp = (MAX_ALLOC_CHUNK-LARGE_POOL_OVERHEAD) /
 	  ((long) blocksperrow * SIZEOF(JBLOCK));
   if (ltemp <= 0)
     ERREXIT(cinfo, JERR_WIDTH_OVERFLOW);
@@ -923,6 +1049,52 @@ access_virt_barray (j_common_ptr cinfo, jvirt_barray_ptr ptr,
 }
 
 
+LOCAL(void)
+reverse_block_rows (JBLOCKARRAY rows, JDIMENSION num_rows)
+/* Reverse the order of num_rows row pointers in place */
+{
+  JBLOCKROW temp;
+  JDIMENSION lo, hi;
+
+  for (lo = 0, hi = num_rows; lo + 1 < hi; lo++) {
+    hi--;
+    temp = rows[lo];
+    rows[lo] = rows[hi];
+    rows[hi] = temp;
+  }
+}
+
+
+METHODDEF(boolean)
+rotate_virt_barray (j_common_ptr cinfo, jvirt_barray_ptr ptr,
+		    JDIMENSION start_row, JDIMENSION num_rows,
+		    JDIMENSION shift)
+/* Rotate rows start_row .. start_row+num_rows-1 of a virtual block array */
+/* upward by shift rows; the first shift rows wrap around to the bottom. */
+/* Only the row pointers are exchanged, so this is possible only when the */
+/* whole array is held in memory.  Returns FALSE (and does nothing) if it */
+/* is not; the caller must then move the block data itself. */
+{
+  JBLOCKARRAY rows;
+
+  /* debugging check */
+  if (start_row + num_rows > ptr->rows_in_array || shift > num_rows ||
+      ptr->mem_buffer == NULL)
+    ERREXIT(cinfo, JERR_BAD_VIRTUAL_ACCESS);
+
+  if (ptr->b_s_open || ptr->rows_in_mem < ptr->rows_in_array ||
+      ptr->first_undef_row < start_row + num_rows)
+    return FALSE;
+
+  /* Rotate by three reversals; needs no workspace */
+  rows = ptr->mem_buffer + start_row;
+  reverse_block_rows(rows, shift);
+  reverse_block_rows(rows + shift, num_rows - shift);
+  reverse_block_rows(rows, num_rows);
+  return TRUE;
+}
+
+
 /*
  * Release all objects belonging to a specified pool.
  */
@@ -964,7 +1136,7 @@ free_pool (j_common_ptr cinfo, int pool_id)
     mem->virt_barray_list = NULL;
   }
 
-  /* Release large objects */
+  /* Release large objects, or keep them as spares */
   lhdr_ptr = mem->large_list[pool_id];
   mem->large_list[pool_id] = NULL;
 
@@ -972,13 +1144,22 @@ free_pool (j_common_ptr cinfo, int pool_id)
     large_pool_ptr next_lhdr_ptr = lhdr_ptr->hdr.next;
     space_freed = lhdr_ptr->hdr.bytes_used +
 		  lhdr_ptr->hdr.bytes_left +
-		  SIZEOF(large_pool_hdr);
-    jpeg_free_large(cinfo, (void FAR *) lhdr_ptr, space_freed);
+		  SIZEOF(large_pool_hdr) +
+		  lhdr_ptr->hdr.bytes_skipped;
+    if (pool_id == JPOOL_IMAGE && mem->pub.keep_image_pool) {
+      lhdr_ptr->hdr.bytes_left += lhdr_ptr->hdr.bytes_used;
+      lhdr_ptr->hdr.bytes_used = 0;
+      lhdr_ptr->hdr.next = mem->spare_large_list;
+      mem->spare_large_list = lhdr_ptr;
+    } else
+      free_pool_mem(cinfo, (void FAR *) ((char FAR *) lhdr_ptr -
+					 lhdr_ptr->hdr.bytes_skipped),
+		    space_freed, TRUE, lhdr_ptr->hdr.app_mem);
     mem->total_space_allocated -= space_freed;
     lhdr_ptr = next_lhdr_ptr;
   }
 
-  /* Release small objects */
+  /* Release small objects, or keep them as spares */
   shdr_ptr = mem->small_list[pool_id];
   mem->small_list[pool_id] = NULL;
 
@@ -987,7 +1168,14 @@ free_pool (j_common_ptr cinfo, int pool_id)
     space_freed = shdr_ptr->hdr.bytes_used +
 		  shdr_ptr->hdr.bytes_left +
 		  SIZEOF(small_pool_hdr);
-    jpeg_free_small(cinfo, (void *) shdr_ptr, space_freed);
+    if (pool_id == JPOOL_IMAGE && mem->pub.keep_image_pool) {
+      shdr_ptr->hdr.bytes_left += shdr_ptr->hdr.bytes_used;
+      shdr_ptr->hdr.bytes_used = 0;
+      shdr_ptr->hdr.next = mem->spare_small_list;
+      mem->spare_small_list = shdr_ptr;
+    } else
+      free_pool_mem(cinfo, (void FAR *) shdr_ptr, space_freed,
+		    FALSE, shdr_ptr->hdr.app_mem);
     mem->total_space_allocated -= space_freed;
     shdr_ptr = next_shdr_ptr;
   }
@@ -1002,16 +1190,35 @@ free_pool (j_common_ptr cinfo, int pool_id)
 METHODDEF(void)
 self_destruct (j_common_ptr cinfo)
 {
+  my_mem_ptr mem = (my_mem_ptr) cinfo->mem;
+  small_pool_ptr shdr_ptr;
+  large_pool_ptr lhdr_ptr;
   int pool;
 
   /* Close all backing store, release all memory.
    * Releasing pools in reverse order might help avoid fragmentation
    * with some (brain-damaged) malloc libraries.
    */
+  mem->pub.keep_image_pool = FALSE;
   for (pool = JPOOL_NUMPOOLS-1; pool >= JPOOL_PERMANENT; pool--) {
     free_pool(cinfo, pool);
   }
 
+  /* Release the spare pools */
+  while ((lhdr_ptr = mem->spare_large_list) != NULL) {
+    mem->spare_large_list = lhdr_ptr->hdr.next;
+    free_pool_mem(cinfo, (void FAR *) ((char FAR *) lhdr_ptr -
+				       lhdr_ptr->hdr.bytes_skipped),
+		  lhdr_ptr->hdr.bytes_left + SIZEOF(large_pool_hdr) +
+		  lhdr_ptr->hdr.bytes_skipped, TRUE, lhdr_ptr->hdr.app_mem);
+  }
+  while ((shdr_ptr = mem->spare_small_list) != NULL) {
+    mem->spare_small_list = shdr_ptr->hdr.next;
+    free_pool_mem(cinfo, (void FAR *) shdr_ptr,
+		  shdr_ptr->hdr.bytes_left + SIZEOF(small_pool_hdr),
+		  FALSE, shdr_ptr->hdr.app_mem);
+  }
+
   /* Release the memory manager control block too. */
   jpeg_free_small(cinfo, (void *) cinfo->mem, SIZEOF(my_memory_mgr));
   cinfo->mem = NULL;		/* ensures I will be called only once */
@@ -1044,6 +1251,12 @@ jinit_memory_mgr (j_common_ptr cinfo)
    */
   if ((SIZEOF(ALIGN_TYPE) & (SIZEOF(ALIGN_TYPE)-1)) != 0)
     ERREXIT(cinfo, JERR_BAD_ALIGN_TYPE);
+  /* Likewise LARGE_POOL_ALIGN must be a power of 2, and a multiple of
+   * SIZEOF(ALIGN_TYPE).
+   */
+  if ((LARGE_POOL_ALIGN & (LARGE_POOL_ALIGN-1)) != 0 ||
+      (LARGE_POOL_ALIGN % SIZEOF(ALIGN_TYPE)) != 0)
+    ERREXIT(cinfo, JERR_BAD_ALIGN_TYPE);
   /* MAX_ALLOC_CHUNK must be representable as type size_t, and must be
    * a multiple of SIZEOF(ALIGN_TYPE).
    * Again, an "unreachable code" warning may be ignored here.
@@ -1074,12 +1287,18 @@ jinit_memory_mgr (j_common_ptr cinfo)
   mem->pub.realize_virt_arrays = realize_virt_arrays;
   mem->pub.access_virt_sarray = access_virt_sarray;
   mem->pub.access_virt_barray = access_virt_barray;
+  mem->pub.rotate_virt_barray = rotate_virt_barray;
   mem->pub.free_pool = free_pool;
   mem->pub.self_destruct = self_destruct;
 
   /* Make MAX_ALLOC_CHUNK accessible to other modules */
   mem->pub.max_alloc_chunk = MAX_ALLOC_CHUNK;
 
+  /* No allocator hooks unless the application installs them */
+  mem->pub.get_mem = NULL;
+  mem->pub.free_mem = NULL;
+  mem->pub.keep_image_pool = FALSE;
+
   /* Initialize working state */
   mem->pub.max_memory_to_use = max_to_use;
 
@@ -1089,6 +1308,8 @@ jinit_memory_mgr (j_common_ptr cinfo)
   }
   mem->virt_sarray_list = NULL;
   mem->virt_barray_list = NULL;
+  mem->spare_small_list = NULL;
+  mem->spare_large_list = NULL;
 
   mem->total_space_allocated = SIZEOF(my_memory_mgr);
 
@@ -346,6 +346,7 @@ typedef enum { FALSE = 0, TRUE = 1 } boolean;
 #define DCT_ISLOW_SUPPORTED	/* slow but accurate integer algorithm */
 #define DCT_IFAST_SUPPORTED	/* faster, less accurate integer method */
 #define DCT_FLOAT_SUPPORTED	/* floating-point: accurate, fast on fast HW */
+#define SIMD_SUPPORTED		/* vector code where the compiler targets SSE2 */
 
 /* Encoder capability options: */
 
@@ -47,6 +47,11 @@ struct jpeg_comp_master {
   JMETHOD(void, prepare_for_pass, (j_compress_ptr cinfo));
   JMETHOD(void, pass_startup, (j_compress_ptr cinfo));
   JMETHOD(void, finish_pass, (j_compress_ptr cinfo));
+  /* Called after each iMCU row of entropy-coded data, if not NULL.
+   * A streaming destination manager (jpeg_callback_dest) sets this in its
+   * init_destination, so as to pass data on before the buffer fills up.
+   */
+  JMETHOD(void, iMCU_row_done, (j_compress_ptr cinfo));
 
   /* State variables made visible to other modules */
   boolean call_pass_startup;	/* True if pass_startup must be called */
@@ -213,6 +218,10 @@ struct jpeg_entropy_decoder {
   JMETHOD(void, start_pass, (j_decompress_ptr cinfo));
   JMETHOD(boolean, decode_mcu, (j_decompress_ptr cinfo, JBLOCKROW *MCU_data));
   JMETHOD(void, finish_pass, (j_decompress_ptr cinfo));
+  /* Zigzag index of the last coefficient stored in each block of the MCU
+   * by decode_mcu, or DCTSIZE2-1 if the decoder does not keep track.
+   */
+  int block_last[D_MAX_BLOCKS_IN_MCU];
 };
 
 /* Inverse DCT (also performs dequantization) */
@@ -225,8 +234,16 @@ struct jpeg_inverse_dct {
   JMETHOD(void, start_pass, (j_decompress_ptr cinfo));
   /* It is useful to allow each component to have a separate IDCT method. */
   inverse_DCT_method_ptr inverse_DCT[MAX_COMPONENTS];
+  /* Equivalent faster methods for sparse blocks, or NULL if there are none:
+   * for blocks with only a DC coefficient, and for blocks whose coefficients
+   * are all within the first IDCT_LOW_LAST+1 in zigzag order.
+   */
+  inverse_DCT_method_ptr inverse_DCT_dc[MAX_COMPONENTS];
+  inverse_DCT_method_ptr inverse_DCT_low[MAX_COMPONENTS];
 };
 
+#define IDCT_LOW_LAST  9	/* zigzag indexes 0..9 lie in the upper left 4x4 */
+
 /* Upsampling (note that upsampler must also call color converter) */
 struct jpeg_upsampler {
   JMETHOD(void, start_pass, (j_decompress_ptr cinfo));
@@ -324,6 +341,7 @@ struct jpeg_color_quantizer {
 #define jzero_far		jZeroFar
 #define jcopy_sample_rows	jCopySamples
 #define jcopy_block_row		jCopyBlocks
+#define jsimd_flags		jSIMDFlags
 #define jpeg_zigzag_order	jZIGTable
 #define jpeg_natural_order	jZAGTable
 #define jpeg_natural_order7	jZAG7Table
@@ -333,6 +351,11 @@ struct jpeg_color_quantizer {
 #define jpeg_natural_order3	jZAG3Table
 #define jpeg_natural_order2	jZAG2Table
 #define jpeg_aritab		jAriTab
+#define jpeg_range_limit_table	jRangeLimit
+#define jpeg_cr_r_tab		jCrRTab
+#define jpeg_cb_b_tab		jCbBTab
+#define jpeg_cr_g_tab		jCrGTab
+#define jpeg_cb_g_tab		jCbGTab
 #endif /* NEED_SHORT_EXTERNAL_NAMES */
 
 
@@ -401,6 +424,7 @@ EXTERN(void) jcopy_sample_rows JPP((JSAMPARRAY input_array, int source_row,
 				    int num_rows, JDIMENSION num_cols));
 EXTERN(void) jcopy_block_row JPP((JBLOCKROW input_row, JBLOCKROW output_row,
 				  JDIMENSION num_blocks));
+EXTERN(int) jsimd_flags JPP((void));
 /* Constant tables in jutils.c */
 #if 0				/* This table is not actually needed in v6a */
 extern const int jpeg_zigzag_order[]; /* natural coef order to zigzag order */
@@ -416,6 +440,67 @@ extern const int jpeg_natural_order2[]; /* zz to natural order for 2x2 block */
 /* Arithmetic coding probability estimation tables in jaricom.c */
 extern const INT32 jpeg_aritab[];
 
+/* Sample range limit table in jdmaster.c (see there for the layout) */
+extern const JSAMPLE jpeg_range_limit_table[];
+
+/* YCbCr->RGB conversion tables in jdcolor.c, shared with jdmerge.c */
+extern const int jpeg_cr_r_tab[];	/* Cr=>R values, rounded */
+extern const int jpeg_cb_b_tab[];	/* Cb=>B values, rounded */
+extern const INT32 jpeg_cr_g_tab[];	/* Cr=>G values, scaled up */
+extern const INT32 jpeg_cb_g_tab[];	/* Cb=>G values, scaled up, + ONE_HALF */
+
+/* Generators for constant tables indexed by sample value.
+ * JSAMPLE_TABLE(m,i) expands to the MAXJSAMPLE+1 initializers
+ * m(i), m(i+1), ..., and JSAMPLE_HALF_TABLE(m,i) to the first
+ * CENTERJSAMPLE of them.  m must produce a constant expression.
+ */
+
+#define JTABLE_4(m,i)	m(i), m((i)+1), m((i)+2), m((i)+3)
+#define JTABLE_16(m,i)	JTABLE_4(m,i), JTABLE_4(m,(i)+4), \
+			JTABLE_4(m,(i)+8), JTABLE_4(m,(i)+12)
+#define JTABLE_64(m,i)	JTABLE_16(m,i), JTABLE_16(m,(i)+16), \
+			JTABLE_16(m,(i)+32), JTABLE_16(m,(i)+48)
+#define JTABLE_128(m,i)	JTABLE_64(m,i), JTABLE_64(m,(i)+64)
+#define JTABLE_256(m,i)	JTABLE_128(m,i), JTABLE_128(m,(i)+128)
+#define JTABLE_512(m,i)	JTABLE_256(m,i), JTABLE_256(m,(i)+256)
+#define JTABLE_1024(m,i) JTABLE_512(m,i), JTABLE_512(m,(i)+512)
+#define JTABLE_2048(m,i) JTABLE_1024(m,i), JTABLE_1024(m,(i)+1024)
+#define JTABLE_4096(m,i) JTABLE_2048(m,i), JTABLE_2048(m,(i)+2048)
+
+#if BITS_IN_JSAMPLE == 8
+#define JSAMPLE_TABLE(m,i)	JTABLE_256(m,i)
+#define JSAMPLE_HALF_TABLE(m,i)	JTABLE_128(m,i)
+#endif
+#if BITS_IN_JSAMPLE == 9
+#define JSAMPLE_TABLE(m,i)	JTABLE_512(m,i)
+#define JSAMPLE_HALF_TABLE(m,i)	JTABLE_256(m,i)
+#endif
+#if BITS_IN_JSAMPLE == 10
+#define JSAMPLE_TABLE(m,i)	JTABLE_1024(m,i)
+#define JSAMPLE_HALF_TABLE(m,i)	JTABLE_512(m,i)
+#endif
+#if BITS_IN_JSAMPLE == 11
+#define JSAMPLE_TABLE(m,i)	JTABLE_2048(m,i)
+#define JSAMPLE_HALF_TABLE(m,i)	JTABLE_1024(m,i)
+#endif
+#if BITS_IN_JSAMPLE == 12
+#define JSAMPLE_TABLE(m,i)	JTABLE_4096(m,i)
+#define JSAMPLE_HALF_TABLE(m,i)	JTABLE_2048(m,i)
+#endif
+
+/* SIMD code is compiled in where the compiler targets a suitable
+ * instruction set, and used unless jsimd_flags() reports it disabled.
+ */
+
+#ifdef SIMD_SUPPORTED
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define JSIMD_SSE2
+#endif
+#endif
+
+#define JSIMD_FLAG_SSE2		0x01	/* jsimd_flags() bits */
+
 /* Suppress undefined-structure complaints if necessary. */
 
 #ifdef INCOMPLETE_TYPES_BROKEN
@@ -778,6 +778,12 @@ struct jpeg_destination_mgr {
   JMETHOD(void, term_destination, (j_compress_ptr cinfo));
 };
 
+/* Application routine receiving output of jpeg_callback_dest.
+ * Returns FALSE to signal a write error.
+ */
+typedef JMETHOD(boolean, jpeg_output_callback,
+		(j_compress_ptr cinfo, const JOCTET * data, size_t datacount));
+
 
 /* Data source object for decompression */
 
@@ -859,6 +865,34 @@ struct jpeg_memory_mgr {
 
   /* Maximum allocation request accepted by alloc_large. */
   long max_alloc_chunk;
+
+  /* Optional allocator for the memory manager's pools.  If get_mem is not
+   * NULL, pools are obtained from it instead of from the system-dependent
+   * routines, and released through free_mem.  The storage returned must
+   * be aligned as malloc() would align it.  May be set by outer application
+   * after creating the JPEG object; the routines must remain valid until
+   * the object is destroyed.
+   */
+  JMETHOD(void FAR *, get_mem, (j_common_ptr cinfo, size_t sizeofobject));
+  JMETHOD(void, free_mem, (j_common_ptr cinfo, void FAR * object,
+			   size_t sizeofobject));
+
+  /* If TRUE, storage of the IMAGE pool is kept when the pool is freed at
+   * the end of an image (jpeg_finish_compress/decompress, jpeg_abort) and
+   * reused for the next image; it is released when the object is
+   * destroyed.  Processing a series of same-sized images then gets no new
+   * storage after the first one.
+   */
+  boolean keep_image_pool;
+
+  /* Rotate block rows of a virtual array in place (see jmemmgr.c).
+   * Kept at the end so that the layout of the fields above is unchanged.
+   */
+  JMETHOD(boolean, rotate_virt_barray, (j_common_ptr cinfo,
+					 jvirt_barray_ptr ptr,
+					 JDIMENSION start_row,
+					 JDIMENSION num_rows,
+					 JDIMENSION shift));
 };
 
 
@@ -897,6 +931,7 @@ typedef JMETHOD(boolean, jpeg_marker_parser_method, (j_decompress_ptr cinfo));
 #define jpeg_stdio_src		jStdSrc
 #define jpeg_mem_dest		jMemDest
 #define jpeg_mem_src		jMemSrc
+#define jpeg_callback_dest	jCallbackDest
 #define jpeg_set_defaults	jSetDefaults
 #define jpeg_set_colorspace	jSetColorspace
 #define jpeg_default_colorspace	jDefColorspace
@@ -982,6 +1017,13 @@ EXTERN(void) jpeg_mem_src JPP((j_decompress_ptr cinfo,
 			      unsigned char * inbuffer,
 			      unsigned long insize));
 
+/* Data destination manager: application callback, flushed every
+ * flush_rows iMCU rows (0 = only when the buffer is full).
+ */
+EXTERN(void) jpeg_callback_dest JPP((j_compress_ptr cinfo,
+				    jpeg_output_callback callback,
+				    int flush_rows));
+
 /* Default parameter setup for compression */
 EXTERN(void) jpeg_set_defaults JPP((j_compress_ptr cinfo));
 /* Compression parameter setup aids */
@@ -82,32 +82,38 @@ int arraylist_add(struct arraylist *list, value_type value) {
 }
 
 
+/* Each command is a tuple "destX destY srcX srcY width height", optionally
+ * preceded by a source reference "@k" (atlas k) or "@-k" (frame N-k).
+ */
+#define CMD_FIELDS	7	/* destX destY srcX srcY width height ref */
+
 struct arraylist values(char *line)
 {
 	struct arraylist u;
+	int ref = 0;
+	int i;
 
-	char* token = strtok(line, " ");
+	char* token = strtok(line, " \t\r\n");
+	arraylist_initial(&u);
 	while (token) {
-		// srcX
-		arraylist_add(&u, atoi(token));
-		token = strtok(NULL, " ");
-		// srcY
-		arraylist_add(&u, atoi(token));
-		token = strtok(NULL, " ");
-		// destX
-		arraylist_add(&u, atoi(token));
-		token = strtok(NULL, " ");
-		// destY
-		arraylist_add(&u, atoi(token));
-		token = strtok(NULL, " ");
-		// width
-		arraylist_add(&u, atoi(token));
-		token = strtok(NULL, " ");
-		// height
-		arraylist_add(&u, atoi(token));
-
-		// next change set
-		token = strtok(NULL, " ");
+		if (*token == '@') {
+			// source reference for the next tuple
+			ref = atoi(token + 1);
+			token = strtok(NULL, " \t\r\n");
+			continue;
+		}
+		// destX destY srcX srcY width height
+		for (i = 0; i < 6 && token; i++) {
+			arraylist_add(&u, atoi(token));
+			token = strtok(NULL, " \t\r\n");
+		}
+		if (i < 6) {
+			// drop an incomplete tuple
+			u.size -= i;
+			break;
+		}
+		arraylist_add(&u, ref);
+		ref = 0;
 	}
 	return u;
 }
@@ -120,7 +126,7 @@ static JCOPY_OPTION copyoption;	/* -copy switch */
 static jpeg_transform_info transformoption; /* image transformation options */
 
 void do_crop(unsigned char *srcbuffer, long src_size, unsigned char **outbuffer, long *out_size, char *crop_spec);
-void do_drop1(unsigned char *srcbuffer, long src_size, unsigned char *dropbuffer, long drop_size, unsigned char **outbuffer, long *out_size, char *writefile, char *crop_spec);
+boolean do_drop1(unsigned char *srcbuffer, long src_size, unsigned char *dropbuffer, long drop_size, unsigned char **outbuffer, long *out_size, char *writefile, char *crop_spec);
 LOCAL(void)
 usage (void)
 /* complain about bad command line */
@@ -479,72 +485,774 @@ parse_switches (j_compress_ptr cinfo, int argc, char **argv,
 }
 
 static struct arraylist a;
+
+
+/*
+ * Drop source references.
+ * Besides the frame being updated (reference 0), a command may copy from
+ * one of the preceding frames (@-k is frame N-k) or from an atlas image
+ * named on the command line (@k is the k-th one).  References must have
+ * the frame's sampling factors and quantization tables.  A command whose
+ * reference is not available, or does not cover the requested rectangle,
+ * rejects its whole batch like any other bad command, so that no frame is
+ * written with a region missing.
+ * The decoded coefficient arrays of the most recently used references are
+ * kept in a small LRU cache; an evicted reference is decoded again from its
+ * JPEG data when it is next needed.
+ */
+
+#define MAX_HISTORY	8	/* frames kept for @-k references */
+#define REF_CACHE_SIZE	4	/* decoded references kept in memory */
+
+typedef struct {
+  unsigned char *data;		/* JPEG datastream */
+  long size;
+} frame_buffer;
+
+typedef struct {
+  boolean valid;
+  long key;			/* frame number, or -k for atlas k */
+  unsigned long last_use;	/* LRU clock value */
+  unsigned char *atlas_data;	/* JPEG data we own, if any */
+  struct jpeg_decompress_struct info;
+  struct jpeg_error_mgr jerr;
+  jvirt_barray_ptr * coef_arrays;
+} ref_cache_entry;
+
+static frame_buffer history[MAX_HISTORY]; /* indexed by frame # modulo size */
+static long frame_number;	/* number of the frame being updated */
+static char ** atlas_names;	/* atlas files, for @k references */
+static int num_atlases;
+static ref_cache_entry ref_cache[REF_CACHE_SIZE];
+static unsigned long ref_clock;
+
+/*
+ * Session mode.
+ * The quantization and Huffman tables never change within a session, so
+ * with -session they are sent once as a tables-only datastream ahead of the
+ * frames (as frame 0), and each frame is written as an abbreviated image
+ * without tables or copied extra markers.  Our own decoders likewise load
+ * the tables once through jpeg_read_header(..., FALSE) before reading a frame.
+ */
+
+static boolean session_mode;	/* write abbreviated frames */
+static unsigned char * session_tables; /* tables-only datastream */
+static unsigned long session_tables_size;
+
+
+LOCAL(unsigned char *)
+read_jpeg_file (const char * filename, long * size)
+/* Read a whole file into a malloc'd buffer */
+{
+  FILE * f;
+  unsigned char * buffer;
+
+  if ((f = fopen(filename, READ_BINARY)) == NULL) {
+    fprintf(stderr, "%s: can't open %s\n", progname, filename);
+    exit(EXIT_FAILURE);
+  }
+  fseek(f, 0, SEEK_END);
+  *size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  buffer = (unsigned char *) malloc(*size + 1);
+  if (buffer == NULL || fread(buffer, 1, *size, f) != (size_t) *size) {
+    fprintf(stderr, "%s: can't read %s\n", progname, filename);
+    exit(EXIT_FAILURE);
+  }
+  fclose(f);
+  return buffer;
+}
+
+
+LOCAL(void)
+read_frame_header (j_decompress_ptr cinfo, unsigned char * data, long size)
+/* Set up to read a frame, which may be an abbreviated image */
+{
+  if (session_tables != NULL) {
+    jpeg_mem_src(cinfo, session_tables, session_tables_size);
+    (void) jpeg_read_header(cinfo, FALSE);
+  }
+  jpeg_mem_src(cinfo, data, size);
+  (void) jpeg_read_header(cinfo, TRUE);
+}
+
+
+LOCAL(void)
+make_session_tables (frame_buffer * frame)
+/* Build the tables-only datastream that all frames of the session share */
+{
+  struct jpeg_decompress_struct srcinfo;
+  struct jpeg_compress_struct dstinfo;
+  struct jpeg_error_mgr jsrcerr, jdsterr;
+
+  srcinfo.err = jpeg_std_error(&jsrcerr);
+  jpeg_create_decompress(&srcinfo);
+  dstinfo.err = jpeg_std_error(&jdsterr);
+  jpeg_create_compress(&dstinfo);
+
+  jpeg_mem_src(&srcinfo, frame->data, frame->size);
+  (void) jpeg_read_header(&srcinfo, TRUE);
+  /* Same tables as do_drop1 sets up for the frames */
+  jpeg_copy_critical_parameters(&srcinfo, &dstinfo);
+  jpeg_mem_dest(&dstinfo, &session_tables, &session_tables_size);
+  jpeg_write_tables(&dstinfo);
+
+  jpeg_destroy_compress(&dstinfo);
+  jpeg_destroy_decompress(&srcinfo);
+}
+
+
+LOCAL(void)
+release_reference (ref_cache_entry * entry)
+{
+  if (! entry->valid)
+    return;
+  jpeg_destroy_decompress(&entry->info);
+  free(entry->atlas_data);
+  entry->atlas_data = NULL;
+  entry->valid = FALSE;
+}
+
+
+LOCAL(void)
+forget_frame (long frame)
+/* Frame data is about to be freed; drop its decoded copy too */
+{
+  int i;
+
+  for (i = 0; i < REF_CACHE_SIZE; i++)
+    if (ref_cache[i].valid && ref_cache[i].key == frame)
+      release_reference(&ref_cache[i]);
+}
+
+
+LOCAL(boolean)
+reference_compatible (j_decompress_ptr srcinfo, j_decompress_ptr refinfo)
+/* Check that blocks of the reference can be dropped as is into the frame.
+ * Only needs the headers read: quantization tables are looked up by slot.
+ */
+{
+  int ci, k;
+  jpeg_component_info *srcptr, *refptr;
+  JQUANT_TBL *srcqtbl, *refqtbl;
+
+  if (refinfo->num_components > srcinfo->num_components ||
+      refinfo->min_DCT_h_scaled_size != srcinfo->min_DCT_h_scaled_size ||
+      refinfo->min_DCT_v_scaled_size != srcinfo->min_DCT_v_scaled_size)
+    return FALSE;
+  for (ci = 0; ci < refinfo->num_components; ci++) {
+    srcptr = srcinfo->comp_info + ci;
+    refptr = refinfo->comp_info + ci;
+    if (refptr->h_samp_factor != srcptr->h_samp_factor ||
+	refptr->v_samp_factor != srcptr->v_samp_factor)
+      return FALSE;
+    srcqtbl = srcinfo->quant_tbl_ptrs[srcptr->quant_tbl_no];
+    refqtbl = refinfo->quant_tbl_ptrs[refptr->quant_tbl_no];
+    if (srcqtbl == NULL || refqtbl == NULL)
+      return FALSE;
+    for (k = 0; k < DCTSIZE2; k++)
+      if (refqtbl->quantval[k] != srcqtbl->quantval[k])
+	return FALSE;
+  }
+  return TRUE;
+}
+
+
+LOCAL(ref_cache_entry *)
+get_reference (j_decompress_ptr srcinfo, int ref)
+/* Look up a reference, decoding it if it is not in the cache.
+ * Returns NULL if the reference does not exist or cannot be used.
+ */
+{
+  long key;
+  int i;
+  ref_cache_entry *entry, *victim;
+  unsigned char *data;
+  long size;
+
+  if (ref < 0) {
+    if (-ref >= MAX_HISTORY || frame_number + ref < 0)
+      return NULL;
+    key = frame_number + ref;
+  } else {
+    if (ref > num_atlases)
+      return NULL;
+    key = -ref;
+  }
+
+  victim = ref_cache;
+  for (i = 0; i < REF_CACHE_SIZE; i++) {
+    entry = ref_cache + i;
+    if (entry->valid && entry->key == key) {
+      entry->last_use = ++ref_clock;
+      return entry;
+    }
+    if (victim->valid && (! entry->valid ||
+			  entry->last_use < victim->last_use))
+      victim = entry;
+  }
+
+  /* Not cached: evict the least recently used entry and decode */
+  release_reference(victim);
+  if (key >= 0) {
+    data = history[key % MAX_HISTORY].data;
+    size = history[key % MAX_HISTORY].size;
+  } else {
+    data = victim->atlas_data = read_jpeg_file(atlas_names[ref - 1], &size);
+  }
+  victim->info.err = jpeg_std_error(&victim->jerr);
+  jpeg_create_decompress(&victim->info);
+  read_frame_header(&victim->info, data, size);
+  victim->coef_arrays = jpeg_read_coefficients(&victim->info);
+  victim->valid = TRUE;
+  victim->key = key;
+  victim->last_use = ++ref_clock;
+
+  if (! reference_compatible(srcinfo, &victim->info)) {
+    fprintf(stderr, "%s: reference @%d does not match the frame\n",
+	    progname, ref);
+    release_reference(victim);
+    return NULL;
+  }
+  return victim;
+}
+
+
+LOCAL(boolean)
+reference_covers (j_compress_ptr dstinfo, j_decompress_ptr refinfo,
+		  JDIMENSION x, JDIMENSION y, JDIMENSION w, JDIMENSION h)
+/* Does the reference hold the given rectangle (measured in iMCUs)? */
+{
+  int ci;
+  JDIMENSION cols, rows;
+  jpeg_component_info *compptr;
+
+  for (ci = 0; ci < refinfo->num_components; ci++) {
+    compptr = refinfo->comp_info + ci;
+    cols = (compptr->width_in_blocks + compptr->h_samp_factor - 1) /
+	   compptr->h_samp_factor * compptr->h_samp_factor;
+    rows = (compptr->height_in_blocks + compptr->v_samp_factor - 1) /
+	   compptr->v_samp_factor * compptr->v_samp_factor;
+    if ((x + w) * dstinfo->comp_info[ci].h_samp_factor > cols ||
+	(y + h) * dstinfo->comp_info[ci].v_samp_factor > rows)
+      return FALSE;
+  }
+  return TRUE;
+}
+
+
+LOCAL(boolean)
+move_off_grid (j_decompress_ptr srcinfo, j_compress_ptr dstinfo,
+	       int destX, int destY, int srcX, int srcY, int width, int height)
+/* Does a command need do_move, and can it have it? */
+{
+  int iMCU_width = srcinfo->max_h_samp_factor * srcinfo->min_DCT_h_scaled_size;
+  int iMCU_height = srcinfo->max_v_samp_factor * srcinfo->min_DCT_v_scaled_size;
+
+  if (srcinfo->min_DCT_h_scaled_size != DCTSIZE ||
+      srcinfo->min_DCT_v_scaled_size != DCTSIZE ||
+      srcinfo->data_precision != BITS_IN_JSAMPLE)
+    return FALSE;		/* keep rounding to the iMCU grid */
+  return destX % iMCU_width != 0 || destY % iMCU_height != 0 ||
+	 srcX % iMCU_width != 0 || srcY % iMCU_height != 0 ||
+	 (width % iMCU_width != 0 && destX + width < (int) dstinfo->jpeg_width) ||
+	 (height % iMCU_height != 0 && destY + height < (int) dstinfo->jpeg_height);
+}
+
+
+LOCAL(int)
+pattern_conversions (const char * pattern)
+/* Count the integer conversions (%d or %i, with optional flags, width and
+ * precision) in an output file name pattern, which is used as a printf
+ * format.  Returns -1 if it holds any other % sequence except "%%".
+ */
+{
+  int count = 0;
+
+  while (*pattern != '\0') {
+    if (*pattern++ != '%')
+      continue;
+    if (*pattern == '%') {
+      pattern++;
+      continue;
+    }
+    while (*pattern == '-' || *pattern == '+' || *pattern == ' ' ||
+	   *pattern == '#' || *pattern == '0')
+      pattern++;
+    while (*pattern >= '0' && *pattern <= '9')
+      pattern++;
+    if (*pattern == '.') {
+      pattern++;
+      while (*pattern >= '0' && *pattern <= '9')
+	pattern++;
+    }
+    if (*pattern != 'd' && *pattern != 'i')
+      return -1;
+    pattern++;
+    count++;
+  }
+  return count;
+}
+
+
+LOCAL(void)
+write_frame (const char * pattern, frame_buffer * frame)
+/* Write a frame; a printf-style pattern gets the frame number.
+ * The pattern was checked by pattern_conversions.
+ */
+{
+  char * filename;
+  size_t filename_size;
+  FILE * f;
+
+  filename_size = strlen(pattern) + 32;
+  filename = (char *) malloc(filename_size);
+  snprintf(filename, filename_size, pattern, (int) frame_number);
+  if ((f = fopen(filename, WRITE_BINARY)) == NULL) {
+    fprintf(stderr, "%s: can't open %s for writing\n", progname, filename);
+    exit(EXIT_FAILURE);
+  }
+  fwrite(frame->data, 1, frame->size, f);
+  fclose(f);
+  free(filename);
+}
+
+
+/*
+ * Streaming output.
+ * With "-" as output name, frames go to stdout while they are compressed,
+ * flushed after every iMCU row, so that a consumer can start decoding a
+ * frame before it is complete.  The data is also collected in memory, for
+ * later @-k references.  Nothing reaches stdout until all commands of the
+ * batch have been accepted, so a rejected batch leaves no partial frame.
+ */
+
+static boolean stream_output;	/* write frames to stdout as they are made */
+
+typedef struct {
+  unsigned char ** buffer;	/* frame data collected so far */
+  long * size;
+  long alloc;
+  boolean live;			/* pass data on to stdout yet? */
+} stream_sink;
+
+
+METHODDEF(boolean)
+stream_callback (j_compress_ptr cinfo, const JOCTET * data, size_t datacount)
+{
+  stream_sink * sink = (stream_sink *) cinfo->client_data;
+  unsigned char * newbuffer;
+
+  if (*sink->size + (long) datacount > sink->alloc) {
+    sink->alloc = (*sink->size + (long) datacount) * 2;
+    if ((newbuffer = (unsigned char *) realloc(*sink->buffer,
+					       sink->alloc)) == NULL)
+      return FALSE;
+    *sink->buffer = newbuffer;
+  }
+  memcpy(*sink->buffer + *sink->size, data, datacount);
+  *sink->size += (long) datacount;
+
+  if (sink->live) {
+    if (fwrite(data, 1, datacount, stdout) != datacount)
+      return FALSE;
+    fflush(stdout);
+  }
+  return TRUE;
+}
+
+
+LOCAL(boolean)
+stream_go_live (stream_sink * sink)
+/* Start passing data on; first send what was held back */
+{
+  sink->live = TRUE;
+  if (*sink->size > 0) {
+    if (fwrite(*sink->buffer, 1, *sink->size, stdout) != (size_t) *sink->size)
+      return FALSE;
+    fflush(stdout);
+  }
+  return TRUE;
+}
+
+
+/*
+ * Lossless mosaic.
+ * With -mosaic, tiles given in row-major order are joined into one image by
+ * placing their coefficient blocks, without decoding to pixels.  Column
+ * widths are taken from the first row and row heights from the first column;
+ * all but the last column and row must be a whole number of iMCUs.  Tiles
+ * must match the first one the same way drop references do.  Each tile is
+ * read and released in turn, so at most one tile is held besides the output.
+ */
+
+LOCAL(FILE *)
+open_tile (j_decompress_ptr cinfo, const char * name)
+{
+  FILE * fp;
+
+  if ((fp = fopen(name, READ_BINARY)) == NULL) {
+    fprintf(stderr, "%s: can't open %s\n", progname, name);
+    exit(EXIT_FAILURE);
+  }
+  jpeg_stdio_src(cinfo, fp);
+  (void) jpeg_read_header(cinfo, TRUE);
+  return fp;
+}
+
+
+LOCAL(void)
+do_mosaic (int cols, char * outname, char ** tiles, int num_tiles)
+{
+  struct jpeg_decompress_struct firstinfo, tileinfo;
+  struct jpeg_compress_struct dstinfo;
+  struct jpeg_error_mgr jfirsterr, jtileerr, jdsterr;
+  jvirt_barray_ptr * tile_coef_arrays;
+  jvirt_barray_ptr dst_coef_arrays[MAX_COMPONENTS];
+  JDIMENSION * col_x;		/* column edges in pixels */
+  JDIMENSION * row_y;		/* row edges in pixels */
+  JDIMENSION iMCU_width, iMCU_height, MCU_cols, MCU_rows;
+  int rows, t, c, r, ci;
+  FILE * fp;
+  FILE * outfile;
+  jpeg_component_info *compptr;
+
+  rows = cols > 0 ? num_tiles / cols : 0;
+  if (rows < 1 || rows * cols != num_tiles) {
+    fprintf(stderr, "%s: %d tiles do not fill %d columns\n",
+	    progname, num_tiles, cols);
+    exit(EXIT_FAILURE);
+  }
+  col_x = (JDIMENSION *) malloc((cols + 1) * sizeof(JDIMENSION));
+  row_y = (JDIMENSION *) malloc((rows + 1) * sizeof(JDIMENSION));
+  col_x[0] = row_y[0] = 0;
+
+  firstinfo.err = jpeg_std_error(&jfirsterr);
+  jpeg_create_decompress(&firstinfo);
+  tileinfo.err = jpeg_std_error(&jtileerr);
+  jpeg_create_decompress(&tileinfo);
+  dstinfo.err = jpeg_std_error(&jdsterr);
+  jpeg_create_compress(&dstinfo);
+
+  fp = open_tile(&firstinfo, tiles[0]);
+  fclose(fp);
+  iMCU_width = firstinfo.max_h_samp_factor * firstinfo.min_DCT_h_scaled_size;
+  iMCU_height = firstinfo.max_v_samp_factor * firstinfo.min_DCT_v_scaled_size;
+
+  /* First pass: lay out the grid from the headers */
+  for (t = 0; t < num_tiles; t++) {
+    c = t % cols;
+    r = t / cols;
+    fp = open_tile(&tileinfo, tiles[t]);
+    if (! reference_compatible(&firstinfo, &tileinfo)) {
+      fprintf(stderr, "%s: tile %s does not match %s\n",
+	      progname, tiles[t], tiles[0]);
+      exit(EXIT_FAILURE);
+    }
+    if (r == 0)
+      col_x[c + 1] = col_x[c] + tileinfo.image_width;
+    if (c == 0)
+      row_y[r + 1] = row_y[r] + tileinfo.image_height;
+    if (tileinfo.image_width != col_x[c + 1] - col_x[c] ||
+	tileinfo.image_height != row_y[r + 1] - row_y[r] ||
+	(c < cols - 1 && tileinfo.image_width % iMCU_width != 0) ||
+	(r < rows - 1 && tileinfo.image_height % iMCU_height != 0)) {
+      fprintf(stderr, "%s: tile %s does not fit the grid\n",
+	      progname, tiles[t]);
+      exit(EXIT_FAILURE);
+    }
+    jpeg_abort_decompress(&tileinfo);
+    fclose(fp);
+  }
+
+  /* Set up the destination and its coefficient arrays.  The arrays live
+   * on firstinfo, which stays open until the end, so that do_drop can
+   * reach them through their owner, as it does for the tile arrays.
+   */
+  jpeg_copy_critical_parameters(&firstinfo, &dstinfo);
+  dstinfo.image_width = dstinfo.jpeg_width = col_x[cols];
+  dstinfo.image_height = dstinfo.jpeg_height = row_y[rows];
+  MCU_cols = (col_x[cols] + iMCU_width - 1) / iMCU_width;
+  MCU_rows = (row_y[rows] + iMCU_height - 1) / iMCU_height;
+  for (ci = 0; ci < dstinfo.num_components; ci++) {
+    compptr = dstinfo.comp_info + ci;
+    dst_coef_arrays[ci] = (*firstinfo.mem->request_virt_barray)
+      ((j_common_ptr) &firstinfo, JPOOL_IMAGE, TRUE,
+       MCU_cols * (JDIMENSION) compptr->h_samp_factor,
+       MCU_rows * (JDIMENSION) compptr->v_samp_factor,
+       (JDIMENSION) compptr->v_samp_factor);
+  }
+  (*firstinfo.mem->realize_virt_arrays) ((j_common_ptr) &firstinfo);
+
+  /* Second pass: place each tile's blocks */
+  for (t = 0; t < num_tiles; t++) {
+    c = t % cols;
+    r = t / cols;
+    fp = open_tile(&tileinfo, tiles[t]);
+    tile_coef_arrays = jpeg_read_coefficients(&tileinfo);
+    do_drop(&firstinfo, &dstinfo, col_x[c] / iMCU_width, row_y[r] / iMCU_height,
+	    dst_coef_arrays, &tileinfo, tile_coef_arrays,
+	    (tileinfo.image_width + iMCU_width - 1) / iMCU_width,
+	    (tileinfo.image_height + iMCU_height - 1) / iMCU_height, 0, 0);
+    (void) jpeg_finish_decompress(&tileinfo);
+    fclose(fp);
+  }
+
+  /* Entropy-encode the result once */
+  if (strcmp(outname, "-") == 0)
+    outfile = write_stdout();
+  else if ((outfile = fopen(outname, WRITE_BINARY)) == NULL) {
+    fprintf(stderr, "%s: can't open %s for writing\n", progname, outname);
+    exit(EXIT_FAILURE);
+  }
+  jpeg_stdio_dest(&dstinfo, outfile);
+  jpeg_write_coefficients(&dstinfo, dst_coef_arrays);
+  jpeg_finish_compress(&dstinfo);
+  if (outfile != stdout)
+    fclose(outfile);
+
+  jpeg_destroy_compress(&dstinfo);
+  jpeg_destroy_decompress(&tileinfo);
+  jpeg_destroy_decompress(&firstinfo);
+  free(col_x);
+  free(row_y);
+}
+
+
+/*
+ * Lossless split, the inverse of the mosaic.
+ * With -split, the source coefficients are read once and cut into tiles of
+ * the given size, each written with its own compressor to a file named by a
+ * printf-style pattern that gets the tile row and column.  The tile size
+ * must be a whole number of iMCUs; tiles at the right and bottom edges get
+ * what remains of the image.
+ */
+
+LOCAL(void)
+do_split (JDIMENSION tile_width, JDIMENSION tile_height, char * pattern,
+	  char * inputname)
+{
+  struct jpeg_decompress_struct srcinfo;
+  struct jpeg_compress_struct dstinfo;
+  struct jpeg_error_mgr jsrcerr, jdsterr;
+  jvirt_barray_ptr * src_coef_arrays;
+  jvirt_barray_ptr dst_coef_arrays[MAX_COMPONENTS];
+  JDIMENSION iMCU_width, iMCU_height, x, y, width, height;
+  JDIMENSION MCU_cols, MCU_rows;
+  char * filename;
+  size_t filename_size;
+  int ci;
+  FILE * fp;
+  FILE * outfile;
+  jpeg_component_info *compptr;
+
+  srcinfo.err = jpeg_std_error(&jsrcerr);
+  jpeg_create_decompress(&srcinfo);
+  dstinfo.err = jpeg_std_error(&jdsterr);
+  jpeg_create_compress(&dstinfo);
+
+  if (pattern_conversions(pattern) != 2) {
+    fprintf(stderr, "%s: output pattern must hold two %%d conversions\n",
+	    progname);
+    exit(EXIT_FAILURE);
+  }
+
+  fp = open_tile(&srcinfo, inputname);
+  iMCU_width = srcinfo.max_h_samp_factor * srcinfo.min_DCT_h_scaled_size;
+  iMCU_height = srcinfo.max_v_samp_factor * srcinfo.min_DCT_v_scaled_size;
+  if (tile_width == 0 || tile_height == 0 ||
+      tile_width % iMCU_width != 0 || tile_height % iMCU_height != 0) {
+    fprintf(stderr, "%s: tile size must be a multiple of %ux%u\n",
+	    progname, iMCU_width, iMCU_height);
+    exit(EXIT_FAILURE);
+  }
+  src_coef_arrays = jpeg_read_coefficients(&srcinfo);
+  /* One set of arrays the size of the first (largest) tile, owned by
+   * srcinfo like the source arrays, serves every tile.
+   */
+  width = srcinfo.image_width < tile_width ? srcinfo.image_width : tile_width;
+  height = srcinfo.image_height < tile_height ? srcinfo.image_height :
+	   tile_height;
+  MCU_cols = (width + iMCU_width - 1) / iMCU_width;
+  MCU_rows = (height + iMCU_height - 1) / iMCU_height;
+  for (ci = 0; ci < srcinfo.num_components; ci++) {
+    compptr = srcinfo.comp_info + ci;
+    dst_coef_arrays[ci] = (*srcinfo.mem->request_virt_barray)
+      ((j_common_ptr) &srcinfo, JPOOL_IMAGE, FALSE,
+       MCU_cols * (JDIMENSION) compptr->h_samp_factor,
+       MCU_rows * (JDIMENSION) compptr->v_samp_factor,
+       (JDIMENSION) compptr->v_samp_factor);
+  }
+  (*srcinfo.mem->realize_virt_arrays) ((j_common_ptr) &srcinfo);
+  filename_size = strlen(pattern) + 64;
+  filename = (char *) malloc(filename_size);
+
+  for (y = 0; y < srcinfo.image_height; y += tile_height) {
+    for (x = 0; x < srcinfo.image_width; x += tile_width) {
+      width = srcinfo.image_width - x;
+      if (width > tile_width)
+	width = tile_width;
+      height = srcinfo.image_height - y;
+      if (height > tile_height)
+	height = tile_height;
+
+      /* Set up a compressor for the tile and copy its blocks over */
+      jpeg_copy_critical_parameters(&srcinfo, &dstinfo);
+      dstinfo.image_width = dstinfo.jpeg_width = width;
+      dstinfo.image_height = dstinfo.jpeg_height = height;
+      MCU_cols = (width + iMCU_width - 1) / iMCU_width;
+      MCU_rows = (height + iMCU_height - 1) / iMCU_height;
+      do_drop(&srcinfo, &dstinfo, 0, 0, dst_coef_arrays,
+	      &srcinfo, src_coef_arrays, MCU_cols, MCU_rows,
+	      x / iMCU_width, y / iMCU_height);
+
+      snprintf(filename, filename_size, pattern, (int) (y / tile_height),
+	       (int) (x / tile_width));
+      if ((outfile = fopen(filename, WRITE_BINARY)) == NULL) {
+	fprintf(stderr, "%s: can't open %s for writing\n", progname, filename);
+	exit(EXIT_FAILURE);
+      }
+      jpeg_stdio_dest(&dstinfo, outfile);
+      jpeg_write_coefficients(&dstinfo, dst_coef_arrays);
+      jpeg_finish_compress(&dstinfo);
+      fclose(outfile);
+    }
+  }
+
+  free(filename);
+  jpeg_destroy_compress(&dstinfo);
+  (void) jpeg_finish_decompress(&srcinfo);
+  jpeg_destroy_decompress(&srcinfo);
+  fclose(fp);
+}
+
+
 /*
  * The main program.
+ * Each line read from stdin is one batch of drop commands, which turns the
+ * current frame into the next one.
  */
+
 int
 main (int argc, char **argv)
 {
-  int number = 0;
-  int max;
-  unsigned char *drop_img = NULL;
-  long drop_size;
-  unsigned char *out_img = NULL;
+  unsigned char *out_img;
   long out_size;
-  unsigned char *src_img = NULL;
   char cropspec[100];
+  frame_buffer *frame;
+  char *line = NULL;
+  size_t size = 0;
+  char *outname;
+  int i, argn;
 
-  int *decoder;
+  progname = argv[0];
+  if (progname == NULL || progname[0] == 0)
+    progname = "jpegtran";		/* in case C library doesn't provide it */
 
-  FILE *f;
+  if (argc > 3 && strcmp(argv[1], "-mosaic") == 0) {
+    do_mosaic(atoi(argv[2]), argv[3], argv + 4, argc - 4);
+    return 0;
+  }
 
-  char *line = NULL;
-  size_t size;
-  getline(&line, &size, stdin);
-  puts(line);
-  a = values(line);
+  if (argc == 5 && strcmp(argv[1], "-split") == 0) {
+    unsigned int tile_width, tile_height;
+    char ch;
+
+    if (sscanf(argv[2], "%ux%u%c", &tile_width, &tile_height, &ch) != 2) {
+      fprintf(stderr, "%s: bad tile size %s\n", progname, argv[2]);
+      exit(EXIT_FAILURE);
+    }
+    do_split((JDIMENSION) tile_width, (JDIMENSION) tile_height,
+	     argv[3], argv[4]);
+    return 0;
+  }
 
-  puts("HERE");
-  decoder = a.data;
-  max = a.size;
+  argn = 1;
+  if (argc > 1 && strcmp(argv[1], "-session") == 0) {
+    session_mode = TRUE;
+    argn++;
+  }
+  if (argc < argn + 2) {
+    fprintf(stderr, "usage: %s [-session] inputfile outputfile [atlasfile ...] < commands\n",
+	    progname);
+    fprintf(stderr, "outputfile may be - to stream frames to stdout\n");
+    fprintf(stderr, "-session writes tables once, then abbreviated frames\n");
+    fprintf(stderr, "   or: %s -mosaic columns outputfile tile ...\n", progname);
+    fprintf(stderr, "   or: %s -split WxH outputpattern inputfile\n", progname);
+    exit(EXIT_FAILURE);
+  }
+  outname = argv[argn + 1];
+  stream_output = (strcmp(outname, "-") == 0);
+  if (! stream_output) {
+    i = pattern_conversions(outname);
+    if (i < 0 || i > 1) {
+      fprintf(stderr, "%s: outputfile may hold one %%d conversion only\n",
+	      progname);
+      exit(EXIT_FAILURE);
+    }
+    if (session_mode && i == 0) {
+      fprintf(stderr, "%s: -session needs - or a frame number pattern as outputfile\n",
+	      progname);
+      exit(EXIT_FAILURE);
+    }
+  }
+  atlas_names = argv + argn + 2;
+  num_atlases = argc - argn - 2;
 
   // read the image
-  f = fopen(argv[1], "rb");
-  fseek(f, 0, SEEK_END);
-  out_size = ftell(f);
-  fseek(f, 0, SEEK_SET);
+  frame_number = 0;
+  frame = &history[0];
+  frame->data = read_jpeg_file(argv[argn], &frame->size);
+
+  // send the session tables ahead of the frames, as frame 0
+  if (session_mode) {
+    frame_buffer tables;
+
+    make_session_tables(frame);
+    tables.data = session_tables;
+    tables.size = (long) session_tables_size;
+    if (stream_output) {
+      fwrite(tables.data, 1, tables.size, stdout);
+      fflush(stdout);
+    } else
+      write_frame(outname, &tables);
+  }
 
-  out_img = (unsigned char *)malloc(out_size + 1);
-  src_img = out_img;
-  fread(out_img, out_size, 1, f);
-  fclose(f);
+  while (getline(&line, &size, stdin) > 0) {
+	free(a.data);
+	a = values(line);
+	if (a.size == 0)
+		continue;
+
+	out_img = NULL;
+	out_size = 0;
+	sprintf(cropspec, "+%d+%d", a.data[0], a.data[1]);
+	if (! do_drop1(frame->data, frame->size, frame->data, frame->size,
+		       &out_img, &out_size, NULL, cropspec)) {
+		fprintf(stderr, "%s: bad command in frame %ld\n",
+			progname, frame_number + 1);
+		free(out_img);
+		continue;
+	}
 
-  while (number < max) {
-	unsigned char *temp_img = NULL;
-	long temp_size;
-
-	sprintf(cropspec, "+%d+%d", decoder[number], decoder[number+1]);
-	do_drop1(out_img, out_size, src_img, out_size, &temp_img, &temp_size, NULL, cropspec);
-	free(drop_img);
-	drop_img = NULL;
-	if (number > 5) free(out_img);
-	out_img = temp_img;
-	out_size = temp_size;
-	//printf("%dx%d+%d+%d\n", decoder[number+4], decoder[number+5], decoder[number+2], decoder[number+3]);
-	printf(cropspec);
-	//printf("\n");
-	number += 6; // width, height, srcX, srcY, destX, destY
-	//printf("Got here: %d %d", max, number);
-	break;
+	// the result becomes the current frame
+	frame_number++;
+	forget_frame(frame_number - MAX_HISTORY);
+	frame = &history[frame_number % MAX_HISTORY];
+	free(frame->data);
+	frame->data = out_img;
+	frame->size = out_size;
+	if (! stream_output)
+	  write_frame(outname, frame);
   }
 
-  f = fopen(argv[2], "wb");
-  // for (number = 0; number < out_size; number++) {
-  fwrite(out_img, 1, out_size, f);
-  // }
-	  fclose(f);
-  // free(drop_img);
-  free(out_img);
+  for (i = 0; i < REF_CACHE_SIZE; i++)
+	release_reference(&ref_cache[i]);
+  for (i = 0; i < MAX_HISTORY; i++)
+	free(history[i].data);
+  free(session_tables);
+  free(a.data);
+  free(line);
 
   return 0;
 }
@@ -653,7 +1361,7 @@ void do_crop(unsigned char *srcbuffer, long src_size, unsigned char **outbuffer,
 #endif
 }
 
-void do_drop1(unsigned char *srcbuffer, long src_size, unsigned char *dropbuffer, long drop_size, unsigned char **outbuffer, long *out_size, char *writefile, char *crop_spec)
+boolean do_drop1(unsigned char *srcbuffer, long src_size, unsigned char *dropbuffer, long drop_size, unsigned char **outbuffer, long *out_size, char *writefile, char *crop_spec)
 {
   struct jpeg_decompress_struct srcinfo;
   struct jpeg_error_mgr jsrcerr;
@@ -669,8 +1377,10 @@ void do_drop1(unsigned char *srcbuffer, long src_size, unsigned char *dropbuffer
   jvirt_barray_ptr * dst_coef_arrays;
   int file_index;
   int crop1, crop2;
+  boolean result = FALSE;
 
   FILE * fp;
+  stream_sink sink;
 
   /* Initialize the JPEG decompression object with default error handling. */
   srcinfo.err = jpeg_std_error(&jsrcerr);
@@ -698,23 +1408,19 @@ void do_drop1(unsigned char *srcbuffer, long src_size, unsigned char *dropbuffer
   dropinfo.err = jpeg_std_error(&jdroperr);
   jpeg_create_decompress(&dropinfo);
   //jpeg_stdio_src(&dropinfo, drop_file);
-  jpeg_mem_src(&dropinfo, dropbuffer, drop_size);
 
 #ifdef PROGRESS_REPORT
   start_progress_monitor((j_common_ptr) &dstinfo, &progress);
 #endif
 
-  /* Specify data source for decompression */
-  //jpeg_stdio_src(&srcinfo, fp);
-  jpeg_mem_src(&srcinfo, srcbuffer, src_size);
-
   /* Enable saving of extra markers that we want to copy */
   jcopy_markers_setup(&srcinfo, copyoption);
 
-  /* Read file header */
-  (void) jpeg_read_header(&srcinfo, TRUE);
+  /* Specify data source for decompression and read file header */
+  //jpeg_stdio_src(&srcinfo, fp);
+  read_frame_header(&srcinfo, srcbuffer, src_size);
 
-  (void) jpeg_read_header(&dropinfo, TRUE);
+  read_frame_header(&dropinfo, dropbuffer, drop_size);
   transformoption.crop_width = 64;
   transformoption.crop_width_set = JCROP_POS;
   transformoption.crop_height = 64;
@@ -768,6 +1474,13 @@ void do_drop1(unsigned char *srcbuffer, long src_size, unsigned char *dropbuffer
 
   if (writefile != NULL) {
 	 jpeg_stdio_dest(&dstinfo, fp);
+  } else if (stream_output) {
+    sink.buffer = outbuffer;
+    sink.size = out_size;
+    sink.alloc = 0;
+    sink.live = FALSE;
+    dstinfo.client_data = (void *) &sink;
+    jpeg_callback_dest(&dstinfo, stream_callback, 1);
   } else {
     jpeg_mem_dest(&dstinfo, outbuffer, (unsigned long *)out_size);
   }
@@ -776,8 +1489,13 @@ void do_drop1(unsigned char *srcbuffer, long src_size, unsigned char *dropbuffer
   /* Start compressor (note no image data is actually written here) */
   jpeg_write_coefficients(&dstinfo, dst_coef_arrays);
 
-  /* Copy to the output file any extra markers that we want to preserve */
-  jcopy_markers_execute(&srcinfo, &dstinfo, copyoption);
+  /* Copy to the output file any extra markers that we want to preserve;
+   * in session mode the frame is an abbreviated image instead.
+   */
+  if (session_mode)
+    jpeg_suppress_tables(&dstinfo, TRUE);
+  else
+    jcopy_markers_execute(&srcinfo, &dstinfo, copyoption);
 
   /* Execute image transformation, if any */
   // jtransform_execute_transformation(&srcinfo, &dstinfo,
@@ -787,10 +1505,16 @@ void do_drop1(unsigned char *srcbuffer, long src_size, unsigned char *dropbuffer
   {
 	  int number = 0;
 	  int *decoder = a.data;
+	  JDIMENSION full_width, dirty_top = 0, dirty_bottom = 0;
+
+	  /* Destination width in iMCUs, and the iMCU rows written so far */
+	  full_width = (dstinfo.jpeg_width + transformoption.iMCU_sample_width - 1) /
+		  transformoption.iMCU_sample_width;
 
 	  while (number < a.size) {
 		  long temp_size;
-		  int crop_width, crop_height, srcX, srcY, destX, destY;
+		  int crop_width, crop_height, srcX, srcY, destX, destY, ref;
+		  ref_cache_entry *entry = NULL;
 		  char cropspec[100];
 		  crop_width = decoder[number+4];
 		  crop_height = decoder[number+5];
@@ -799,6 +1523,51 @@ void do_drop1(unsigned char *srcbuffer, long src_size, unsigned char *dropbuffer
 
 		  destX = decoder[number];
 		  destY = decoder[number+1];
+		  ref = decoder[number+6];
+
+		  if (ref != 0 && (entry = get_reference(&srcinfo, ref)) == NULL) {
+			  fprintf(stderr, "%s: reference @%d not available\n", progname, ref);
+			  goto release;	/* no frame with a region missing */
+		  }
+
+		  /* Moves off the iMCU grid are done with pixel precision by
+		   * do_move, which keeps pixel work to the blocks that need it.
+		   */
+		  if (move_off_grid(&srcinfo, &dstinfo, destX, destY, srcX, srcY,
+				    crop_width, crop_height)) {
+			  j_decompress_ptr moveinfo = ref != 0 ? &entry->info : &dropinfo;
+			  JDIMENSION top, bottom;
+
+			  if (destX < 0 || destY < 0 || srcX < 0 || srcY < 0 ||
+			      crop_width <= 0 || crop_height <= 0 ||
+			      destX >= (int) dstinfo.jpeg_width ||
+			      destY >= (int) dstinfo.jpeg_height)
+				  goto release;
+			  /* Clip to the destination and the source image */
+			  if (crop_width > (int) dstinfo.jpeg_width - destX)
+				  crop_width = (int) dstinfo.jpeg_width - destX;
+			  if (crop_height > (int) dstinfo.jpeg_height - destY)
+				  crop_height = (int) dstinfo.jpeg_height - destY;
+			  if (crop_width > (int) moveinfo->image_width - srcX)
+				  crop_width = (int) moveinfo->image_width - srcX;
+			  if (crop_height > (int) moveinfo->image_height - srcY)
+				  crop_height = (int) moveinfo->image_height - srcY;
+			  if (crop_width > 0 && crop_height > 0) {
+				  do_move(&srcinfo, &dstinfo, destX, destY, src_coef_arrays,
+					  moveinfo, ref != 0 ? entry->coef_arrays :
+					  transformoption.drop_coef_arrays,
+					  crop_width, crop_height, srcX, srcY);
+				  top = destY / transformoption.iMCU_sample_height;
+				  bottom = (destY + crop_height + transformoption.iMCU_sample_height - 1) /
+					  transformoption.iMCU_sample_height;
+				  if (dirty_top >= dirty_bottom || top < dirty_top)
+					  dirty_top = top;
+				  if (bottom > dirty_bottom)
+					  dirty_bottom = bottom;
+			  }
+			  number += CMD_FIELDS;
+			  continue;
+		  }
 
 		  // continually run the src coefficient array again
 		  // with new drop coefficient array and positions
@@ -814,7 +1583,7 @@ void do_drop1(unsigned char *srcbuffer, long src_size, unsigned char *dropbuffer
 		  transformoption.crop_height = 32;
 		  transformoption.crop_height_set = JCROP_POS;
 
-		  {
+		  if (ref == 0) {
 			  JDIMENSION xoffset, yoffset, dtemp;
 			  JDIMENSION width_in_iMCUs, height_in_iMCUs;
 			  JDIMENSION width_in_blocks, height_in_blocks;
@@ -827,14 +1596,14 @@ void do_drop1(unsigned char *srcbuffer, long src_size, unsigned char *dropbuffer
 						  srcinfo.min_DCT_h_scaled_size,
 						  srcinfo.min_DCT_v_scaled_size,
 						  transformoption.transform))
-						  return;
+						  goto release;
 				  } else {
 					  if (!jtransform_perfect_transform(srcinfo.output_width,
 						  srcinfo.output_height,
 						  srcinfo.max_h_samp_factor * srcinfo.min_DCT_h_scaled_size,
 						  srcinfo.max_v_samp_factor * srcinfo.min_DCT_v_scaled_size,
 						  transformoption.transform))
-						  return;
+						  goto release;
 				  }
 			  }
 
@@ -886,7 +1655,7 @@ void do_drop1(unsigned char *srcbuffer, long src_size, unsigned char *dropbuffer
 					  transformoption.crop_yoffset = 0;	/* default to +0 */
 				  if (transformoption.crop_width_set == JCROP_UNSET) {
 					  if (transformoption.crop_xoffset >= transformoption.output_width)
-						  return;
+						  goto release;
 					  transformoption.crop_width = transformoption.output_width - transformoption.crop_xoffset;
 				  } else {
 					  /* Check for crop extension */
@@ -895,17 +1664,17 @@ void do_drop1(unsigned char *srcbuffer, long src_size, unsigned char *dropbuffer
 						  if (transformoption.transform != JXFORM_NONE ||
 							  transformoption.crop_xoffset >= transformoption.crop_width ||
 							  transformoption.crop_xoffset > transformoption.crop_width - transformoption.output_width)
-							  return;
+							  goto release;
 					  } else {
 						  if (transformoption.crop_xoffset >= transformoption.output_width ||
 							  transformoption.crop_width <= 0 ||
 							  transformoption.crop_xoffset > transformoption.output_width - transformoption.crop_width)
-							  return;
+							  goto release;
 					  }
 				  }
 				  if (transformoption.crop_height_set == JCROP_UNSET) {
 					  if (transformoption.crop_yoffset >= transformoption.output_height)
-						  return;
+						  goto release;
 					  transformoption.crop_height = transformoption.output_height - transformoption.crop_yoffset;
 				  } else {
 					  /* Check for crop extension */
@@ -914,12 +1683,12 @@ void do_drop1(unsigned char *srcbuffer, long src_size, unsigned char *dropbuffer
 						  if (transformoption.transform != JXFORM_NONE ||
 							  transformoption.crop_yoffset >= transformoption.crop_height ||
 							  transformoption.crop_yoffset > transformoption.crop_height - transformoption.output_height)
-							  return;
+							  goto release;
 					  } else {
 						  if (transformoption.crop_yoffset >= transformoption.output_height ||
 							  transformoption.crop_height <= 0 ||
 							  transformoption.crop_yoffset > transformoption.output_height - transformoption.crop_height)
-							  return;
+							  goto release;
 					  }
 				  }
 				  /* Convert negative crop offsets into regular offsets */
@@ -967,12 +1736,12 @@ void do_drop1(unsigned char *srcbuffer, long src_size, unsigned char *dropbuffer
 									  srcinfo.max_h_samp_factor !=
 									  srcinfo.comp_info[ci].h_samp_factor *
 									  transformoption.drop_ptr->max_h_samp_factor)
-									  return;
+									  goto release;
 								  if (transformoption.drop_ptr->comp_info[ci].v_samp_factor *
 									  srcinfo.max_v_samp_factor !=
 									  srcinfo.comp_info[ci].v_samp_factor *
 									  transformoption.drop_ptr->max_v_samp_factor)
-									  return;
+									  goto release;
 						  }
 						  break;
 				  default:
@@ -1006,6 +1775,13 @@ void do_drop1(unsigned char *srcbuffer, long src_size, unsigned char *dropbuffer
 
 		  crop2 = transformoption.y_crop_offset;
 		  crop1 = transformoption.x_crop_offset;
+		  if (ref != 0) {
+			  /* Source offsets in the reference, rounded up to iMCU boundaries */
+			  crop1 = (srcX + transformoption.iMCU_sample_width - 1) /
+				  transformoption.iMCU_sample_width;
+			  crop2 = (srcY + transformoption.iMCU_sample_height - 1) /
+				  transformoption.iMCU_sample_height;
+		  }
 		  // second
 		  jtransform_parse_crop_spec(&transformoption, cropspec);
 		  transformoption.crop_width = crop_width;
@@ -1026,14 +1802,14 @@ void do_drop1(unsigned char *srcbuffer, long src_size, unsigned char *dropbuffer
 						  srcinfo.min_DCT_h_scaled_size,
 						  srcinfo.min_DCT_v_scaled_size,
 						  transformoption.transform))
-						  return;
+						  goto release;
 				  } else {
 					  if (!jtransform_perfect_transform(srcinfo.output_width,
 						  srcinfo.output_height,
 						  srcinfo.max_h_samp_factor * srcinfo.min_DCT_h_scaled_size,
 						  srcinfo.max_v_samp_factor * srcinfo.min_DCT_v_scaled_size,
 						  transformoption.transform))
-						  return;
+						  goto release;
 				  }
 			  }
 
@@ -1085,7 +1861,7 @@ void do_drop1(unsigned char *srcbuffer, long src_size, unsigned char *dropbuffer
 					  transformoption.crop_yoffset = 0;	/* default to +0 */
 				  if (transformoption.crop_width_set == JCROP_UNSET) {
 					  if (transformoption.crop_xoffset >= transformoption.output_width)
-						  return;
+						  goto release;
 					  transformoption.crop_width = transformoption.output_width - transformoption.crop_xoffset;
 				  } else {
 					  /* Check for crop extension */
@@ -1094,17 +1870,17 @@ void do_drop1(unsigned char *srcbuffer, long src_size, unsigned char *dropbuffer
 						  if (transformoption.transform != JXFORM_NONE ||
 							  transformoption.crop_xoffset >= transformoption.crop_width ||
 							  transformoption.crop_xoffset > transformoption.crop_width - transformoption.output_width)
-							  return;
+							  goto release;
 					  } else {
 						  if (transformoption.crop_xoffset >= transformoption.output_width ||
 							  transformoption.crop_width <= 0 ||
 							  transformoption.crop_xoffset > transformoption.output_width - transformoption.crop_width)
-							  return;
+							  goto release;
 					  }
 				  }
 				  if (transformoption.crop_height_set == JCROP_UNSET) {
 					  if (transformoption.crop_yoffset >= transformoption.output_height)
-						  return;
+						  goto release;
 					  transformoption.crop_height = transformoption.output_height - transformoption.crop_yoffset;
 				  } else {
 					  /* Check for crop extension */
@@ -1113,12 +1889,12 @@ void do_drop1(unsigned char *srcbuffer, long src_size, unsigned char *dropbuffer
 						  if (transformoption.transform != JXFORM_NONE ||
 							  transformoption.crop_yoffset >= transformoption.crop_height ||
 							  transformoption.crop_yoffset > transformoption.crop_height - transformoption.output_height)
-							  return;
+							  goto release;
 					  } else {
 						  if (transformoption.crop_yoffset >= transformoption.output_height ||
 							  transformoption.crop_height <= 0 ||
 							  transformoption.crop_yoffset > transformoption.output_height - transformoption.crop_height)
-							  return;
+							  goto release;
 					  }
 				  }
 				  /* Convert negative crop offsets into regular offsets */
@@ -1166,12 +1942,12 @@ void do_drop1(unsigned char *srcbuffer, long src_size, unsigned char *dropbuffer
 									  srcinfo.max_h_samp_factor !=
 									  srcinfo.comp_info[ci].h_samp_factor *
 									  transformoption.drop_ptr->max_h_samp_factor)
-									  return;
+									  goto release;
 								  if (transformoption.drop_ptr->comp_info[ci].v_samp_factor *
 									  srcinfo.max_v_samp_factor !=
 									  srcinfo.comp_info[ci].v_samp_factor *
 									  transformoption.drop_ptr->max_v_samp_factor)
-									  return;
+									  goto release;
 						  }
 						  break;
 				  default:
@@ -1201,23 +1977,62 @@ void do_drop1(unsigned char *srcbuffer, long src_size, unsigned char *dropbuffer
 		  }
 
 		  //printf("dfsdfs%d %d", transformoption.x_crop_offset, transformoption.y_crop_offset);
-		  do_drop(&srcinfo, &dstinfo, transformoption.x_crop_offset, transformoption.y_crop_offset,
-			  src_coef_arrays, &dropinfo, transformoption.drop_coef_arrays, transformoption.drop_width,
-			  transformoption.drop_height, crop1, crop2);
+		  /* Commands naming a reference copy from its cached arrays.
+		   * A full-width vertical move within the frame over rows not yet
+		   * touched by this batch is a scroll: do_scroll can then rotate
+		   * row pointers instead of copying every block.
+		   */
+		  if (ref != 0) {
+			  if (reference_covers(&dstinfo, &entry->info, crop1, crop2,
+					       transformoption.drop_width, transformoption.drop_height))
+				  do_drop(&srcinfo, &dstinfo, transformoption.x_crop_offset, transformoption.y_crop_offset,
+					  src_coef_arrays, &entry->info, entry->coef_arrays, transformoption.drop_width,
+					  transformoption.drop_height, crop1, crop2);
+			  else {
+				  fprintf(stderr, "%s: command exceeds reference @%d\n", progname, ref);
+				  goto release;
+			  }
+		  } else if (transformoption.x_crop_offset == 0 && crop1 == 0 &&
+		      transformoption.drop_width == full_width &&
+		      (dirty_top >= dirty_bottom ||
+		       (dirty_top >= crop2 + transformoption.drop_height &&
+			dirty_top >= transformoption.y_crop_offset + transformoption.drop_height) ||
+		       (dirty_bottom <= crop2 && dirty_bottom <= transformoption.y_crop_offset)))
+			  do_scroll(&srcinfo, &dstinfo, transformoption.y_crop_offset, crop2,
+				    src_coef_arrays, &dropinfo, transformoption.drop_coef_arrays,
+				    transformoption.drop_height);
+		  else
+			  do_drop(&srcinfo, &dstinfo, transformoption.x_crop_offset, transformoption.y_crop_offset,
+				  src_coef_arrays, &dropinfo, transformoption.drop_coef_arrays, transformoption.drop_width,
+				  transformoption.drop_height, crop1, crop2);
+		  if (transformoption.drop_width != 0 && transformoption.drop_height != 0) {
+			  if (dirty_top >= dirty_bottom || transformoption.y_crop_offset < dirty_top)
+				  dirty_top = transformoption.y_crop_offset;
+			  if (transformoption.y_crop_offset + transformoption.drop_height > dirty_bottom)
+				  dirty_bottom = transformoption.y_crop_offset + transformoption.drop_height;
+		  }
 
-		  number += 6;
+		  number += CMD_FIELDS;
 	  }
 
   }
 
-  /* Finish compression and release memory */
+  /* All commands accepted; a streamed frame may go out now */
+  if (writefile == NULL && stream_output && ! stream_go_live(&sink))
+    ERREXIT(&dstinfo, JERR_FILE_WRITE);
+
+  /* Finish compression */
   jpeg_finish_compress(&dstinfo);
-  jpeg_destroy_compress(&dstinfo);
   (void) jpeg_finish_decompress(&dropinfo);
-  jpeg_destroy_decompress(&dropinfo);
-
-
   (void) jpeg_finish_decompress(&srcinfo);
+  result = TRUE;
+
+  /* Release memory; a rejected command comes here directly, so that
+   * the objects and their coefficient arrays are not leaked.
+   */
+release:
+  jpeg_destroy_compress(&dstinfo);
+  jpeg_destroy_decompress(&dropinfo);
   jpeg_destroy_decompress(&srcinfo);
 
 #ifdef PROGRESS_REPORT
@@ -1227,4 +2042,5 @@ void do_drop1(unsigned char *srcbuffer, long src_size, unsigned char *dropbuffer
   if (writefile != NULL && fp != stdout)
     fclose(fp);
 
+  return result;
 }
@@ -17,6 +17,14 @@
 
 #ifdef QUANT_1PASS_SUPPORTED
 
+/* The SSE2 code handles 8-bit samples */
+#ifdef JSIMD_SSE2
+#if BITS_IN_JSAMPLE == 8
+#define QUANT_SSE2_SUPPORTED
+#include <emmintrin.h>
+#endif
+#endif
+
 
 /*
  * The main purpose of 1-pass quantization is to provide a fast, if not very
@@ -140,6 +148,8 @@ typedef FSERROR FAR *FSERRPTR;	/* pointer to error array (in FAR storage!) */
 
 #define MAX_Q_COMPS 4		/* max components I can handle */
 
+#define MAX_SSE2_STEPS 16	/* max steps per colorindex for the SSE2 code */
+
 typedef struct {
   struct jpeg_color_quantizer pub; /* public fields */
 
@@ -154,6 +164,17 @@ typedef struct {
    */
   boolean is_padded;		/* is the colorindex padded for odither? */
 
+#ifdef QUANT_SSE2_SUPPORTED
+  /* The SSE2 code finds colorindex[i][j] by comparing j with the places
+   * where the entries change: step_at[i][k] is the largest j before the
+   * k'th change, and step_by[i][k] the amount of the change.
+   */
+  boolean use_steps;		/* TRUE if all tables fit the arrays below */
+  int num_steps[3];
+  JSAMPLE step_at[3][MAX_SSE2_STEPS];
+  JSAMPLE step_by[3][MAX_SSE2_STEPS];
+#endif
+
   int Ncolors[MAX_Q_COMPS];	/* # of values alloced to each component */
 
   /* Variables for ordered dithering */
@@ -385,6 +406,28 @@ create_colorindex (j_decompress_ptr cinfo)
 	indexptr[MAXJSAMPLE+j] = indexptr[MAXJSAMPLE];
       }
   }
+
+#ifdef QUANT_SSE2_SUPPORTED
+  /* Find the steps of the 3-component tables, for the SSE2 code */
+  cquantize->use_steps = (cinfo->out_color_components == 3);
+  for (i = 0; i < 3 && cquantize->use_steps; i++) {
+    indexptr = cquantize->colorindex[i];
+    k = 0;
+    for (j = 0; j < MAXJSAMPLE; j++) {
+      if (indexptr[j+1] == indexptr[j])
+	continue;
+      if (k >= MAX_SSE2_STEPS) {
+	cquantize->use_steps = FALSE;
+	break;
+      }
+      cquantize->step_at[i][k] = (JSAMPLE) j;
+      cquantize->step_by[i][k] =
+	(JSAMPLE) (GETJSAMPLE(indexptr[j+1]) - GETJSAMPLE(indexptr[j]));
+      k++;
+    }
+    cquantize->num_steps[i] = k;
+  }
+#endif
 }
 
 
@@ -607,6 +650,211 @@ quantize3_ord_dither (j_decompress_ptr cinfo, JSAMPARRAY input_buf,
 }
 
 
+#ifdef QUANT_SSE2_SUPPORTED
+
+/*
+ * SSE2 versions of color_quantize3 and quantize3_ord_dither, which work on
+ * 16 pixels at a time.  Instead of looking up colorindex[i][j] they add up
+ * the steps of the table that lie below j; colorindex[i][0] is always 0.
+ * The padding of the table for ordered dither repeats its end values, so
+ * the dithered values are simply clamped to 0..MAXJSAMPLE.  Each group of
+ * 16 columns spans one row of the dither matrix.  Pixels left over at the
+ * end of a row are done as in the C versions.
+ */
+
+/* The steps of the three colorindex tables, in vectors.  All three get
+ * the same number of steps; the extra ones are never taken.
+ */
+typedef struct {
+  int num_steps;
+  __m128i step_at[MAX_SSE2_STEPS][3]; /* offset by 0x80, see below */
+  __m128i step_by[MAX_SSE2_STEPS][3];
+} steps_sse2;
+
+
+LOCAL(void)
+load_steps_sse2 (my_cquantize_ptr cquantize, steps_sse2 * steps)
+{
+  int i, k;
+
+  steps->num_steps = 0;
+  for (i = 0; i < 3; i++)
+    if (steps->num_steps < cquantize->num_steps[i])
+      steps->num_steps = cquantize->num_steps[i];
+  for (i = 0; i < 3; i++) {
+    for (k = 0; k < steps->num_steps; k++) {
+      if (k < cquantize->num_steps[i]) {
+	steps->step_at[k][i] = _mm_set1_epi8((char)
+	  (GETJSAMPLE(cquantize->step_at[i][k]) ^ 0x80));
+	steps->step_by[k][i] = _mm_set1_epi8((char)
+	  GETJSAMPLE(cquantize->step_by[i][k]));
+      } else {
+	steps->step_at[k][i] = _mm_set1_epi8(0x7F);
+	steps->step_by[k][i] = _mm_setzero_si128();
+      }
+    }
+  }
+}
+
+
+INLINE
+LOCAL(void)
+quantize3_sse2 (steps_sse2 * steps, JSAMPROW inptr, JSAMPROW outptr,
+		__m128i * dither_up, __m128i * dither_down)
+/* Map 16 pixels, with dither_up[i] added to and dither_down[i] subtracted
+ * from component i of the pixels
+ */
+{
+  __m128i px0, px1, px2, t0, t1, t2, sign, code0, code1, code2;
+  int k;
+
+  /* Load the pixels and separate them into planes: each round is a
+   * perfect shuffle of the 48 bytes, and after four rounds every third
+   * byte has been gathered.
+   */
+#define SHUFFLE_SSE2  \
+  t0 = _mm_unpacklo_epi8(px0, _mm_unpackhi_epi64(px1, px1)); \
+  t1 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(px0, px0), px2); \
+  t2 = _mm_unpacklo_epi8(px1, _mm_unpackhi_epi64(px2, px2)); \
+  px0 = t0; px1 = t1; px2 = t2
+
+  px0 = _mm_loadu_si128((const __m128i *) inptr);
+  px1 = _mm_loadu_si128((const __m128i *) (inptr + 16));
+  px2 = _mm_loadu_si128((const __m128i *) (inptr + 32));
+  SHUFFLE_SSE2; SHUFFLE_SSE2; SHUFFLE_SSE2; SHUFFLE_SSE2;
+
+  /* Dithered values, range-limited by saturating arithmetic, and offset
+   * by 0x80 so that signed comparisons can be used
+   */
+  sign = _mm_set1_epi8((char) 0x80);
+  px0 = _mm_xor_si128(_mm_subs_epu8(_mm_adds_epu8(px0, dither_up[0]),
+				    dither_down[0]), sign);
+  px1 = _mm_xor_si128(_mm_subs_epu8(_mm_adds_epu8(px1, dither_up[1]),
+				    dither_down[1]), sign);
+  px2 = _mm_xor_si128(_mm_subs_epu8(_mm_adds_epu8(px2, dither_up[2]),
+				    dither_down[2]), sign);
+
+  code0 = code1 = code2 = _mm_setzero_si128();
+  for (k = 0; k < steps->num_steps; k++) {
+    code0 = _mm_add_epi8(code0, _mm_and_si128(
+      _mm_cmpgt_epi8(px0, steps->step_at[k][0]), steps->step_by[k][0]));
+    code1 = _mm_add_epi8(code1, _mm_and_si128(
+      _mm_cmpgt_epi8(px1, steps->step_at[k][1]), steps->step_by[k][1]));
+    code2 = _mm_add_epi8(code2, _mm_and_si128(
+      _mm_cmpgt_epi8(px2, steps->step_at[k][2]), steps->step_by[k][2]));
+  }
+  _mm_storeu_si128((__m128i *) outptr,
+		   _mm_add_epi8(_mm_add_epi8(code0, code1), code2));
+}
+
+
+METHODDEF(void)
+color_quantize3_sse2 (j_decompress_ptr cinfo, JSAMPARRAY input_buf,
+		      JSAMPARRAY output_buf, int num_rows)
+/* SSE2 version of color_quantize3 */
+{
+  my_cquantize_ptr cquantize = (my_cquantize_ptr) cinfo->cquantize;
+  register int pixcode;
+  register JSAMPROW ptrin, ptrout;
+  JSAMPROW colorindex0 = cquantize->colorindex[0];
+  JSAMPROW colorindex1 = cquantize->colorindex[1];
+  JSAMPROW colorindex2 = cquantize->colorindex[2];
+  steps_sse2 steps;
+  __m128i zero[3];
+  int row;
+  JDIMENSION col;
+  JDIMENSION width = cinfo->output_width;
+
+  load_steps_sse2(cquantize, &steps);
+  zero[0] = zero[1] = zero[2] = _mm_setzero_si128();
+
+  for (row = 0; row < num_rows; row++) {
+    ptrin = input_buf[row];
+    ptrout = output_buf[row];
+    for (col = width; col >= 16; col -= 16) {
+      quantize3_sse2(&steps, ptrin, ptrout, zero, zero);
+      ptrin += 16 * 3;
+      ptrout += 16;
+    }
+    for (; col > 0; col--) {
+      pixcode  = GETJSAMPLE(colorindex0[GETJSAMPLE(*ptrin++)]);
+      pixcode += GETJSAMPLE(colorindex1[GETJSAMPLE(*ptrin++)]);
+      pixcode += GETJSAMPLE(colorindex2[GETJSAMPLE(*ptrin++)]);
+      *ptrout++ = (JSAMPLE) pixcode;
+    }
+  }
+}
+
+
+METHODDEF(void)
+quantize3_ord_dither_sse2 (j_decompress_ptr cinfo, JSAMPARRAY input_buf,
+			   JSAMPARRAY output_buf, int num_rows)
+/* SSE2 version of quantize3_ord_dither */
+{
+  my_cquantize_ptr cquantize = (my_cquantize_ptr) cinfo->cquantize;
+  register int pixcode;
+  register JSAMPROW input_ptr;
+  register JSAMPROW output_ptr;
+  JSAMPROW colorindex0 = cquantize->colorindex[0];
+  JSAMPROW colorindex1 = cquantize->colorindex[1];
+  JSAMPROW colorindex2 = cquantize->colorindex[2];
+  int * dither0;		/* points to active row of dither matrix */
+  int * dither1;
+  int * dither2;
+  int row_index, col_index;	/* current indexes into dither matrix */
+  int row, i, k;
+  JDIMENSION col;
+  JDIMENSION width = cinfo->output_width;
+  JSAMPLE up[3][ODITHER_SIZE], down[3][ODITHER_SIZE];
+  steps_sse2 steps;
+  __m128i dither_up[3], dither_down[3];
+
+  load_steps_sse2(cquantize, &steps);
+
+  for (row = 0; row < num_rows; row++) {
+    row_index = cquantize->row_index;
+    input_ptr = input_buf[row];
+    output_ptr = output_buf[row];
+    dither0 = cquantize->odither[0][row_index];
+    dither1 = cquantize->odither[1][row_index];
+    dither2 = cquantize->odither[2][row_index];
+
+    /* Split the dither matrix row into its positive and negative parts */
+    for (i = 0; i < 3; i++) {
+      for (k = 0; k < ODITHER_SIZE; k++) {
+	int d = cquantize->odither[i][row_index][k];
+	up[i][k] = (JSAMPLE) (d > 0 ? d : 0);
+	down[i][k] = (JSAMPLE) (d < 0 ? -d : 0);
+      }
+      dither_up[i] = _mm_loadu_si128((const __m128i *) up[i]);
+      dither_down[i] = _mm_loadu_si128((const __m128i *) down[i]);
+    }
+
+    for (col = width; col >= ODITHER_SIZE; col -= ODITHER_SIZE) {
+      quantize3_sse2(&steps, input_ptr, output_ptr,
+		     dither_up, dither_down);
+      input_ptr += ODITHER_SIZE * 3;
+      output_ptr += ODITHER_SIZE;
+    }
+    col_index = 0;
+    for (; col > 0; col--) {
+      pixcode  = GETJSAMPLE(colorindex0[GETJSAMPLE(*input_ptr++) +
+					dither0[col_index]]);
+      pixcode += GETJSAMPLE(colorindex1[GETJSAMPLE(*input_ptr++) +
+					dither1[col_index]]);
+      pixcode += GETJSAMPLE(colorindex2[GETJSAMPLE(*input_ptr++) +
+					dither2[col_index]]);
+      *output_ptr++ = (JSAMPLE) pixcode;
+      col_index = (col_index + 1) & ODITHER_MASK;
+    }
+    row_index = (row_index + 1) & ODITHER_MASK;
+    cquantize->row_index = row_index;
+  }
+}
+
+#endif /* QUANT_SSE2_SUPPORTED */
+
+
 METHODDEF(void)
 quantize_fs_dither (j_decompress_ptr cinfo, JSAMPARRAY input_buf,
 		    JSAMPARRAY output_buf, int num_rows)
@@ -752,16 +1000,16 @@ start_pass_1_quant (j_decompress_ptr cinfo, boolean is_pre_scan)
   /* Initialize for desired dithering mode. */
   switch (cinfo->dither_mode) {
   case JDITHER_NONE:
-    if (cinfo->out_color_components == 3)
+    if (cinfo->out_color_components == 3) {
       cquantize->pub.color_quantize = color_quantize3;
-    else
+#ifdef QUANT_SSE2_SUPPORTED
+      if (cquantize->use_steps && (jsimd_flags() & JSIMD_FLAG_SSE2))
+	cquantize->pub.color_quantize = color_quantize3_sse2;
+#endif
+    } else
       cquantize->pub.color_quantize = color_quantize;
     break;
   case JDITHER_ORDERED:
-    if (cinfo->out_color_components == 3)
-      cquantize->pub.color_quantize = quantize3_ord_dither;
-    else
-      cquantize->pub.color_quantize = quantize_ord_dither;
     cquantize->row_index = 0;	/* initialize state for ordered dither */
     /* If user changed to ordered dither from another mode,
      * we must recreate the color index table with padding.
@@ -772,6 +1020,14 @@ start_pass_1_quant (j_decompress_ptr cinfo, boolean is_pre_scan)
     /* Create ordered-dither tables if we didn't already. */
     if (cquantize->odither[0] == NULL)
       create_odither_tables(cinfo);
+    if (cinfo->out_color_components == 3) {
+      cquantize->pub.color_quantize = quantize3_ord_dither;
+#ifdef QUANT_SSE2_SUPPORTED
+      if (cquantize->use_steps && (jsimd_flags() & JSIMD_FLAG_SSE2))
+	cquantize->pub.color_quantize = quantize3_ord_dither_sse2;
+#endif
+    } else
+      cquantize->pub.color_quantize = quantize_ord_dither;
     break;
   case JDITHER_FS:
     cquantize->pub.color_quantize = quantize_fs_dither;
@@ -634,6 +634,14 @@ select_colors (j_decompress_ptr cinfo, int desired_colors)
 #define BOX_C1_SHIFT  (C1_SHIFT + BOX_C1_LOG)
 #define BOX_C2_SHIFT  (C2_SHIFT + BOX_C2_LOG)
 
+/* The SSE2 code fills the four cells of an update box row at once */
+#ifdef JSIMD_SSE2
+#if BOX_C2_LOG == 2
+#define QUANT_SSE2_SUPPORTED
+#include <emmintrin.h>
+#endif
+#endif
+
 
 /*
  * The next three routines implement inverse colormap filling.  They could
@@ -852,6 +860,91 @@ find_best_colors (j_decompress_ptr cinfo, int minc0, int minc1, int minc2,
 }
 
 
+#ifdef QUANT_SSE2_SUPPORTED
+
+LOCAL(void)
+find_best_colors_sse2 (j_decompress_ptr cinfo,
+		       int minc0, int minc1, int minc2,
+		       int numcolors, JSAMPLE colorlist[], JSAMPLE bestcolor[])
+/* SSE2 version of find_best_colors.  The BOX_C2_ELEMS (= 4) cells along
+ * the c2 axis are done at once: their distances to a color differ from the
+ * first one's by fixed offsets, which are found once per color.  Each cell
+ * keeps the first color with the smallest distance, as in the C version.
+ */
+{
+  int ic0, ic1;
+  int i, icolor;
+  __m128i * bptr;		/* pointer into bestdist[] array */
+  __m128i * cptr;		/* pointer into bestidx[] array */
+  INT32 dist0, dist1;		/* initial distance values */
+  INT32 xx0, xx1;		/* distance increments */
+  INT32 inc0, inc1, inc2;	/* initial values for increments */
+  __m128i offset, color, dist2, closer;
+  /* These arrays hold the distance to and index of the nearest-so-far
+   * color for each cell
+   */
+  __m128i bestdist[BOX_C0_ELEMS * BOX_C1_ELEMS];
+  __m128i bestidx[BOX_C0_ELEMS * BOX_C1_ELEMS];
+  int idx[BOX_C0_ELEMS * BOX_C1_ELEMS * BOX_C2_ELEMS];
+
+  /* Initialize best-distance for each cell of the update box */
+  for (i = 0; i < BOX_C0_ELEMS * BOX_C1_ELEMS; i++) {
+    bestdist[i] = _mm_set1_epi32(0x7FFFFFFFL);
+    bestidx[i] = _mm_setzero_si128();
+  }
+
+  for (i = 0; i < numcolors; i++) {
+    icolor = GETJSAMPLE(colorlist[i]);
+    /* Compute (square of) distance from minc0/c1/c2 to this color */
+    inc0 = (minc0 - GETJSAMPLE(cinfo->colormap[0][icolor])) * C0_SCALE;
+    dist0 = inc0*inc0;
+    inc1 = (minc1 - GETJSAMPLE(cinfo->colormap[1][icolor])) * C1_SCALE;
+    dist0 += inc1*inc1;
+    inc2 = (minc2 - GETJSAMPLE(cinfo->colormap[2][icolor])) * C2_SCALE;
+    dist0 += inc2*inc2;
+    /* Form the initial difference increments */
+    inc0 = inc0 * (2 * STEP_C0) + STEP_C0 * STEP_C0;
+    inc1 = inc1 * (2 * STEP_C1) + STEP_C1 * STEP_C1;
+    inc2 = inc2 * (2 * STEP_C2) + STEP_C2 * STEP_C2;
+    /* The k-th cell along c2 is k*inc2 + k*(k-1)*STEP_C2^2 further */
+    offset = _mm_setr_epi32(0, inc2,
+			    2 * inc2 + 2 * STEP_C2 * STEP_C2,
+			    3 * inc2 + 6 * STEP_C2 * STEP_C2);
+    color = _mm_set1_epi32(icolor);
+    /* Now loop over all cells in box, updating distance per Thomas method */
+    bptr = bestdist;
+    cptr = bestidx;
+    xx0 = inc0;
+    for (ic0 = BOX_C0_ELEMS-1; ic0 >= 0; ic0--) {
+      dist1 = dist0;
+      xx1 = inc1;
+      for (ic1 = BOX_C1_ELEMS-1; ic1 >= 0; ic1--) {
+	dist2 = _mm_add_epi32(_mm_set1_epi32(dist1), offset);
+	closer = _mm_cmplt_epi32(dist2, *bptr);
+	*bptr = _mm_or_si128(_mm_and_si128(closer, dist2),
+			     _mm_andnot_si128(closer, *bptr));
+	*cptr = _mm_or_si128(_mm_and_si128(closer, color),
+			     _mm_andnot_si128(closer, *cptr));
+	bptr++;
+	cptr++;
+	dist1 += xx1;
+	xx1 += 2 * STEP_C1 * STEP_C1;
+      }
+      dist0 += xx0;
+      xx0 += 2 * STEP_C0 * STEP_C0;
+    }
+  }
+
+  /* Return the indexes of the closest entries */
+  for (i = 0; i < BOX_C0_ELEMS * BOX_C1_ELEMS; i++)
+    _mm_storeu_si128((__m128i *) (idx + i * BOX_C2_ELEMS), bestidx[i]);
+  for (i = 0; i < BOX_C0_ELEMS * BOX_C1_ELEMS * BOX_C2_ELEMS; i++)
+    bestcolor[i] = (JSAMPLE) idx[i];
+}
+
+#endif /* QUANT_SSE2_SUPPORTED */
+
+
 LOCAL(void)
 fill_inverse_cmap (j_decompress_ptr cinfo, int c0, int c1, int c2)
 /* Fill the inverse-colormap entries in the update box that contains */
@@ -889,6 +982,12 @@ fill_inverse_cmap (j_decompress_ptr cinfo, int c0, int c1, int c2)
   numcolors = find_nearby_colors(cinfo, minc0, minc1, minc2, colorlist);
 
   /* Determine the actually nearest colors. */
+#ifdef QUANT_SSE2_SUPPORTED
+  if (jsimd_flags() & JSIMD_FLAG_SSE2)
+    find_best_colors_sse2(cinfo, minc0, minc1, minc2, numcolors, colorlist,
+			  bestcolor);
+  else
+#endif
   find_best_colors(cinfo, minc0, minc1, minc2, numcolors, colorlist,
 		   bestcolor);
 
@@ -16,6 +16,12 @@
 #include "jinclude.h"
 #include "jpeglib.h"
 
+#ifndef NO_GETENV
+#ifndef HAVE_STDLIB_H		/* <stdlib.h> should declare getenv() */
+extern char * getenv JPP((const char * name));
+#endif
+#endif
+
 
 /*
  * jpeg_zigzag_order[i] is the zigzag-order position of the i'th element
@@ -225,3 +231,36 @@ jcopy_block_row (JBLOCKROW input_row, JBLOCKROW output_row,
   }
 #endif
 }
+
+
+/*
+ * Report the SIMD code to be used.
+ * The SSE2 code is compiled in only where the compiler itself targets SSE2
+ * (see jpegint.h), so the processor running it must have SSE2 anyway and
+ * is not probed.  Setting the environment variable JPEGSIMD to 0 disables
+ * all SIMD code, for debugging or for comparing against the plain C code.
+ * The answer does not change, so it is kept in a static variable.  If your
+ * system doesn't support getenv(), define NO_GETENV to disable this feature.
+ */
+
+GLOBAL(int)
+jsimd_flags (void)
+{
+#ifdef JSIMD_SSE2
+  static int flags = -1;
+#ifndef NO_GETENV
+  char * env;
+#endif
+
+  if (flags < 0) {
+    flags = JSIMD_FLAG_SSE2;
+#ifndef NO_GETENV
+    if ((env = getenv("JPEGSIMD")) != NULL && env[0] == '0' && env[1] == 0)
+      flags = 0;
+#endif
+  }
+  return flags;
+#else
+  return 0;			/* no SIMD code compiled in */
+#endif
+}
@@ -58,6 +58,8 @@ typedef struct _bmp_source_struct {
   JSAMPARRAY colormap;		/* BMP colormap (converted to my format) */
 
   jvirt_sarray_ptr whole_image;	/* Needed to reverse row order */
+  JSAMPROW iobuffer;		/* Holds one file row if reading in place */
+  long image_offset;		/* File position of the bottom row */
   JDIMENSION source_row;	/* Current source row number */
   JDIMENSION row_width;		/* Physical width of scanlines in file */
 
@@ -109,11 +111,53 @@ read_colormap (bmp_source_ptr sinfo, int cmaplen, int mapentrysize)
 }
 
 
+LOCAL(void)
+read_file_row (bmp_source_ptr sinfo, JSAMPROW out_ptr)
+/* Copy the next row of the file as is */
+{
+  register FILE *infile = sinfo->pub.input_file;
+  register int c;
+  register JDIMENSION col;
+
+  for (col = sinfo->row_width; col > 0; col--) {
+    /* inline copy of read_byte() for speed */
+    if ((c = getc(infile)) == EOF)
+      ERREXIT(sinfo->cinfo, JERR_INPUT_EOF);
+    *out_ptr++ = (JSAMPLE) c;
+  }
+}
+
+
+LOCAL(JSAMPROW)
+fetch_source_row (j_compress_ptr cinfo, bmp_source_ptr source)
+/* Get the unprocessed data of the next row in top-to-bottom order */
+{
+  JSAMPARRAY image_ptr;
+
+  source->source_row--;
+  if (source->whole_image == NULL) {
+    /* Read the row directly from its place in the file */
+    if (fseek(source->pub.input_file, source->image_offset +
+	      (long) source->row_width * (long) source->source_row,
+	      SEEK_SET) != 0)
+      ERREXIT(cinfo, JERR_INPUT_EOF);
+    read_file_row(source, source->iobuffer);
+    return source->iobuffer;
+  }
+  /* Fetch next row from virtual array */
+  image_ptr = (*cinfo->mem->access_virt_sarray)
+    ((j_common_ptr) cinfo, source->whole_image,
+     source->source_row, (JDIMENSION) 1, FALSE);
+  return image_ptr[0];
+}
+
+
 /*
  * Read one row of pixels.
- * The image has been read into the whole_image array, but is otherwise
- * unprocessed.  We must read it out in top-to-bottom row order, and if
- * it is an 8-bit image, we must expand colormapped pixels to 24bit format.
+ * The image has been read into the whole_image array, or is read directly
+ * from the file, but is otherwise unprocessed.  We must read it out in
+ * top-to-bottom row order, and if it is an 8-bit image, we must expand
+ * colormapped pixels to 24bit format.
  */
 
 METHODDEF(JDIMENSION)
@@ -122,19 +166,12 @@ get_8bit_row (j_compress_ptr cinfo, cjpeg_source_ptr sinfo)
 {
   bmp_source_ptr source = (bmp_source_ptr) sinfo;
   register JSAMPARRAY colormap = source->colormap;
-  JSAMPARRAY image_ptr;
   register int t;
   register JSAMPROW inptr, outptr;
   register JDIMENSION col;
 
-  /* Fetch next row from virtual array */
-  source->source_row--;
-  image_ptr = (*cinfo->mem->access_virt_sarray)
-    ((j_common_ptr) cinfo, source->whole_image,
-     source->source_row, (JDIMENSION) 1, FALSE);
-
   /* Expand the colormap indexes to real data */
-  inptr = image_ptr[0];
+  inptr = fetch_source_row(cinfo, source);
   outptr = source->pub.buffer[0];
   for (col = cinfo->image_width; col > 0; col--) {
     t = GETJSAMPLE(*inptr++);
@@ -152,20 +189,13 @@ get_24bit_row (j_compress_ptr cinfo, cjpeg_source_ptr sinfo)
 /* This version is for reading 24-bit pixels */
 {
   bmp_source_ptr source = (bmp_source_ptr) sinfo;
-  JSAMPARRAY image_ptr;
   register JSAMPROW inptr, outptr;
   register JDIMENSION col;
 
-  /* Fetch next row from virtual array */
-  source->source_row--;
-  image_ptr = (*cinfo->mem->access_virt_sarray)
-    ((j_common_ptr) cinfo, source->whole_image,
-     source->source_row, (JDIMENSION) 1, FALSE);
-
   /* Transfer data.  Note source values are in BGR order
    * (even though Microsoft's own documents say the opposite).
    */
-  inptr = image_ptr[0];
+  inptr = fetch_source_row(cinfo, source);
   outptr = source->pub.buffer[0];
   for (col = cinfo->image_width; col > 0; col--) {
     outptr[2] = *inptr++;	/* can omit GETJSAMPLE() safely */
@@ -183,19 +213,13 @@ get_32bit_row (j_compress_ptr cinfo, cjpeg_source_ptr sinfo)
 /* This version is for reading 32-bit pixels */
 {
   bmp_source_ptr source = (bmp_source_ptr) sinfo;
-  JSAMPARRAY image_ptr;
   register JSAMPROW inptr, outptr;
   register JDIMENSION col;
 
-  /* Fetch next row from virtual array */
-  source->source_row--;
-  image_ptr = (*cinfo->mem->access_virt_sarray)
-    ((j_common_ptr) cinfo, source->whole_image,
-     source->source_row, (JDIMENSION) 1, FALSE);
   /* Transfer data.  Note source values are in BGR order
    * (even though Microsoft's own documents say the opposite).
    */
-  inptr = image_ptr[0];
+  inptr = fetch_source_row(cinfo, source);
   outptr = source->pub.buffer[0];
   for (col = cinfo->image_width; col > 0; col--) {
     outptr[2] = *inptr++;	/* can omit GETJSAMPLE() safely */
@@ -213,41 +237,36 @@ get_32bit_row (j_compress_ptr cinfo, cjpeg_source_ptr sinfo)
  * This method loads the image into whole_image during the first call on
  * get_pixel_rows.  The get_pixel_rows pointer is then adjusted to call
  * get_8bit_row, get_24bit_row, or get_32bit_row on subsequent calls.
+ * If the input file is seekable, there is no whole_image; we just set up
+ * to read the rows from the file in top-to-bottom order.
  */
 
 METHODDEF(JDIMENSION)
 preload_image (j_compress_ptr cinfo, cjpeg_source_ptr sinfo)
 {
   bmp_source_ptr source = (bmp_source_ptr) sinfo;
-  register FILE *infile = source->pub.input_file;
-  register int c;
-  register JSAMPROW out_ptr;
   JSAMPARRAY image_ptr;
-  JDIMENSION row, col;
+  JDIMENSION row;
   cd_progress_ptr progress = (cd_progress_ptr) cinfo->progress;
 
-  /* Read the data into a virtual array in input-file row order. */
-  for (row = 0; row < cinfo->image_height; row++) {
-    if (progress != NULL) {
-      progress->pub.pass_counter = (long) row;
-      progress->pub.pass_limit = (long) cinfo->image_height;
-      (*progress->pub.progress_monitor) ((j_common_ptr) cinfo);
-    }
-    image_ptr = (*cinfo->mem->access_virt_sarray)
-      ((j_common_ptr) cinfo, source->whole_image,
-       row, (JDIMENSION) 1, TRUE);
-    out_ptr = image_ptr[0];
-    for (col = source->row_width; col > 0; col--) {
-      /* inline copy of read_byte() for speed */
-      if ((c = getc(infile)) == EOF)
-	ERREXIT(cinfo, JERR_INPUT_EOF);
-      *out_ptr++ = (JSAMPLE) c;
+  if (source->whole_image != NULL) {
+    /* Read the data into a virtual array in input-file row order. */
+    for (row = 0; row < cinfo->image_height; row++) {
+      if (progress != NULL) {
+	progress->pub.pass_counter = (long) row;
+	progress->pub.pass_limit = (long) cinfo->image_height;
+	(*progress->pub.progress_monitor) ((j_common_ptr) cinfo);
+      }
+      image_ptr = (*cinfo->mem->access_virt_sarray)
+	((j_common_ptr) cinfo, source->whole_image,
+	 row, (JDIMENSION) 1, TRUE);
+      read_file_row(source, image_ptr[0]);
     }
+    if (progress != NULL)
+      progress->completed_extra_passes++;
   }
-  if (progress != NULL)
-    progress->completed_extra_passes++;
 
-  /* Set up to read from the virtual array in top-to-bottom order */
+  /* Set up to read in top-to-bottom order */
   switch (source->bits_per_pixel) {
   case 8:
     source->pub.get_pixel_rows = get_8bit_row;
@@ -421,15 +440,24 @@ start_input_bmp (j_compress_ptr cinfo, cjpeg_source_ptr sinfo)
   while ((row_width & 3) != 0) row_width++;
   source->row_width = row_width;
 
-  /* Allocate space for inversion array, prepare for preload pass */
-  source->whole_image = (*cinfo->mem->request_virt_sarray)
-    ((j_common_ptr) cinfo, JPOOL_IMAGE, FALSE,
-     row_width, (JDIMENSION) biHeight, (JDIMENSION) 1);
-  source->pub.get_pixel_rows = preload_image;
-  if (cinfo->progress != NULL) {
-    cd_progress_ptr progress = (cd_progress_ptr) cinfo->progress;
-    progress->total_extra_passes++; /* count file input as separate pass */
+  if (file_is_seekable(source->pub.input_file) &&
+      (source->image_offset = ftell(source->pub.input_file)) >= 0) {
+    /* We can read the rows in place; just need a buffer for one of them */
+    source->whole_image = NULL;
+    source->iobuffer = (JSAMPROW) (*cinfo->mem->alloc_small)
+      ((j_common_ptr) cinfo, JPOOL_IMAGE,
+       (size_t) row_width * SIZEOF(JSAMPLE));
+  } else {
+    /* Allocate space for inversion array, prepare for preload pass */
+    source->whole_image = (*cinfo->mem->request_virt_sarray)
+      ((j_common_ptr) cinfo, JPOOL_IMAGE, FALSE,
+       row_width, (JDIMENSION) biHeight, (JDIMENSION) 1);
+    if (cinfo->progress != NULL) {
+      cd_progress_ptr progress = (cd_progress_ptr) cinfo->progress;
+      progress->total_extra_passes++; /* count file input as separate pass */
+    }
   }
+  source->pub.get_pixel_rows = preload_image;
 
   /* Allocate one-row buffer for returned data */
   source->pub.buffer = (*cinfo->mem->alloc_sarray)
@@ -10,6 +10,10 @@
  * the text in COM (comment) markers in a JFIF file.
  * This may be useful as an example of the minimum logic needed to parse
  * JPEG markers.
+ *
+ * A batch mode is also provided for surveying large numbers of files:
+ * it prints a one-line summary of the frame header, quantization tables
+ * and comments of each file named on the command line or in a list file.
  */
 
 #define JPEG_CJPEG_DJPEG	/* to get the command-line config symbols */
@@ -18,6 +22,11 @@
 #ifdef HAVE_LOCALE_H
 #include <locale.h>		/* Bill Allombert: use locale for isprint */
 #endif
+#ifndef HAVE_STDLIB_H		/* <stdlib.h> should declare malloc() */
+extern void * malloc ();
+extern void * realloc ();
+#endif
+#include <setjmp.h>		/* for error recovery in batch mode */
 #include <ctype.h>		/* to declare isupper(), tolower() */
 #ifdef USE_SETMODE
 #include <fcntl.h>		/* to declare setmode()'s parameter macros */
@@ -63,13 +72,32 @@
  */
 
 static FILE * infile;		/* input JPEG file */
+static int infile_seekable;	/* OK to skip data with fseek()? */
 
 /* Return next input byte, or EOF if no more */
 #define NEXTBYTE()  getc(infile)
 
 
-/* Error exit handler */
-#define ERREXIT(msg)  (fprintf(stderr, "%s\n", msg), exit(EXIT_FAILURE))
+/* Error exit handler.
+ * In batch mode an error abandons only the current file: scan_file()
+ * points batch_error at its setjmp buffer while a file is being scanned.
+ */
+
+static jmp_buf * batch_error;	/* non-NULL while scanning in batch mode */
+static const char * infile_name; /* name of file being scanned in batch */
+
+static void
+error_exit (const char * msg)
+{
+  if (batch_error != NULL) {
+    fprintf(stderr, "%s: %s\n", infile_name, msg);
+    longjmp(*batch_error, 1);
+  }
+  fprintf(stderr, "%s\n", msg);
+  exit(EXIT_FAILURE);
+}
+
+#define ERREXIT(msg)  error_exit(msg)
 
 
 /* Read one byte, testing for EOF */
@@ -123,6 +151,7 @@ read_2_bytes (void)
 #define M_SOI   0xD8		/* Start Of Image (beginning of datastream) */
 #define M_EOI   0xD9		/* End Of Image (end of datastream) */
 #define M_SOS   0xDA		/* Start Of Scan (begins compressed data) */
+#define M_DQT   0xDB		/* Define Quantization Table(s) */
 #define M_APP0	0xE0		/* Application-specific marker, type N */
 #define M_APP12	0xEC		/* (we don't bother to list all 16 APPn's) */
 #define M_COM   0xFE		/* COMment */
@@ -158,6 +187,8 @@ next_marker (void)
   } while (c == 0xFF);
 
   if (discarded_bytes != 0) {
+    if (batch_error != NULL)
+      fprintf(stderr, "%s: ", infile_name);
     fprintf(stderr, "Warning: garbage data found in JPEG file\n");
   }
 
@@ -207,7 +238,14 @@ skip_variable (void)
   if (length < 2)
     ERREXIT("Erroneous JPEG marker length");
   length -= 2;
-  /* Skip over the remaining bytes */
+  /* Skip over the remaining bytes.  Large APPn blocks (Exif thumbnails,
+   * ICC profiles) are common, so avoid reading them if we can.
+   */
+  if (infile_seekable) {
+    if (fseek(infile, (long) length, SEEK_CUR) != 0)
+      ERREXIT("Can't seek in JPEG file");
+    return;
+  }
   while (length > 0) {
     (void) read_1_byte();
     length--;
@@ -412,10 +450,14 @@ usage (void)
   fprintf(stderr, "rdjpgcom displays any textual comments in a JPEG file.\n");
 
   fprintf(stderr, "Usage: %s [switches] [inputfile]\n", progname);
+  fprintf(stderr, "       %s -batch [-files listfile] [inputfile ...]\n",
+	  progname);
 
   fprintf(stderr, "Switches (names may be abbreviated):\n");
   fprintf(stderr, "  -raw        Display non-printable characters in comments (unsafe)\n");
   fprintf(stderr, "  -verbose    Also display dimensions of JPEG image\n");
+  fprintf(stderr, "  -batch      Print a one-line summary of each input file\n");
+  fprintf(stderr, "  -files name Also summarize files listed in named file (- for stdin)\n");
 
   exit(EXIT_FAILURE);
 }
@@ -446,6 +488,341 @@ keymatch (char * arg, const char * keyword, int minchars)
 }
 
 
+/*
+ * Batch mode.
+ * Instead of the listing above, we print one line per file giving the items
+ * most often wanted when auditing a large collection of JPEG files:
+ *	name width height components precision process sampling quant
+ * followed by one field per COM marker, all separated by tabs.
+ * "process" is the SOFn marker type (SOF0 = baseline, SOF2 = progressive,
+ * etc); "sampling" lists the HxV sampling factors of the components, and
+ * "quant" a hash of the quantization table used by each component, so that
+ * files made with the same quality settings are easy to group together.
+ * The hash is 32-bit FNV-1a over the 64 table entries in stored (zigzag)
+ * order, each taken as two bytes MSB first whatever the table precision.
+ * Tabs, newlines, backslashes and nonprintable characters in the file name
+ * and comments are escaped, so a record never spans lines.
+ * If a file has no frame header (tables-only datastream), the frame fields
+ * are printed as "-".
+ */
+
+#define NUM_QUANT_TBLS  4	/* quantization tables are numbered 0..3 */
+#define MAX_COMPONENTS  255	/* largest count a SOF marker can hold */
+
+#define FNV_OFFSET_BASIS  2166136261UL
+#define FNV_PRIME         16777619UL
+
+static struct {
+  int have_frame;		/* TRUE once a SOFn marker is seen */
+  int process;			/* which SOFn marker */
+  unsigned int image_width, image_height;
+  int data_precision, num_components;
+  int samp_factor[MAX_COMPONENTS]; /* H/V sampling factors, as in SOF */
+  int quant_tbl_no[MAX_COMPONENTS];
+  int quant_defined[NUM_QUANT_TBLS];
+  unsigned long quant_hash[NUM_QUANT_TBLS];
+} record;
+
+/* COM marker contents are saved until the record is printed, since they
+ * often precede SOFn.  Each is stored as a 2-byte length and the text.
+ */
+static unsigned char * comment_buffer;
+static size_t comment_buffer_size, comment_buffer_used;
+
+
+static void
+record_SOFn (int marker)
+{
+  unsigned int length;
+  int ci;
+
+  length = read_2_bytes();	/* usual parameter length count */
+
+  record.data_precision = read_1_byte();
+  record.image_height = read_2_bytes();
+  record.image_width = read_2_bytes();
+  record.num_components = read_1_byte();
+
+  if (length != (unsigned int) (8 + record.num_components * 3))
+    ERREXIT("Bogus SOF marker length");
+
+  for (ci = 0; ci < record.num_components; ci++) {
+    (void) read_1_byte();	/* Component ID code */
+    record.samp_factor[ci] = read_1_byte();
+    record.quant_tbl_no[ci] = read_1_byte();
+  }
+  record.process = marker;
+  record.have_frame = 1;
+}
+
+
+static void
+record_DQT (void)
+{
+  unsigned int length, count;
+  unsigned int value;
+  unsigned long hash;
+  int n, prec, i;
+
+  length = read_2_bytes();
+  /* Length includes itself, so must be at least 2 */
+  if (length < 2)
+    ERREXIT("Erroneous JPEG marker length");
+  length -= 2;
+
+  while (length > 0) {
+    n = read_1_byte();
+    prec = n >> 4;
+    n &= 0x0F;
+    count = prec ? 1 + 64*2 : 1 + 64;
+    if (length < count)
+      ERREXIT("Bogus DQT marker length");
+    if (n >= NUM_QUANT_TBLS)
+      ERREXIT("Bogus DQT table number");
+
+    hash = FNV_OFFSET_BASIS;
+    for (i = 0; i < 64; i++) {
+      value = prec ? read_2_bytes() : (unsigned int) read_1_byte();
+      hash = ((hash ^ (value >> 8)) * FNV_PRIME) & 0xFFFFFFFFUL;
+      hash = ((hash ^ (value & 0xFF)) * FNV_PRIME) & 0xFFFFFFFFUL;
+    }
+    record.quant_hash[n] = hash;
+    record.quant_defined[n] = 1;
+    length -= count;
+  }
+}
+
+
+static void
+record_COM (void)
+{
+  unsigned int length;
+  size_t needed;
+
+  /* Get the marker parameter length count */
+  length = read_2_bytes();
+  /* Length includes itself, so must be at least 2 */
+  if (length < 2)
+    ERREXIT("Erroneous JPEG marker length");
+  length -= 2;
+
+  needed = comment_buffer_used + 2 + length;
+  if (needed > comment_buffer_size) {
+    comment_buffer_size = needed > 2 * comment_buffer_size ?
+			  needed : 2 * comment_buffer_size;
+    comment_buffer = (unsigned char *)
+      realloc((void *) comment_buffer, comment_buffer_size);
+    if (comment_buffer == NULL)
+      ERREXIT("Insufficient memory");
+  }
+  comment_buffer[comment_buffer_used++] = (unsigned char) (length >> 8);
+  comment_buffer[comment_buffer_used++] = (unsigned char) (length & 0xFF);
+  if (fread((void *) (comment_buffer + comment_buffer_used), 1,
+	    (size_t) length, infile) != (size_t) length)
+    ERREXIT("Premature EOF in JPEG file");
+  comment_buffer_used += length;
+}
+
+
+/*
+ * Parse the marker stream until SOS or EOI is seen, collecting the items
+ * of the record.  Nothing is printed here, so that a damaged file produces
+ * either a complete record or none at all.
+ */
+
+static int
+scan_JPEG_record (void)
+{
+  int marker;
+
+  /* Expect SOI at start of file */
+  if (first_marker() != M_SOI)
+    ERREXIT("Expected SOI marker first");
+
+  /* Scan miscellaneous markers until we reach SOS. */
+  for (;;) {
+    marker = next_marker();
+    switch (marker) {
+    case M_SOF0:		/* Baseline */
+    case M_SOF1:		/* Extended sequential, Huffman */
+    case M_SOF2:		/* Progressive, Huffman */
+    case M_SOF3:		/* Lossless, Huffman */
+    case M_SOF5:		/* Differential sequential, Huffman */
+    case M_SOF6:		/* Differential progressive, Huffman */
+    case M_SOF7:		/* Differential lossless, Huffman */
+    case M_SOF9:		/* Extended sequential, arithmetic */
+    case M_SOF10:		/* Progressive, arithmetic */
+    case M_SOF11:		/* Lossless, arithmetic */
+    case M_SOF13:		/* Differential sequential, arithmetic */
+    case M_SOF14:		/* Differential progressive, arithmetic */
+    case M_SOF15:		/* Differential lossless, arithmetic */
+      record_SOFn(marker);
+      break;
+
+    case M_SOS:			/* stop before hitting compressed data */
+      return marker;
+
+    case M_EOI:			/* in case it's a tables-only JPEG stream */
+      return marker;
+
+    case M_DQT:
+      record_DQT();
+      break;
+
+    case M_COM:
+      record_COM();
+      break;
+
+    default:			/* Anything else just gets skipped */
+      skip_variable();		/* we assume it has a parameter count... */
+      break;
+    }
+  } /* end loop */
+}
+
+
+static void
+print_escaped (const unsigned char * text, size_t length)
+/* Print a name or comment as one record field */
+{
+  int ch;
+  int lastch = 0;
+
+  while (length > 0) {
+    ch = *text++;
+    /* Same conversions as process_COM, but newlines and tabs are escaped */
+    if (ch == '\r') {
+      printf("\\n");
+    } else if (ch == '\n') {
+      if (lastch != '\r')
+	printf("\\n");
+    } else if (ch == '\t') {
+      printf("\\t");
+    } else if (ch == '\\') {
+      printf("\\\\");
+    } else if (isprint(ch)) {
+      putc(ch, stdout);
+    } else {
+      printf("\\%03o", ch);
+    }
+    lastch = ch;
+    length--;
+  }
+}
+
+
+static void
+print_record (const char * name)
+{
+  unsigned char * ptr;
+  size_t length;
+  int ci, tblno;
+
+  print_escaped((const unsigned char *) name, strlen(name));
+
+  if (record.have_frame) {
+    printf("\t%u\t%u\t%d\t%d\tSOF%d\t",
+	   record.image_width, record.image_height, record.num_components,
+	   record.data_precision, record.process - M_SOF0);
+    for (ci = 0; ci < record.num_components; ci++)
+      printf(ci ? ",%dx%d" : "%dx%d",
+	     record.samp_factor[ci] >> 4, record.samp_factor[ci] & 0x0F);
+    putc('\t', stdout);
+    for (ci = 0; ci < record.num_components; ci++) {
+      if (ci)
+	putc(',', stdout);
+      tblno = record.quant_tbl_no[ci];
+      if (tblno < NUM_QUANT_TBLS && record.quant_defined[tblno])
+	printf("%08lx", record.quant_hash[tblno]);
+      else
+	putc('-', stdout);
+    }
+  } else
+    printf("\t-\t-\t-\t-\t-\t-\t-");
+
+  for (ptr = comment_buffer; ptr < comment_buffer + comment_buffer_used;
+       ptr += length) {
+    length = ((size_t) ptr[0] << 8) + ptr[1];
+    ptr += 2;
+    putc('\t', stdout);
+    print_escaped(ptr, length);
+  }
+  putc('\n', stdout);
+}
+
+
+static int
+scan_file (const char * name)
+/* Print the record for one file; returns 0 if it could not be read */
+{
+  jmp_buf error_return;
+  int result;
+
+  if ((infile = fopen(name, READ_BINARY)) == NULL) {
+    fprintf(stderr, "%s: can't open %s\n", progname, name);
+    return 0;
+  }
+  infile_name = name;
+  infile_seekable = (fseek(infile, 0L, SEEK_CUR) == 0);
+  MEMZERO(&record, SIZEOF(record));
+  comment_buffer_used = 0;
+
+  if (setjmp(error_return)) {
+    result = 0;			/* message was printed by error_exit */
+  } else {
+    batch_error = &error_return;
+    (void) scan_JPEG_record();
+    print_record(name);
+    result = 1;
+  }
+  batch_error = NULL;
+  fclose(infile);
+  return result;
+}
+
+
+static int
+scan_file_list (const char * listname)
+/* Scan each file named in a list file, one name per line */
+{
+  FILE * listfile;
+  char * name = NULL;
+  size_t name_size = 0, length;
+  int ch, result = 1;
+
+  if (strcmp(listname, "-") == 0)
+    listfile = stdin;
+  else if ((listfile = fopen(listname, "r")) == NULL) {
+    fprintf(stderr, "%s: can't open %s\n", progname, listname);
+    exit(EXIT_FAILURE);
+  }
+
+  do {
+    length = 0;
+    while ((ch = getc(listfile)) != EOF && ch != '\n') {
+      if (length + 1 >= name_size) {
+	name_size = name_size ? 2 * name_size : 256;
+	if ((name = (char *) realloc((void *) name, name_size)) == NULL)
+	  ERREXIT("Insufficient memory");
+      }
+      name[length++] = (char) ch;
+    }
+    if (length > 0 && name[length-1] == '\r')
+      length--;			/* list was written on DOS */
+    if (length > 0) {
+      name[length] = '\0';
+      if (! scan_file(name))
+	result = 0;
+    }
+  } while (ch != EOF);
+
+  if (listfile != stdin)
+    fclose(listfile);
+  free((void *) name);
+  return result;
+}
+
+
 /*
  * The main program.
  */
@@ -456,6 +833,8 @@ main (int argc, char **argv)
   int argn;
   char * arg;
   int verbose = 0, raw = 0;
+  int batch = 0, result;
+  char * listname = NULL;
 
   /* On Mac, fetch a command line. */
 #ifdef USE_CCOMMAND
@@ -476,10 +855,34 @@ main (int argc, char **argv)
       verbose++;
     } else if (keymatch(arg, "raw", 1)) {
       raw = 1;
+    } else if (keymatch(arg, "batch", 1)) {
+      batch = 1;
+    } else if (keymatch(arg, "files", 1)) {
+      /* List of files to summarize; implies -batch. */
+      if (++argn >= argc)	/* advance to next argument */
+	usage();
+      listname = argv[argn];
+      batch = 1;
     } else
       usage();
   }
 
+  if (batch) {
+    /* Summarize each named file, then each one in the list file. */
+    result = 1;
+    for (; argn < argc; argn++)
+      if (! scan_file(argv[argn]))
+	result = 0;
+    if (listname != NULL && ! scan_file_list(listname))
+      result = 0;
+    fflush(stdout);
+    if (ferror(stdout)) {
+      fprintf(stderr, "%s: can't write output\n", progname);
+      result = 0;
+    }
+    exit(result ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+
   /* Open the input file. */
   /* Unix style: expect zero or one file name */
   if (argn < argc-1) {
@@ -64,8 +64,18 @@ typedef char U_CHAR;
  * process very wide images on a PC, you might have to compile in large-memory
  * model, or else replace fread() with a getc() loop --- which will be much
  * slower.
+ *
+ * For the raw formats we read several rows with each fread() call, as many
+ * as fit in READ_BUFFER_SIZE bytes (but at least one, and at most
+ * MAX_ROWS_PER_READ).  This saves much of the per-row overhead for images
+ * of modest width.
  */
 
+#ifndef READ_BUFFER_SIZE
+#define READ_BUFFER_SIZE  32768L	/* desired size of I/O buffer */
+#endif
+#define MAX_ROWS_PER_READ  16		/* max rows returned by one call */
+
 
 /* Private version of data source object */
 
@@ -73,8 +83,10 @@ typedef struct {
   struct cjpeg_source_struct pub; /* public fields */
 
   U_CHAR *iobuffer;		/* non-FAR pointer to I/O buffer */
-  JSAMPROW pixrow;		/* FAR pointer to same */
-  size_t buffer_width;		/* width of I/O buffer */
+  JSAMPROW pixrow[MAX_ROWS_PER_READ]; /* FAR pointers to rows of same */
+  size_t buffer_width;		/* width of one row in I/O buffer */
+  JDIMENSION rows_per_read;	/* # of rows the I/O buffer holds */
+  JDIMENSION rows_left;		/* # of rows not yet read */
   JSAMPLE *rescale;		/* => maxval-remapping array, or NULL */
 } ppm_source_struct;
 
@@ -127,11 +139,29 @@ read_pbm_integer (j_compress_ptr cinfo, FILE * infile)
 }
 
 
+LOCAL(JDIMENSION)
+read_raw_rows (j_compress_ptr cinfo, ppm_source_ptr source)
+/* Fill the I/O buffer with as many rows as it holds; return the count */
+{
+  JDIMENSION num_rows = source->rows_per_read;
+
+  if (num_rows > source->rows_left)
+    num_rows = source->rows_left;
+  if (! ReadOK(source->pub.input_file, source->iobuffer,
+	       source->buffer_width * num_rows))
+    ERREXIT(cinfo, JERR_INPUT_EOF);
+  source->rows_left -= num_rows;
+  return num_rows;
+}
+
+
 /*
- * Read one row of pixels.
+ * Read one or more rows of pixels.
  *
  * We provide several different versions depending on input file format.
  * In all cases, input is scaled to the size of JSAMPLE.
+ * The text formats return one row per call, the raw formats as many rows
+ * as fit in the I/O buffer.
  *
  * A really fast path is provided for reading byte/sample raw files with
  * maxval = MAXJSAMPLE, which is the normal case for 8-bit data.
@@ -177,51 +207,32 @@ get_text_rgb_row (j_compress_ptr cinfo, cjpeg_source_ptr sinfo)
 
 
 METHODDEF(JDIMENSION)
-get_scaled_gray_row (j_compress_ptr cinfo, cjpeg_source_ptr sinfo)
-/* This version is for reading raw-byte-format PGM files with any maxval */
-{
-  ppm_source_ptr source = (ppm_source_ptr) sinfo;
-  register JSAMPROW ptr;
-  register U_CHAR * bufferptr;
-  register JSAMPLE *rescale = source->rescale;
-  JDIMENSION col;
-
-  if (! ReadOK(source->pub.input_file, source->iobuffer, source->buffer_width))
-    ERREXIT(cinfo, JERR_INPUT_EOF);
-  ptr = source->pub.buffer[0];
-  bufferptr = source->iobuffer;
-  for (col = cinfo->image_width; col > 0; col--) {
-    *ptr++ = rescale[UCH(*bufferptr++)];
-  }
-  return 1;
-}
-
-
-METHODDEF(JDIMENSION)
-get_scaled_rgb_row (j_compress_ptr cinfo, cjpeg_source_ptr sinfo)
-/* This version is for reading raw-byte-format PPM files with any maxval */
+get_scaled_rows (j_compress_ptr cinfo, cjpeg_source_ptr sinfo)
+/* This version is for reading raw-byte-format PPM/PGM files with any maxval.
+ * Each sample is remapped independently, so the same code works for both.
+ */
 {
   ppm_source_ptr source = (ppm_source_ptr) sinfo;
   register JSAMPROW ptr;
   register U_CHAR * bufferptr;
   register JSAMPLE *rescale = source->rescale;
-  JDIMENSION col;
+  register size_t col;
+  JDIMENSION row, num_rows;
 
-  if (! ReadOK(source->pub.input_file, source->iobuffer, source->buffer_width))
-    ERREXIT(cinfo, JERR_INPUT_EOF);
-  ptr = source->pub.buffer[0];
+  num_rows = read_raw_rows(cinfo, source);
   bufferptr = source->iobuffer;
-  for (col = cinfo->image_width; col > 0; col--) {
-    *ptr++ = rescale[UCH(*bufferptr++)];
-    *ptr++ = rescale[UCH(*bufferptr++)];
-    *ptr++ = rescale[UCH(*bufferptr++)];
+  for (row = 0; row < num_rows; row++) {
+    ptr = source->pub.buffer[row];
+    for (col = source->buffer_width; col > 0; col--) {
+      *ptr++ = rescale[UCH(*bufferptr++)];
+    }
   }
-  return 1;
+  return num_rows;
 }
 
 
 METHODDEF(JDIMENSION)
-get_raw_row (j_compress_ptr cinfo, cjpeg_source_ptr sinfo)
+get_raw_rows (j_compress_ptr cinfo, cjpeg_source_ptr sinfo)
 /* This version is for reading raw-byte-format files with maxval = MAXJSAMPLE.
  * In this case we just read right into the JSAMPLE buffer!
  * Note that same code works for PPM and PGM files.
@@ -229,63 +240,33 @@ get_raw_row (j_compress_ptr cinfo, cjpeg_source_ptr sinfo)
 {
   ppm_source_ptr source = (ppm_source_ptr) sinfo;
 
-  if (! ReadOK(source->pub.input_file, source->iobuffer, source->buffer_width))
-    ERREXIT(cinfo, JERR_INPUT_EOF);
-  return 1;
+  return read_raw_rows(cinfo, source);
 }
 
 
 METHODDEF(JDIMENSION)
-get_word_gray_row (j_compress_ptr cinfo, cjpeg_source_ptr sinfo)
-/* This version is for reading raw-word-format PGM files with any maxval */
+get_word_rows (j_compress_ptr cinfo, cjpeg_source_ptr sinfo)
+/* This version is for reading raw-word-format PPM/PGM files with any maxval */
 {
   ppm_source_ptr source = (ppm_source_ptr) sinfo;
   register JSAMPROW ptr;
   register U_CHAR * bufferptr;
   register JSAMPLE *rescale = source->rescale;
-  JDIMENSION col;
+  register int temp;
+  register size_t col;
+  JDIMENSION row, num_rows;
 
-  if (! ReadOK(source->pub.input_file, source->iobuffer, source->buffer_width))
-    ERREXIT(cinfo, JERR_INPUT_EOF);
-  ptr = source->pub.buffer[0];
+  num_rows = read_raw_rows(cinfo, source);
   bufferptr = source->iobuffer;
-  for (col = cinfo->image_width; col > 0; col--) {
-    register int temp;
-    temp  = UCH(*bufferptr++) << 8;
-    temp |= UCH(*bufferptr++);
-    *ptr++ = rescale[temp];
-  }
-  return 1;
-}
-
-
-METHODDEF(JDIMENSION)
-get_word_rgb_row (j_compress_ptr cinfo, cjpeg_source_ptr sinfo)
-/* This version is for reading raw-word-format PPM files with any maxval */
-{
-  ppm_source_ptr source = (ppm_source_ptr) sinfo;
-  register JSAMPROW ptr;
-  register U_CHAR * bufferptr;
-  register JSAMPLE *rescale = source->rescale;
-  JDIMENSION col;
-
-  if (! ReadOK(source->pub.input_file, source->iobuffer, source->buffer_width))
-    ERREXIT(cinfo, JERR_INPUT_EOF);
-  ptr = source->pub.buffer[0];
-  bufferptr = source->iobuffer;
-  for (col = cinfo->image_width; col > 0; col--) {
-    register int temp;
-    temp  = UCH(*bufferptr++) << 8;
-    temp |= UCH(*bufferptr++);
-    *ptr++ = rescale[temp];
-    temp  = UCH(*bufferptr++) << 8;
-    temp |= UCH(*bufferptr++);
-    *ptr++ = rescale[temp];
-    temp  = UCH(*bufferptr++) << 8;
-    temp |= UCH(*bufferptr++);
-    *ptr++ = rescale[temp];
+  for (row = 0; row < num_rows; row++) {
+    ptr = source->pub.buffer[row];
+    for (col = source->buffer_width >> 1; col > 0; col--) {
+      temp  = UCH(*bufferptr++) << 8;
+      temp |= UCH(*bufferptr++);
+      *ptr++ = rescale[temp];
+    }
   }
-  return 1;
+  return num_rows;
 }
 
 
@@ -357,13 +338,13 @@ start_input_ppm (j_compress_ptr cinfo, cjpeg_source_ptr sinfo)
     cinfo->in_color_space = JCS_GRAYSCALE;
     TRACEMS2(cinfo, 1, JTRC_PGM, w, h);
     if (maxval > 255) {
-      source->pub.get_pixel_rows = get_word_gray_row;
+      source->pub.get_pixel_rows = get_word_rows;
     } else if (maxval == MAXJSAMPLE && SIZEOF(JSAMPLE) == SIZEOF(U_CHAR)) {
-      source->pub.get_pixel_rows = get_raw_row;
+      source->pub.get_pixel_rows = get_raw_rows;
       use_raw_buffer = TRUE;
       need_rescale = FALSE;
     } else {
-      source->pub.get_pixel_rows = get_scaled_gray_row;
+      source->pub.get_pixel_rows = get_scaled_rows;
     }
     break;
 
@@ -372,24 +353,33 @@ start_input_ppm (j_compress_ptr cinfo, cjpeg_source_ptr sinfo)
     cinfo->in_color_space = JCS_RGB;
     TRACEMS2(cinfo, 1, JTRC_PPM, w, h);
     if (maxval > 255) {
-      source->pub.get_pixel_rows = get_word_rgb_row;
+      source->pub.get_pixel_rows = get_word_rows;
     } else if (maxval == MAXJSAMPLE && SIZEOF(JSAMPLE) == SIZEOF(U_CHAR)) {
-      source->pub.get_pixel_rows = get_raw_row;
+      source->pub.get_pixel_rows = get_raw_rows;
       use_raw_buffer = TRUE;
       need_rescale = FALSE;
     } else {
-      source->pub.get_pixel_rows = get_scaled_rgb_row;
+      source->pub.get_pixel_rows = get_scaled_rows;
     }
     break;
   }
 
-  /* Allocate space for I/O buffer: 1 or 3 bytes or words/pixel. */
+  /* Allocate space for I/O buffer: 1 or 3 bytes or words/pixel per row. */
+  source->rows_per_read = 1;
   if (need_iobuffer) {
     source->buffer_width = (size_t) w * cinfo->input_components *
       ((maxval<=255) ? SIZEOF(U_CHAR) : (2*SIZEOF(U_CHAR)));
+    if ((long) source->buffer_width < READ_BUFFER_SIZE / MAX_ROWS_PER_READ)
+      source->rows_per_read = MAX_ROWS_PER_READ;
+    else if ((long) source->buffer_width < READ_BUFFER_SIZE)
+      source->rows_per_read =
+	(JDIMENSION) (READ_BUFFER_SIZE / (long) source->buffer_width);
+    if (source->rows_per_read > (JDIMENSION) h)
+      source->rows_per_read = (JDIMENSION) h;
+    source->rows_left = (JDIMENSION) h;
     source->iobuffer = (U_CHAR *)
       (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
-				  source->buffer_width);
+				  source->buffer_width * source->rows_per_read);
   }
 
   /* Create compressor input buffer. */
@@ -397,15 +387,19 @@ start_input_ppm (j_compress_ptr cinfo, cjpeg_source_ptr sinfo)
     /* For unscaled raw-input case, we can just map it onto the I/O buffer. */
     /* Synthesize a JSAMPARRAY pointer structure */
     /* Cast here implies near->far pointer conversion on PCs */
-    source->pixrow = (JSAMPROW) source->iobuffer;
-    source->pub.buffer = & source->pixrow;
-    source->pub.buffer_height = 1;
+    JDIMENSION row;
+
+    for (row = 0; row < source->rows_per_read; row++)
+      source->pixrow[row] = (JSAMPROW)
+	(source->iobuffer + source->buffer_width * row);
+    source->pub.buffer = source->pixrow;
+    source->pub.buffer_height = source->rows_per_read;
   } else {
     /* Need to translate anyway, so make a separate sample buffer. */
     source->pub.buffer = (*cinfo->mem->alloc_sarray)
       ((j_common_ptr) cinfo, JPOOL_IMAGE,
-       (JDIMENSION) w * cinfo->input_components, (JDIMENSION) 1);
-    source->pub.buffer_height = 1;
+       (JDIMENSION) w * cinfo->input_components, source->rows_per_read);
+    source->pub.buffer_height = source->rows_per_read;
   }
 
   /* Compute the rescaling array if required. */
@@ -54,6 +54,7 @@ typedef struct _tga_source_struct {
 
   jvirt_sarray_ptr whole_image;	/* Needed if funny input row order */
   JDIMENSION current_row;	/* Current logical row number to read */
+  long image_offset;		/* File position of first row, if seekable */
 
   /* Pointer to routine to extract next Targa pixel from input file */
   JMETHOD(void, read_pixel, (tga_source_ptr sinfo));
@@ -290,6 +291,30 @@ get_memory_row (j_compress_ptr cinfo, cjpeg_source_ptr sinfo)
 }
 
 
+/*
+ * This method is for reading a bottom-up, non-RLE image from a seekable
+ * file.  Each row has a fixed size, so we can go straight to the next row
+ * in top-down order and avoid buffering the whole image.
+ */
+
+METHODDEF(JDIMENSION)
+get_seek_row (j_compress_ptr cinfo, cjpeg_source_ptr sinfo)
+{
+  tga_source_ptr source = (tga_source_ptr) sinfo;
+  JDIMENSION source_row;
+
+  /* Compute row of source that maps to current_row of normal order */
+  source_row = cinfo->image_height - source->current_row - 1;
+  if (fseek(source->pub.input_file, source->image_offset +
+	    (long) source_row * (long) cinfo->image_width *
+	    (long) source->pixel_size, SEEK_SET) != 0)
+    ERREXIT(cinfo, JERR_INPUT_EOF);
+
+  source->current_row++;
+  return (*source->get_pixel_rows) (cinfo, sinfo);
+}
+
+
 /*
  * This method loads the image into whole_image during the first call on
  * get_pixel_rows.  The get_pixel_rows pointer is then adjusted to call
@@ -419,7 +444,19 @@ start_input_tga (j_compress_ptr cinfo, cjpeg_source_ptr sinfo)
     break;
   }
 
-  if (is_bottom_up) {
+  if (is_bottom_up && source->read_pixel == read_non_rle_pixel &&
+      file_is_seekable(source->pub.input_file)) {
+    /* Read the rows in top-down order directly from the file.
+     * We can't know where the image starts until the header is finished.
+     */
+    source->whole_image = NULL;
+    source->pub.buffer = (*cinfo->mem->alloc_sarray)
+      ((j_common_ptr) cinfo, JPOOL_IMAGE,
+       (JDIMENSION) width * components, (JDIMENSION) 1);
+    source->pub.buffer_height = 1;
+    source->pub.get_pixel_rows = get_seek_row;
+    source->current_row = 0;
+  } else if (is_bottom_up) {
     /* Create a virtual array to buffer the upside-down image. */
     source->whole_image = (*cinfo->mem->request_virt_sarray)
       ((j_common_ptr) cinfo, JPOOL_IMAGE, FALSE,
@@ -458,6 +495,10 @@ start_input_tga (j_compress_ptr cinfo, cjpeg_source_ptr sinfo)
     source->colormap = NULL;
   }
 
+  if (source->pub.get_pixel_rows == get_seek_row &&
+      (source->image_offset = ftell(source->pub.input_file)) < 0)
+    ERREXIT(cinfo, JERR_INPUT_EOF);
+
   cinfo->input_components = components;
   cinfo->data_precision = 8;
   cinfo->image_width = width;
@@ -19,6 +19,7 @@
 
 #include "jinclude.h"
 #include "jpeglib.h"
+#include "jdct.h"		/* for the pixel-domain path of do_move */
 #include "transupp.h"		/* My own external interface */
 #include <ctype.h>		/* to declare isdigit() */
 
@@ -300,6 +301,8 @@ do_drop (j_decompress_ptr srcinfo, j_compress_ptr dstinfo,
 /* Drop.  If the dropinfo component number is smaller than the destination's,
  * we fill in the remaining components with zero.  This provides the feature
  * of dropping grayscale into (arbitrarily sampled) color images.
+ * The source arrays must belong to srcinfo and the drop arrays to dropinfo;
+ * each set is accessed through the memory manager of its owner.
  */
 {
   JDIMENSION comp_width, comp_height;
@@ -321,8 +324,8 @@ do_drop (j_decompress_ptr srcinfo, j_compress_ptr dstinfo,
 	((j_common_ptr) srcinfo, src_coef_arrays[ci], blk_y + y_drop_blocks,
 	 (JDIMENSION) compptr->v_samp_factor, TRUE);
       if (ci < dropinfo->num_components) {
-	src_buffer = (*srcinfo->mem->access_virt_barray)
-	  ((j_common_ptr) srcinfo, drop_coef_arrays[ci], blk_y + y_crop_blocks,
+	src_buffer = (*dropinfo->mem->access_virt_barray)
+	  ((j_common_ptr) dropinfo, drop_coef_arrays[ci], blk_y + y_crop_blocks,
 	   (JDIMENSION) compptr->v_samp_factor, FALSE);
 	for (offset_y = 0; offset_y < compptr->v_samp_factor; offset_y++) {
 	  jcopy_block_row(src_buffer[offset_y] + x_crop_blocks,
@@ -340,6 +343,315 @@ do_drop (j_decompress_ptr srcinfo, j_compress_ptr dstinfo,
 }
 
 
+GLOBAL(void)
+do_scroll (j_decompress_ptr srcinfo, j_compress_ptr dstinfo,
+	   JDIMENSION y_crop_offset, JDIMENSION y1_crop_offset,
+	   jvirt_barray_ptr *src_coef_arrays,
+	   j_decompress_ptr dropinfo, jvirt_barray_ptr *drop_coef_arrays,
+	   JDIMENSION drop_height)
+/* Scroll.  This is a drop of full-width iMCU rows y1_crop_offset ..
+ * y1_crop_offset+drop_height-1 of the unmodified frame (held in the drop
+ * arrays) to rows y_crop_offset .. y_crop_offset+drop_height-1, and gives
+ * the same result as do_drop, provided the affected rows of the source
+ * arrays have not yet been changed from the drop arrays.
+ * When source and destination overlap and the arrays are held in memory,
+ * we just rotate the row pointers of the affected range and then refill
+ * the rows exposed by the move from the drop arrays.
+ */
+{
+  JDIMENSION MCU_cols, comp_width, comp_height, shift_rows;
+  JDIMENSION top_blocks, range_blocks, shift_blocks, fill_blocks, blk_y;
+  int ci, offset_y;
+  boolean down;
+  JBLOCKARRAY src_buffer, dst_buffer;
+  jpeg_component_info *compptr;
+
+  if (y_crop_offset == y1_crop_offset || drop_height == 0)
+    return;
+  down = y_crop_offset > y1_crop_offset;
+  shift_rows = down ? y_crop_offset - y1_crop_offset :
+		      y1_crop_offset - y_crop_offset;
+  MCU_cols = (JDIMENSION) jdiv_round_up((long) dstinfo->jpeg_width,
+    (long) (dstinfo->max_h_samp_factor * dstinfo->min_DCT_h_scaled_size));
+
+  for (ci = 0; ci < dstinfo->num_components; ci++) {
+    compptr = dstinfo->comp_info + ci;
+    comp_width = MCU_cols * compptr->h_samp_factor;
+    comp_height = drop_height * compptr->v_samp_factor;
+    shift_blocks = shift_rows * compptr->v_samp_factor;
+    range_blocks = comp_height + shift_blocks;
+    top_blocks = (down ? y1_crop_offset : y_crop_offset) *
+		 compptr->v_samp_factor;
+    /* Rotation pays only if the moved rows outnumber the exposed ones */
+    if (ci < dropinfo->num_components && shift_rows < drop_height &&
+	(*srcinfo->mem->rotate_virt_barray)
+	  ((j_common_ptr) srcinfo, src_coef_arrays[ci], top_blocks,
+	   range_blocks, down ? comp_height : shift_blocks)) {
+      /* Exposed rows keep their original content */
+      if (! down)
+	top_blocks += comp_height;
+      fill_blocks = shift_blocks;
+      for (blk_y = 0; blk_y < fill_blocks; blk_y += compptr->v_samp_factor) {
+	dst_buffer = (*srcinfo->mem->access_virt_barray)
+	  ((j_common_ptr) srcinfo, src_coef_arrays[ci], top_blocks + blk_y,
+	   (JDIMENSION) compptr->v_samp_factor, TRUE);
+	src_buffer = (*dropinfo->mem->access_virt_barray)
+	  ((j_common_ptr) dropinfo, drop_coef_arrays[ci], top_blocks + blk_y,
+	   (JDIMENSION) compptr->v_samp_factor, FALSE);
+	for (offset_y = 0; offset_y < compptr->v_samp_factor; offset_y++) {
+	  jcopy_block_row(src_buffer[offset_y], dst_buffer[offset_y],
+			  comp_width);
+	}
+      }
+      continue;
+    }
+    /* Otherwise copy the blocks, as do_drop would */
+    for (blk_y = 0; blk_y < comp_height; blk_y += compptr->v_samp_factor) {
+      dst_buffer = (*srcinfo->mem->access_virt_barray)
+	((j_common_ptr) srcinfo, src_coef_arrays[ci],
+	 blk_y + y_crop_offset * compptr->v_samp_factor,
+	 (JDIMENSION) compptr->v_samp_factor, TRUE);
+      if (ci < dropinfo->num_components) {
+	src_buffer = (*dropinfo->mem->access_virt_barray)
+	  ((j_common_ptr) dropinfo, drop_coef_arrays[ci],
+	   blk_y + y1_crop_offset * compptr->v_samp_factor,
+	   (JDIMENSION) compptr->v_samp_factor, FALSE);
+	for (offset_y = 0; offset_y < compptr->v_samp_factor; offset_y++) {
+	  jcopy_block_row(src_buffer[offset_y], dst_buffer[offset_y],
+			  comp_width);
+	}
+      } else {
+	for (offset_y = 0; offset_y < compptr->v_samp_factor; offset_y++) {
+	  FMEMZERO(dst_buffer[offset_y], comp_width * SIZEOF(JBLOCK));
+	}
+      }
+    }
+  }
+}
+
+/*
+ * Support for do_move: decoding and re-encoding single blocks with the
+ * accurate integer DCT, as the library itself would do it.
+ */
+
+typedef struct {
+  JDIMENSION blk_x, blk_y;	/* block held, in component block units */
+  boolean valid;
+  JSAMPLE sample[DCTSIZE][DCTSIZE];
+} move_block_cache;
+
+#define MOVE_CACHE_SIZE  4	/* a shifted block overlaps at most 2x2 */
+
+
+LOCAL(void)
+decode_move_block (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		   JBLOCKROW block, JSAMPLE sample[DCTSIZE][DCTSIZE])
+{
+  JSAMPROW rows[DCTSIZE];
+  int i;
+
+  for (i = 0; i < DCTSIZE; i++)
+    rows[i] = sample[i];
+  jpeg_idct_islow(cinfo, compptr, (JCOEFPTR) block, rows, 0);
+}
+
+
+LOCAL(void)
+encode_move_block (JSAMPLE sample[DCTSIZE][DCTSIZE], JQUANT_TBL * qtbl,
+		   JBLOCKROW block)
+/* Forward DCT and quantization, as in jcdctmgr.c */
+{
+  DCTELEM workspace[DCTSIZE2];
+  JSAMPROW rows[DCTSIZE];
+  register DCTELEM temp, qval;
+  register int i;
+
+  for (i = 0; i < DCTSIZE; i++)
+    rows[i] = sample[i];
+  jpeg_fdct_islow(workspace, rows, 0);
+  for (i = 0; i < DCTSIZE2; i++) {
+    /* Divisors are the quantization values times 8, for the DCT scaling */
+    qval = ((DCTELEM) qtbl->quantval[i]) << 3;
+    temp = workspace[i];
+    if (temp < 0) {
+      temp = -temp;
+      temp += qval>>1;
+      temp = temp >= qval ? temp / qval : 0;
+      temp = -temp;
+    } else {
+      temp += qval>>1;
+      temp = temp >= qval ? temp / qval : 0;
+    }
+    (*block)[i] = (JCOEF) temp;
+  }
+}
+
+
+GLOBAL(void)
+do_move (j_decompress_ptr srcinfo, j_compress_ptr dstinfo,
+	 JDIMENSION x_offset, JDIMENSION y_offset,
+	 jvirt_barray_ptr *src_coef_arrays,
+	 j_decompress_ptr dropinfo, jvirt_barray_ptr *drop_coef_arrays,
+	 JDIMENSION width, JDIMENSION height,
+	 JDIMENSION x1_offset, JDIMENSION y1_offset)
+/* Move with pixel precision.  Like do_drop, this puts the width x height
+ * rectangle at (x1_offset,y1_offset) of the drop image at
+ * (x_offset,y_offset) of the destination, but all of these are measured in
+ * pixels rather than iMCUs.  In each component, blocks lying wholly inside
+ * the destination rectangle are copied as they are if the displacement is
+ * a whole number of that component's blocks.  Only the remaining blocks,
+ * usually those on the rectangle's border, are decoded, merged with the
+ * shifted source samples and re-encoded.
+ * Subsampled components are moved by the displacement scaled down to their
+ * resolution, rounded toward zero; their rectangle covers every sample the
+ * full-resolution rectangle touches.  Requires DCTSIZE x DCTSIZE blocks.
+ */
+{
+  JDIMENSION x0, y0, x1, y1, blk_x, blk_y, dst_cols, dst_rows;
+  JDIMENSION src_cols, src_rows, sx, sy, sbx, sby;
+  long dx, dy, px, py;
+  int ci, k, r, c, victim;
+  boolean inside, aligned, have_src;
+  JBLOCKARRAY src_buffer, dst_buffer;
+  jpeg_component_info *compptr;
+  jpeg_component_info src_comp, dst_comp;
+  JQUANT_TBL *src_qtbl, *dst_qtbl;
+  ISLOW_MULT_TYPE src_mult[DCTSIZE2], dst_mult[DCTSIZE2];
+  JSAMPLE sample[DCTSIZE][DCTSIZE];
+  move_block_cache cache[MOVE_CACHE_SIZE];
+
+  /* The IDCT needs the sample_range_limit table, which a transcoding
+   * decompressor does not set up.
+   */
+  if (srcinfo->sample_range_limit == NULL)
+    srcinfo->sample_range_limit =
+      (JSAMPLE *) jpeg_range_limit_table + (MAXJSAMPLE+1);
+
+  for (ci = 0; ci < dstinfo->num_components; ci++) {
+    compptr = dstinfo->comp_info + ci;
+    /* Rectangles and displacement in component samples */
+    x0 = x_offset * compptr->h_samp_factor / dstinfo->max_h_samp_factor;
+    y0 = y_offset * compptr->v_samp_factor / dstinfo->max_v_samp_factor;
+    /* Round the ends up, so that a sample only partly covered by the
+     * rectangle (odd width on 4:2:0, say) is moved as well
+     */
+    x1 = ((x_offset + width) * compptr->h_samp_factor +
+	  dstinfo->max_h_samp_factor - 1) / dstinfo->max_h_samp_factor;
+    y1 = ((y_offset + height) * compptr->v_samp_factor +
+	  dstinfo->max_v_samp_factor - 1) / dstinfo->max_v_samp_factor;
+    dx = (long) x0 - (long) (x1_offset * compptr->h_samp_factor /
+			     dstinfo->max_h_samp_factor);
+    dy = (long) y0 - (long) (y1_offset * compptr->v_samp_factor /
+			     dstinfo->max_v_samp_factor);
+    dst_cols = (JDIMENSION) jround_up((long) compptr->width_in_blocks,
+				      (long) compptr->h_samp_factor);
+    dst_rows = (JDIMENSION) jround_up((long) compptr->height_in_blocks,
+				      (long) compptr->v_samp_factor);
+    if (x1 > dst_cols * DCTSIZE)
+      x1 = dst_cols * DCTSIZE;
+    if (y1 > dst_rows * DCTSIZE)
+      y1 = dst_rows * DCTSIZE;
+    if (x0 >= x1 || y0 >= y1)
+      continue;
+    aligned = dx % DCTSIZE == 0 && dy % DCTSIZE == 0;
+
+    have_src = ci < dropinfo->num_components;
+    src_cols = src_rows = 0;
+    if (have_src) {
+      src_comp = dropinfo->comp_info[ci];
+      src_cols = (JDIMENSION) jround_up((long) src_comp.width_in_blocks,
+					(long) src_comp.h_samp_factor);
+      src_rows = (JDIMENSION) jround_up((long) src_comp.height_in_blocks,
+					(long) src_comp.v_samp_factor);
+      src_qtbl = src_comp.quant_table;
+      for (k = 0; k < DCTSIZE2; k++)
+	src_mult[k] = (ISLOW_MULT_TYPE) src_qtbl->quantval[k];
+      src_comp.dct_table = (void *) src_mult;
+    }
+    dst_qtbl = dstinfo->quant_tbl_ptrs[compptr->quant_tbl_no];
+    for (k = 0; k < DCTSIZE2; k++)
+      dst_mult[k] = (ISLOW_MULT_TYPE) dst_qtbl->quantval[k];
+    dst_comp = *compptr;
+    dst_comp.dct_table = (void *) dst_mult;
+
+    for (blk_y = y0 / DCTSIZE; blk_y * DCTSIZE < y1; blk_y++) {
+      for (blk_x = x0 / DCTSIZE; blk_x * DCTSIZE < x1; blk_x++) {
+	inside = blk_x * DCTSIZE >= x0 && (blk_x + 1) * DCTSIZE <= x1 &&
+		 blk_y * DCTSIZE >= y0 && (blk_y + 1) * DCTSIZE <= y1;
+	dst_buffer = (*srcinfo->mem->access_virt_barray)
+	  ((j_common_ptr) srcinfo, src_coef_arrays[ci], blk_y,
+	   (JDIMENSION) 1, TRUE);
+	/* Coefficient-domain copy where the grids line up */
+	if (inside && aligned && have_src) {
+	  px = (long) blk_x - dx / DCTSIZE;
+	  py = (long) blk_y - dy / DCTSIZE;
+	  if (px >= 0 && py >= 0 &&
+	      px < (long) src_cols && py < (long) src_rows) {
+	    src_buffer = (*dropinfo->mem->access_virt_barray)
+	      ((j_common_ptr) dropinfo, drop_coef_arrays[ci], (JDIMENSION) py,
+	       (JDIMENSION) 1, FALSE);
+	    jcopy_block_row(src_buffer[0] + px, dst_buffer[0] + blk_x,
+			    (JDIMENSION) 1);
+	    continue;
+	  }
+	}
+	/* Otherwise merge in the pixel domain */
+	if (! inside)
+	  decode_move_block(srcinfo, &dst_comp, dst_buffer[0] + blk_x, sample);
+	for (k = 0; k < MOVE_CACHE_SIZE; k++)
+	  cache[k].valid = FALSE;
+	victim = 0;
+	for (r = 0; r < DCTSIZE; r++) {
+	  py = (long) (blk_y * DCTSIZE + r);
+	  if (py < (long) y0 || py >= (long) y1)
+	    continue;
+	  for (c = 0; c < DCTSIZE; c++) {
+	    px = (long) (blk_x * DCTSIZE + c);
+	    if (px < (long) x0 || px >= (long) x1)
+	      continue;
+	    if (! have_src) {
+	      sample[r][c] = CENTERJSAMPLE;
+	      continue;
+	    }
+	    /* Source sample, clamped to the source's block array */
+	    px -= dx;
+	    py = (long) (blk_y * DCTSIZE + r) - dy;
+	    sx = px < 0 ? 0 : px >= (long) (src_cols * DCTSIZE) ?
+		 src_cols * DCTSIZE - 1 : (JDIMENSION) px;
+	    sy = py < 0 ? 0 : py >= (long) (src_rows * DCTSIZE) ?
+		 src_rows * DCTSIZE - 1 : (JDIMENSION) py;
+	    sbx = sx / DCTSIZE;
+	    sby = sy / DCTSIZE;
+	    for (k = 0; k < MOVE_CACHE_SIZE; k++)
+	      if (cache[k].valid &&
+		  cache[k].blk_x == sbx && cache[k].blk_y == sby)
+		break;
+	    if (k == MOVE_CACHE_SIZE) {
+	      k = victim;
+	      victim = (victim + 1) % MOVE_CACHE_SIZE;
+	      src_buffer = (*dropinfo->mem->access_virt_barray)
+		((j_common_ptr) dropinfo, drop_coef_arrays[ci], sby,
+		 (JDIMENSION) 1, FALSE);
+	      decode_move_block(srcinfo, &src_comp, src_buffer[0] + sbx,
+				cache[k].sample);
+	      cache[k].blk_x = sbx;
+	      cache[k].blk_y = sby;
+	      cache[k].valid = TRUE;
+	    }
+	    sample[r][c] = cache[k].sample[sy % DCTSIZE][sx % DCTSIZE];
+	  }
+	}
+	/* The destination row may have moved while reading the source */
+	dst_buffer = (*srcinfo->mem->access_virt_barray)
+	  ((j_common_ptr) srcinfo, src_coef_arrays[ci], blk_y,
+	   (JDIMENSION) 1, TRUE);
+	encode_move_block(sample, dst_qtbl, dst_buffer[0] + blk_x);
+      }
+    }
+  }
+}
+
+
 LOCAL(void)
 do_crop (j_decompress_ptr srcinfo, j_compress_ptr dstinfo,
 	 JDIMENSION x_crop_offset, JDIMENSION y_crop_offset,
@@ -190,6 +190,19 @@ EXTERN(void) do_drop (j_decompress_ptr srcinfo, j_compress_ptr dstinfo,
 	 jvirt_barray_ptr *src_coef_arrays,
 	 j_decompress_ptr dropinfo, jvirt_barray_ptr *drop_coef_arrays,
 	 JDIMENSION drop_width, JDIMENSION drop_height, JDIMENSION x1_crop_offset, JDIMENSION y1_crop_offset);
+/* Lossless vertical scroll of full-width iMCU rows within the frame */
+EXTERN(void) do_scroll (j_decompress_ptr srcinfo, j_compress_ptr dstinfo,
+	 JDIMENSION y_crop_offset, JDIMENSION y1_crop_offset,
+	 jvirt_barray_ptr *src_coef_arrays,
+	 j_decompress_ptr dropinfo, jvirt_barray_ptr *drop_coef_arrays,
+	 JDIMENSION drop_height);
+/* Move at pixel offsets, re-encoding only blocks off the block grid */
+EXTERN(void) do_move (j_decompress_ptr srcinfo, j_compress_ptr dstinfo,
+	 JDIMENSION x_offset, JDIMENSION y_offset,
+	 jvirt_barray_ptr *src_coef_arrays,
+	 j_decompress_ptr dropinfo, jvirt_barray_ptr *drop_coef_arrays,
+	 JDIMENSION width, JDIMENSION height,
+	 JDIMENSION x1_offset, JDIMENSION y1_offset);
 /* Determine whether lossless transformation is perfectly
  * possible for a specified image and transformation.
  */
@@ -33,10 +33,13 @@
 
 /*
  * Since BMP stores scanlines bottom-to-top, we have to invert the image
- * from JPEG's top-to-bottom order.  To do this, we save the outgoing data
- * in a virtual array during put_pixel_row calls, then actually emit the
- * BMP file during finish_output.  The virtual array contains one JSAMPLE per
- * pixel if the output is grayscale or colormapped, three if it is full color.
+ * from JPEG's top-to-bottom order.  If the output file is seekable, we
+ * write the header during start_output and then store each row directly
+ * at its final position in the file as it arrives.  Otherwise we save the
+ * outgoing data in a virtual array during put_pixel_row calls, then actually
+ * emit the BMP file during finish_output.  The virtual array contains one
+ * JSAMPLE per pixel if the output is grayscale or colormapped, three if it
+ * is full color.
  */
 
 /* Private version of data destination object */
@@ -46,11 +49,14 @@ typedef struct {
 
   boolean is_os2;		/* saves the OS2 format request flag */
 
+  boolean use_inversion_array;	/* TRUE to buffer the image until the end */
   jvirt_sarray_ptr whole_image;	/* needed to reverse row order */
+  JSAMPROW iobuffer;		/* holds one row when writing in place */
+  long image_offset;		/* file position of the bottom row */
   JDIMENSION data_width;	/* JSAMPLEs per row */
   JDIMENSION row_width;		/* physical width of one row in the BMP file */
   int pad_bytes;		/* number of padding bytes needed per row */
-  JDIMENSION cur_output_row;	/* next row# to write to virtual array */
+  JDIMENSION cur_output_row;	/* next row# to write */
 } bmp_dest_struct;
 
 typedef bmp_dest_struct * bmp_dest_ptr;
@@ -62,6 +68,47 @@ LOCAL(void) write_colormap
 	     int map_colors, int map_entry_size));
 
 
+/*
+ * Get the buffer for the next output row: either the next row of the
+ * virtual array, or the I/O buffer if rows are written in place.
+ */
+
+LOCAL(JSAMPROW)
+get_output_row (j_decompress_ptr cinfo, bmp_dest_ptr dest)
+{
+  JSAMPARRAY image_ptr;
+
+  if (! dest->use_inversion_array)
+    return dest->iobuffer;
+  /* Access next row in virtual array */
+  image_ptr = (*cinfo->mem->access_virt_sarray)
+    ((j_common_ptr) cinfo, dest->whole_image,
+     dest->cur_output_row, (JDIMENSION) 1, TRUE);
+  return image_ptr[0];
+}
+
+
+/*
+ * Store the completed row in the I/O buffer at its place in the file.
+ * Row N (counting from the top) is the (output_height-1-N)'th one in the file.
+ */
+
+LOCAL(void)
+write_row_in_place (j_decompress_ptr cinfo, bmp_dest_ptr dest)
+{
+  FILE * outfile = dest->pub.output_file;
+  long offset;
+
+  offset = dest->image_offset + (long) dest->row_width *
+    (long) (cinfo->output_height - 1 - dest->cur_output_row);
+  if (fseek(outfile, offset, SEEK_SET) != 0)
+    ERREXIT(cinfo, JERR_FILE_WRITE);
+  if (JFWRITE(outfile, dest->iobuffer, dest->row_width) !=
+      (size_t) dest->row_width)
+    ERREXIT(cinfo, JERR_FILE_WRITE);
+}
+
+
 /*
  * Write some pixel data.
  * In this module rows_supplied will always be 1.
@@ -73,22 +120,15 @@ put_pixel_rows (j_decompress_ptr cinfo, djpeg_dest_ptr dinfo,
 /* This version is for writing 24-bit pixels */
 {
   bmp_dest_ptr dest = (bmp_dest_ptr) dinfo;
-  JSAMPARRAY image_ptr;
   register JSAMPROW inptr, outptr;
   register JDIMENSION col;
   int pad;
 
-  /* Access next row in virtual array */
-  image_ptr = (*cinfo->mem->access_virt_sarray)
-    ((j_common_ptr) cinfo, dest->whole_image,
-     dest->cur_output_row, (JDIMENSION) 1, TRUE);
-  dest->cur_output_row++;
-
   /* Transfer data.  Note destination values must be in BGR order
    * (even though Microsoft's own documents say the opposite).
    */
   inptr = dest->pub.buffer[0];
-  outptr = image_ptr[0];
+  outptr = get_output_row(cinfo, dest);
   for (col = cinfo->output_width; col > 0; col--) {
     outptr[2] = *inptr++;	/* can omit GETJSAMPLE() safely */
     outptr[1] = *inptr++;
@@ -100,6 +140,10 @@ put_pixel_rows (j_decompress_ptr cinfo, djpeg_dest_ptr dinfo,
   pad = dest->pad_bytes;
   while (--pad >= 0)
     *outptr++ = 0;
+
+  if (! dest->use_inversion_array)
+    write_row_in_place(cinfo, dest);
+  dest->cur_output_row++;
 }
 
 METHODDEF(void)
@@ -108,20 +152,13 @@ put_gray_rows (j_decompress_ptr cinfo, djpeg_dest_ptr dinfo,
 /* This version is for grayscale OR quantized color output */
 {
   bmp_dest_ptr dest = (bmp_dest_ptr) dinfo;
-  JSAMPARRAY image_ptr;
   register JSAMPROW inptr, outptr;
   register JDIMENSION col;
   int pad;
 
-  /* Access next row in virtual array */
-  image_ptr = (*cinfo->mem->access_virt_sarray)
-    ((j_common_ptr) cinfo, dest->whole_image,
-     dest->cur_output_row, (JDIMENSION) 1, TRUE);
-  dest->cur_output_row++;
-
   /* Transfer data. */
   inptr = dest->pub.buffer[0];
-  outptr = image_ptr[0];
+  outptr = get_output_row(cinfo, dest);
   for (col = cinfo->output_width; col > 0; col--) {
     *outptr++ = *inptr++;	/* can omit GETJSAMPLE() safely */
   }
@@ -130,27 +167,15 @@ put_gray_rows (j_decompress_ptr cinfo, djpeg_dest_ptr dinfo,
   pad = dest->pad_bytes;
   while (--pad >= 0)
     *outptr++ = 0;
-}
-
-
-/*
- * Startup: normally writes the file header.
- * In this module we may as well postpone everything until finish_output.
- */
 
-METHODDEF(void)
-start_output_bmp (j_decompress_ptr cinfo, djpeg_dest_ptr dinfo)
-{
-  /* no work here */
+  if (! dest->use_inversion_array)
+    write_row_in_place(cinfo, dest);
+  dest->cur_output_row++;
 }
 
 
 /*
- * Finish up at the end of the file.
- *
- * Here is where we really output the BMP file.
- *
- * First, routines to write the Windows and OS/2 variants of the file header.
+ * Routines to write the Windows and OS/2 variants of the file header.
  */
 
 LOCAL(void)
@@ -340,6 +365,37 @@ write_colormap (j_decompress_ptr cinfo, bmp_dest_ptr dest,
 }
 
 
+/*
+ * Startup: write the file header if the rows are to be written in place.
+ * Otherwise we may as well postpone everything until finish_output.
+ */
+
+METHODDEF(void)
+start_output_bmp (j_decompress_ptr cinfo, djpeg_dest_ptr dinfo)
+{
+  bmp_dest_ptr dest = (bmp_dest_ptr) dinfo;
+
+  if (dest->use_inversion_array)
+    return;
+
+  /* Write the header and colormap; the image data follows */
+  if (dest->is_os2)
+    write_os2_header(cinfo, dest);
+  else
+    write_bmp_header(cinfo, dest);
+  dest->image_offset = ftell(dest->pub.output_file);
+  if (dest->image_offset < 0)
+    ERREXIT(cinfo, JERR_FILE_WRITE);
+}
+
+
+/*
+ * Finish up at the end of the file.
+ *
+ * Unless the rows were written in place, here is where we really
+ * output the BMP file.
+ */
+
 METHODDEF(void)
 finish_output_bmp (j_decompress_ptr cinfo, djpeg_dest_ptr dinfo)
 {
@@ -351,6 +407,17 @@ finish_output_bmp (j_decompress_ptr cinfo, djpeg_dest_ptr dinfo)
   register JDIMENSION col;
   cd_progress_ptr progress = (cd_progress_ptr) cinfo->progress;
 
+  if (! dest->use_inversion_array) {
+    /* Leave the file positioned after the image */
+    if (fseek(outfile, dest->image_offset + (long) dest->row_width *
+	      (long) cinfo->output_height, SEEK_SET) != 0)
+      ERREXIT(cinfo, JERR_FILE_WRITE);
+    fflush(outfile);
+    if (ferror(outfile))
+      ERREXIT(cinfo, JERR_FILE_WRITE);
+    return;
+  }
+
   /* Write the header and colormap */
   if (dest->is_os2)
     write_os2_header(cinfo, dest);
@@ -384,10 +451,12 @@ finish_output_bmp (j_decompress_ptr cinfo, djpeg_dest_ptr dinfo)
 
 /*
  * The module selection routine for BMP format output.
+ * Pass use_inversion_array = TRUE unless the output file supports seeking.
  */
 
 GLOBAL(djpeg_dest_ptr)
-jinit_write_bmp (j_decompress_ptr cinfo, boolean is_os2)
+jinit_write_bmp (j_decompress_ptr cinfo, boolean is_os2,
+		 boolean use_inversion_array)
 {
   bmp_dest_ptr dest;
   JDIMENSION row_width;
@@ -399,6 +468,7 @@ jinit_write_bmp (j_decompress_ptr cinfo, boolean is_os2)
   dest->pub.start_output = start_output_bmp;
   dest->pub.finish_output = finish_output_bmp;
   dest->is_os2 = is_os2;
+  dest->use_inversion_array = use_inversion_array;
 
   if (cinfo->out_color_space == JCS_GRAYSCALE) {
     dest->pub.put_pixel_rows = put_gray_rows;
@@ -421,15 +491,21 @@ jinit_write_bmp (j_decompress_ptr cinfo, boolean is_os2)
   dest->row_width = row_width;
   dest->pad_bytes = (int) (row_width - dest->data_width);
 
-  /* Allocate space for inversion array, prepare for write pass */
-  dest->whole_image = (*cinfo->mem->request_virt_sarray)
-    ((j_common_ptr) cinfo, JPOOL_IMAGE, FALSE,
-     row_width, cinfo->output_height, (JDIMENSION) 1);
-  dest->cur_output_row = 0;
-  if (cinfo->progress != NULL) {
-    cd_progress_ptr progress = (cd_progress_ptr) cinfo->progress;
-    progress->total_extra_passes++; /* count file input as separate pass */
+  if (use_inversion_array) {
+    /* Allocate space for inversion array, prepare for write pass */
+    dest->whole_image = (*cinfo->mem->request_virt_sarray)
+      ((j_common_ptr) cinfo, JPOOL_IMAGE, FALSE,
+       row_width, cinfo->output_height, (JDIMENSION) 1);
+    if (cinfo->progress != NULL) {
+      cd_progress_ptr progress = (cd_progress_ptr) cinfo->progress;
+      progress->total_extra_passes++; /* count file input as separate pass */
+    }
+  } else {
+    /* Just one row is needed to assemble the output */
+    dest->iobuffer = (JSAMPROW) (*cinfo->mem->alloc_small)
+      ((j_common_ptr) cinfo, JPOOL_IMAGE, (size_t) row_width);
   }
+  dest->cur_output_row = 0;
 
   /* Create decompressor output buffer. */
   dest->pub.buffer = (*cinfo->mem->alloc_sarray)
@@ -6,12 +6,9 @@
  * For conditions of distribution and use, see the accompanying README file.
  *
  * This file contains routines to write output images in GIF format.
- *
- **************************************************************************
- * NOTE: to avoid entanglements with Unisys' patent on LZW compression,   *
- * this code has been modified to output "uncompressed GIF" files.        *
- * There is no trace of the LZW algorithm in this file.                   *
- **************************************************************************
+ * Either LZW-compressed or "uncompressed" GIF files can be written.
+ * The latter use no LZW string table at all; they are larger, but were
+ * the only kind produced while the Unisys LZW patent was in force.
  *
  * These routines may need modification for non-Unix environments or
  * specialized applications.  As they stand, they assume output to
@@ -42,6 +39,27 @@
 #ifdef GIF_SUPPORTED
 
 
+#define	MAX_LZW_BITS	12	/* maximum LZW code size (4096 symbols) */
+
+typedef INT16 code_int;		/* must hold -1 .. 2**MAX_LZW_BITS */
+
+#define LZW_TABLE_SIZE	((code_int) 1 << MAX_LZW_BITS)
+
+#define HSIZE		5003	/* hash table size for 80% occupancy */
+
+typedef int hash_int;		/* must hold -2*HSIZE..2*HSIZE */
+
+/*
+ * The LZW string table is a hash table indexed by (prefix code, suffix
+ * byte); each entry holds the code assigned to that string.  We check a
+ * hit by comparing the stored prefix/suffix pair, packed into one value.
+ */
+
+typedef INT32 hash_entry;	/* must hold (code_int<<8) | byte */
+
+#define HASH_ENTRY(prefix,suffix)  ((((hash_entry) (prefix)) << 8) | (suffix))
+
+
 /* Private version of data destination object */
 
 typedef struct {
@@ -51,14 +69,25 @@ typedef struct {
 
   /* State for packing variable-width codes into a bitstream */
   int n_bits;			/* current number of bits/code */
-  int maxcode;			/* maximum code, given n_bits */
+  code_int maxcode;		/* maximum code, given n_bits */
+  int init_bits;		/* initial n_bits ... restored after clear */
   INT32 cur_accum;		/* holds bits not yet output */
   int cur_bits;			/* # of bits in cur_accum */
 
   /* State for GIF code assignment */
-  int ClearCode;		/* clear code (doesn't change) */
-  int EOFCode;			/* EOF code (ditto) */
-  int code_counter;		/* counts output symbols */
+  code_int ClearCode;		/* clear code (doesn't change) */
+  code_int EOFCode;		/* EOF code (ditto) */
+  code_int code_counter;	/* counts output symbols (uncompressed GIF) */
+
+  /* LZW string construction */
+  boolean is_lzw;		/* TRUE for LZW compression, FALSE for none */
+  code_int free_code;		/* first not-yet-used symbol code */
+  code_int waiting_code;	/* symbol not yet output; may be extendable */
+  boolean first_byte;		/* if TRUE, waiting_code is not valid */
+
+  /* Hash table for finding symbols for strings already in the table */
+  code_int *hash_code;		/* => hash table of symbol codes */
+  hash_entry FAR *hash_value;	/* => hash table of prefix/suffix values */
 
   /* GIF data packet construction buffer */
   int bytesinpkt;		/* # of bytes in current packet */
@@ -102,7 +131,7 @@ flush_packet (gif_dest_ptr dinfo)
 /* Routine to convert variable-width codes into a byte stream */
 
 LOCAL(void)
-output (gif_dest_ptr dinfo, int code)
+output (gif_dest_ptr dinfo, code_int code)
 /* Emit a code of n_bits bits */
 /* Uses cur_accum and cur_bits to reblock into 8-bit bytes */
 {
@@ -114,10 +143,178 @@ output (gif_dest_ptr dinfo, int code)
     dinfo->cur_accum >>= 8;
     dinfo->cur_bits -= 8;
   }
+
+  /*
+   * If the next entry is going to be too big for the code size,
+   * then increase it, if possible.  We do this here to ensure
+   * that it's done in sync with the decoder's codesize increases.
+   */
+  if (dinfo->is_lzw && dinfo->free_code > dinfo->maxcode) {
+    dinfo->n_bits++;
+    if (dinfo->n_bits == MAX_LZW_BITS)
+      dinfo->maxcode = LZW_TABLE_SIZE; /* free_code will never exceed */
+    else
+      dinfo->maxcode = MAXCODE(dinfo->n_bits);
+  }
+}
+
+
+/* The LZW algorithm proper */
+
+
+LOCAL(void)
+clear_hash (gif_dest_ptr dinfo)
+/* Fill the hash table with empty entries */
+{
+  /* It's sufficient to zero hash_code[] */
+  MEMZERO(dinfo->hash_code, HSIZE * SIZEOF(code_int));
+}
+
+
+LOCAL(void)
+clear_block (gif_dest_ptr dinfo)
+/* Reset compressor and issue a Clear code */
+{
+  clear_hash(dinfo);			/* delete all the symbols */
+  dinfo->free_code = dinfo->ClearCode + 2;
+  output(dinfo, dinfo->ClearCode);	/* inform decoder */
+  dinfo->n_bits = dinfo->init_bits;	/* reset code size */
+  dinfo->maxcode = MAXCODE(dinfo->n_bits);
+}
+
+
+LOCAL(void)
+compress_init (gif_dest_ptr dinfo, int i_bits)
+/* Initialize compressor */
+{
+  /* init all the state variables */
+  dinfo->n_bits = dinfo->init_bits = i_bits;
+  dinfo->maxcode = MAXCODE(dinfo->n_bits);
+  dinfo->ClearCode = ((code_int) 1 << (i_bits - 1));
+  dinfo->EOFCode = dinfo->ClearCode + 1;
+  dinfo->code_counter = dinfo->free_code = dinfo->ClearCode + 2;
+  dinfo->first_byte = TRUE;	/* no waiting symbol yet */
+  /* init output buffering vars */
+  dinfo->bytesinpkt = 0;
+  dinfo->cur_accum = 0;
+  dinfo->cur_bits = 0;
+  /* clear hash table */
+  if (dinfo->is_lzw)
+    clear_hash(dinfo);
+  /* GIF specifies an initial Clear code */
+  output(dinfo, dinfo->ClearCode);
+}
+
+
+/*
+ * Compress a row of pixels.
+ * We use the hashing scheme of "compress": the hash index is formed from
+ * the suffix byte and the prefix code, and collisions are resolved by
+ * secondary probing with a displacement derived from the first index.
+ * The whole row is processed in one loop, which keeps the current string's
+ * code and the bit accumulator in local variables; only finished bytes are
+ * stored into the packet buffer.
+ */
+
+LOCAL(void)
+compress_row (gif_dest_ptr dinfo, JSAMPROW ptr, JDIMENSION width)
+{
+  register code_int *hash_code = dinfo->hash_code;
+  register hash_entry FAR *hash_value = dinfo->hash_value;
+  register hash_int i;
+  register hash_int disp;
+  register hash_entry probe_value;
+  register code_int waiting_code;
+  register int c;
+  register INT32 cur_accum;
+  register int cur_bits;
+
+  if (width == 0)
+    return;
+  if (dinfo->first_byte) {	/* need to initialize waiting_code */
+    dinfo->waiting_code = (code_int) GETJSAMPLE(*ptr++);
+    dinfo->first_byte = FALSE;
+    width--;
+  }
+  waiting_code = dinfo->waiting_code;
+  cur_accum = dinfo->cur_accum;
+  cur_bits = dinfo->cur_bits;
+
+  for (; width > 0; width--) {
+    c = GETJSAMPLE(*ptr++);
+
+    /* Probe hash table to see if a symbol exists for
+     * waiting_code followed by c.
+     * If so, replace waiting_code by that symbol and continue.
+     */
+    i = ((hash_int) c << (MAX_LZW_BITS-8)) + waiting_code;
+    /* i is less than twice 2**MAX_LZW_BITS, therefore less than twice HSIZE */
+    if (i >= HSIZE)
+      i -= HSIZE;
+
+    probe_value = HASH_ENTRY(waiting_code, c);
+
+    if (hash_code[i] != 0) {	/* is first probed slot empty? */
+      if (hash_value[i] == probe_value) {
+	waiting_code = hash_code[i];
+	continue;
+      }
+      if (i == 0)		/* secondary hash (after G. Knott) */
+	disp = 1;
+      else
+	disp = HSIZE - i;
+      for (;;) {
+	i -= disp;
+	if (i < 0)
+	  i += HSIZE;
+	if (hash_code[i] == 0)
+	  break;		/* hit empty slot */
+	if (hash_value[i] == probe_value)
+	  break;		/* found the string */
+      }
+      if (hash_code[i] != 0) {
+	waiting_code = hash_code[i];
+	continue;
+      }
+    }
+
+    /* here when hashtable[i] is an empty slot; desired symbol not in table */
+    /* Emit waiting_code; this is output() with the bit buffer in registers */
+    cur_accum |= ((INT32) waiting_code) << cur_bits;
+    cur_bits += dinfo->n_bits;
+    while (cur_bits >= 8) {
+      CHAR_OUT(dinfo, cur_accum & 0xFF);
+      cur_accum >>= 8;
+      cur_bits -= 8;
+    }
+    if (dinfo->free_code > dinfo->maxcode) {
+      dinfo->n_bits++;
+      if (dinfo->n_bits == MAX_LZW_BITS)
+	dinfo->maxcode = LZW_TABLE_SIZE; /* free_code will never exceed */
+      else
+	dinfo->maxcode = MAXCODE(dinfo->n_bits);
+    }
+
+    if (dinfo->free_code < LZW_TABLE_SIZE) {
+      hash_code[i] = dinfo->free_code++; /* add symbol to hashtable */
+      hash_value[i] = probe_value;
+    } else {
+      dinfo->cur_accum = cur_accum;
+      dinfo->cur_bits = cur_bits;
+      clear_block(dinfo);
+      cur_accum = dinfo->cur_accum;
+      cur_bits = dinfo->cur_bits;
+    }
+    waiting_code = (code_int) c;
+  }
+
+  dinfo->waiting_code = waiting_code;
+  dinfo->cur_accum = cur_accum;
+  dinfo->cur_bits = cur_bits;
 }
 
 
-/* The pseudo-compression algorithm.
+/* The pseudo-compression algorithm, used for uncompressed GIF.
  *
  * In this module we simply output each pixel value as a separate symbol;
  * thus, no compression occurs.  In fact, there is expansion of one bit per
@@ -139,25 +336,6 @@ output (gif_dest_ptr dinfo, int code)
  * one symbol in every 256.
  */
 
-LOCAL(void)
-compress_init (gif_dest_ptr dinfo, int i_bits)
-/* Initialize pseudo-compressor */
-{
-  /* init all the state variables */
-  dinfo->n_bits = i_bits;
-  dinfo->maxcode = MAXCODE(dinfo->n_bits);
-  dinfo->ClearCode = (1 << (i_bits - 1));
-  dinfo->EOFCode = dinfo->ClearCode + 1;
-  dinfo->code_counter = dinfo->ClearCode + 2;
-  /* init output buffering vars */
-  dinfo->bytesinpkt = 0;
-  dinfo->cur_accum = 0;
-  dinfo->cur_bits = 0;
-  /* GIF specifies an initial Clear code */
-  output(dinfo, dinfo->ClearCode);
-}
-
-
 LOCAL(void)
 compress_pixel (gif_dest_ptr dinfo, int c)
 /* Accept and "compress" one pixel value.
@@ -165,7 +343,7 @@ compress_pixel (gif_dest_ptr dinfo, int c)
  */
 {
   /* Output the given pixel value as a symbol. */
-  output(dinfo, c);
+  output(dinfo, (code_int) c);
   /* Issue Clear codes often enough to keep the reader from ratcheting up
    * its symbol size.
    */
@@ -182,6 +360,9 @@ LOCAL(void)
 compress_term (gif_dest_ptr dinfo)
 /* Clean up at end */
 {
+  /* Flush out the buffered LZW code */
+  if (dinfo->is_lzw && ! dinfo->first_byte)
+    output(dinfo, dinfo->waiting_code);
   /* Send an EOF code */
   output(dinfo, dinfo->EOFCode);
   /* Flush the bit-packing buffer */
@@ -289,7 +470,7 @@ emit_header (gif_dest_ptr dinfo, int num_colors, JSAMPARRAY colormap)
   /* Write Initial Code Size byte */
   putc(InitCodeSize, dinfo->pub.output_file);
 
-  /* Initialize for "compression" of image data */
+  /* Initialize for compression of image data */
   compress_init(dinfo, InitCodeSize+1);
 }
 
@@ -324,6 +505,10 @@ put_pixel_rows (j_decompress_ptr cinfo, djpeg_dest_ptr dinfo,
   register JDIMENSION col;
 
   ptr = dest->pub.buffer[0];
+  if (dest->is_lzw) {
+    compress_row(dest, ptr, cinfo->output_width);
+    return;
+  }
   for (col = cinfo->output_width; col > 0; col--) {
     compress_pixel(dest, GETJSAMPLE(*ptr++));
   }
@@ -339,7 +524,7 @@ finish_output_gif (j_decompress_ptr cinfo, djpeg_dest_ptr dinfo)
 {
   gif_dest_ptr dest = (gif_dest_ptr) dinfo;
 
-  /* Flush "compression" mechanism */
+  /* Flush compression mechanism */
   compress_term(dest);
   /* Write a zero-length data block to end the series */
   putc(0, dest->pub.output_file);
@@ -357,7 +542,7 @@ finish_output_gif (j_decompress_ptr cinfo, djpeg_dest_ptr dinfo)
  */
 
 GLOBAL(djpeg_dest_ptr)
-jinit_write_gif (j_decompress_ptr cinfo)
+jinit_write_gif (j_decompress_ptr cinfo, boolean is_lzw)
 {
   gif_dest_ptr dest;
 
@@ -369,6 +554,7 @@ jinit_write_gif (j_decompress_ptr cinfo)
   dest->pub.start_output = start_output_gif;
   dest->pub.put_pixel_rows = put_pixel_rows;
   dest->pub.finish_output = finish_output_gif;
+  dest->is_lzw = is_lzw;
 
   if (cinfo->out_color_space != JCS_GRAYSCALE &&
       cinfo->out_color_space != JCS_RGB)
@@ -393,6 +579,16 @@ jinit_write_gif (j_decompress_ptr cinfo)
     ((j_common_ptr) cinfo, JPOOL_IMAGE, cinfo->output_width, (JDIMENSION) 1);
   dest->pub.buffer_height = 1;
 
+  if (is_lzw) {
+    /* Allocate space for hash table */
+    dest->hash_code = (code_int *)
+      (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+				  HSIZE * SIZEOF(code_int));
+    dest->hash_value = (hash_entry FAR *)
+      (*cinfo->mem->alloc_large) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+				  HSIZE * SIZEOF(hash_entry));
+  }
+
   return (djpeg_dest_ptr) dest;
 }
 
@@ -9,6 +9,12 @@
  * user-supplied text as a COM (comment) marker in a JFIF file.
  * This may be useful as an example of the minimum logic needed to parse
  * JPEG markers.
+ *
+ * The comment can also be updated in place, without copying the rest of
+ * the file, if there is room for it ahead of the SOFn marker.  Room is
+ * provided by fill bytes (extra 0xFF bytes before a marker, which any JPEG
+ * decoder must skip) and, with -replace, by the old COM markers.  The -pad
+ * switch reserves fill bytes for this purpose when a file is written.
  */
 
 #define JPEG_CJPEG_DJPEG	/* to get the command-line config symbols */
@@ -16,6 +22,7 @@
 
 #ifndef HAVE_STDLIB_H		/* <stdlib.h> should declare malloc() */
 extern void * malloc ();
+extern void * realloc ();
 #endif
 #include <ctype.h>		/* to declare isupper(), tolower() */
 #ifdef USE_SETMODE
@@ -37,13 +44,16 @@ extern void * malloc ();
 #ifdef DONT_USE_B_MODE		/* define mode parameters for fopen() */
 #define READ_BINARY	"r"
 #define WRITE_BINARY	"w"
+#define UPDATE_BINARY	"r+"
 #else
 #ifdef VMS			/* VMS is very nonstandard */
 #define READ_BINARY	"rb", "ctx=stm"
 #define WRITE_BINARY	"wb", "ctx=stm"
+#define UPDATE_BINARY	"r+b", "ctx=stm"
 #else				/* standard ANSI-compliant case */
 #define READ_BINARY	"rb"
 #define WRITE_BINARY	"wb"
+#define UPDATE_BINARY	"r+b"
 #endif
 #endif
 
@@ -66,6 +76,12 @@ extern void * malloc ();
 #define MAX_COM_LENGTH 65000L	/* must be <= 65533 in any case */
 #endif
 
+/* Size of the buffer used to copy the compressed data. */
+
+#ifndef COPY_BUFFER_SIZE
+#define COPY_BUFFER_SIZE 16384
+#endif
+
 
 /*
  * These macros are used to read the input file and write the output file.
@@ -138,13 +154,31 @@ write_marker (int marker)
   PUTBYTE(marker);
 }
 
+static void
+write_fill_bytes (long count)
+/* Emit fill bytes, which may precede any marker */
+{
+  while (count > 0) {
+    PUTBYTE(0xFF);
+    count--;
+  }
+}
+
 static void
 copy_rest_of_file (void)
 {
-  int c;
+  char buffer[COPY_BUFFER_SIZE];
+  size_t nbytes;
 
-  while ((c = NEXTBYTE()) != EOF)
-    PUTBYTE(c);
+  /* There are no markers to look at beyond this point,
+   * so the data can be copied a block at a time.
+   */
+  while ((nbytes = JFREAD(infile, buffer, SIZEOF(buffer))) > 0) {
+    if (JFWRITE(outfile, buffer, nbytes) != nbytes)
+      ERREXIT("Error writing output file");
+  }
+  if (ferror(infile))
+    ERREXIT("Error reading JPEG file");
 }
 
 
@@ -183,6 +217,8 @@ copy_rest_of_file (void)
  * not deal correctly with FF/00 sequences in the compressed image data...
  */
 
+static int garbage_found;	/* set if next_marker skipped any garbage */
+
 static int
 next_marker (void)
 {
@@ -204,6 +240,7 @@ next_marker (void)
 
   if (discarded_bytes != 0) {
     fprintf(stderr, "Warning: garbage data found in JPEG file\n");
+    garbage_found = 1;
   }
 
   return c;
@@ -342,6 +379,109 @@ scan_JPEG_header (int keep_COM)
 }
 
 
+/*
+ * In-place update.
+ * We scan the header just as scan_JPEG_header does, but without writing
+ * anything, to find where the new COM marker would go: immediately ahead
+ * of the SOFn (or EOI) marker.  The bytes available there are the fill
+ * bytes preceding that marker plus, if old comments are being deleted, any
+ * directly preceding run of COM markers and fill bytes.  If the new marker
+ * fits, we overwrite that region with the COM marker followed by fill
+ * bytes, and overwrite any other deleted COM markers with fill bytes.
+ * The rest of the file is not touched.
+ */
+
+static long * com_spans;	/* start/end file offsets of COM markers */
+static int num_com_spans;
+static int max_com_spans;
+
+static void
+add_com_span (long start, long end)
+{
+  if (num_com_spans >= max_com_spans) {
+    max_com_spans = (max_com_spans == 0 ? 16 : max_com_spans * 2);
+    com_spans = (long *) realloc((void *) com_spans,
+				 (size_t) max_com_spans * 2 * SIZEOF(long));
+    if (com_spans == NULL)
+      ERREXIT("Insufficient memory");
+  }
+  com_spans[2*num_com_spans] = start;
+  com_spans[2*num_com_spans+1] = end;
+  num_com_spans++;
+}
+
+static int
+update_in_place (int keep_COM, char * comment, unsigned int comment_length)
+/* Returns 1 if done, 0 if there is not enough room for the comment */
+{
+  long seg_end;			/* end of previous marker segment */
+  long marker_start;		/* file offset of the FF before marker code */
+  long run_start = -1L;		/* start of deletable bytes before marker */
+  long room;
+  int marker, i;
+
+  if (first_marker() != M_SOI)
+    ERREXIT("Expected SOI marker first");
+  garbage_found = 0;
+  num_com_spans = 0;
+
+  for (;;) {
+    seg_end = ftell(infile);
+    marker = next_marker();
+    marker_start = ftell(infile) - 2L;
+    if (seg_end < 0L || garbage_found)
+      return 0;			/* play safe: do a normal rewrite */
+    if (marker == M_SOS)
+      ERREXIT("SOS without prior SOFn");
+    if ((marker >= M_SOF0 && marker <= M_SOF15 && marker != 0xC4 &&
+	 marker != 0xC8 && marker != 0xCC) || marker == M_EOI)
+      break;
+    if (marker == M_COM && ! keep_COM) {
+      skip_variable();
+      add_com_span(marker_start, ftell(infile));
+      if (run_start < 0L)
+	run_start = seg_end;
+    } else {
+      skip_variable();		/* we assume it has a parameter count... */
+      run_start = -1L;
+    }
+  }
+
+  /* Now marker_start is where the SOFn or EOI marker begins */
+  if (run_start < 0L)
+    run_start = seg_end;
+  room = marker_start - run_start;
+  if (comment_length > 0 && room < (long) comment_length + 4L)
+    return 0;
+
+  /* Blank out deleted comments that lie outside the rewritten region */
+  for (i = 0; i < num_com_spans; i++) {
+    if (com_spans[2*i] >= run_start)
+      break;
+    if (fseek(infile, com_spans[2*i], SEEK_SET) != 0)
+      ERREXIT("Cannot seek in JPEG file");
+    write_fill_bytes(com_spans[2*i+1] - com_spans[2*i]);
+  }
+
+  /* Rewrite the region in front of the SOFn marker */
+  if (fseek(infile, run_start, SEEK_SET) != 0)
+    ERREXIT("Cannot seek in JPEG file");
+  if (comment_length > 0) {
+    write_marker(M_COM);
+    write_2_bytes(comment_length + 2);
+    if (JFWRITE(outfile, comment, comment_length) != (size_t) comment_length)
+      ERREXIT("Error writing JPEG file");
+    room -= (long) comment_length + 4L;
+  }
+  write_fill_bytes(room);
+
+  fflush(outfile);
+  if (ferror(outfile))
+    ERREXIT("Error writing JPEG file");
+  return 1;
+}
+
+
 /* Command line parsing code */
 
 static const char * progname;	/* program name for error messages */
@@ -365,6 +505,8 @@ usage (void)
   fprintf(stderr, "  -replace         Delete any existing comments\n");
   fprintf(stderr, "  -comment \"text\"  Insert comment with given text\n");
   fprintf(stderr, "  -cfile name      Read comment from named file\n");
+  fprintf(stderr, "  -pad N           Leave room for N more bytes of comment\n");
+  fprintf(stderr, "  -inplace         Update the named file in place if possible\n");
   fprintf(stderr, "Notice that you must put quotes around the comment text\n");
   fprintf(stderr, "when you use -comment.\n");
   fprintf(stderr, "If you do not give either -comment or -cfile on the command line,\n");
@@ -419,6 +561,10 @@ main (int argc, char **argv)
   FILE * comment_file = NULL;
   unsigned int comment_length = 0;
   int marker;
+  int in_place = 0;
+  long pad_length = 0;
+  char * filename = NULL;
+  char * temp_filename = NULL;
 
   /* On Mac, fetch a command line. */
 #ifdef USE_CCOMMAND
@@ -437,6 +583,12 @@ main (int argc, char **argv)
     arg++;			/* advance over '-' */
     if (keymatch(arg, "replace", 1)) {
       keep_COM = 0;
+    } else if (keymatch(arg, "inplace", 1)) {
+      in_place = 1;
+    } else if (keymatch(arg, "pad", 1)) {
+      if (++argn >= argc) usage();
+      if (sscanf(argv[argn], "%ld", &pad_length) != 1 || pad_length < 0)
+	usage();
     } else if (keymatch(arg, "cfile", 2)) {
       if (++argn >= argc) usage();
       if ((comment_file = fopen(argv[argn], "r")) == NULL) {
@@ -479,9 +631,20 @@ main (int argc, char **argv)
    */
   if (comment_arg == NULL && comment_file == NULL && argn >= argc)
     usage();
+  /* In-place update needs exactly one file name. */
+  if (in_place && argn != argc-1)
+    usage();
 
   /* Open the input file. */
-  if (argn < argc) {
+  if (in_place) {
+    /* Infile and outfile are the same stream until we find we must copy */
+    filename = argv[argn];
+    if ((infile = fopen(filename, UPDATE_BINARY)) == NULL) {
+      fprintf(stderr, "%s: can't open %s\n", progname, filename);
+      exit(EXIT_FAILURE);
+    }
+    outfile = infile;
+  } else if (argn < argc) {
     if ((infile = fopen(argv[argn], READ_BINARY)) == NULL) {
       fprintf(stderr, "%s: can't open %s\n", progname, argv[argn]);
       exit(EXIT_FAILURE);
@@ -502,6 +665,9 @@ main (int argc, char **argv)
   }
 
   /* Open the output file. */
+  if (in_place) {
+    /* nothing to do yet */
+  } else {
 #ifdef TWO_FILE_COMMANDLINE
   /* Must have explicit output file name */
   if (argn != argc-2) {
@@ -532,6 +698,7 @@ main (int argc, char **argv)
   outfile = stdout;
 #endif
 #endif /* TWO_FILE_COMMANDLINE */
+  }
 
   /* Collect comment text from comment_file or stdin, if necessary */
   if (comment_arg == NULL) {
@@ -555,6 +722,27 @@ main (int argc, char **argv)
       fclose(comment_file);
   }
 
+  /* Try to store the comment without copying the file.  If that fails,
+   * write a new copy under a temporary name and then rename it.
+   */
+  if (in_place) {
+    if (update_in_place(keep_COM, comment_arg, comment_length)) {
+      fclose(infile);
+      exit(EXIT_SUCCESS);
+    }
+    if (fseek(infile, 0L, SEEK_SET) != 0)
+      ERREXIT("Cannot seek in JPEG file");
+    temp_filename = (char *) malloc(strlen(filename) + 5);
+    if (temp_filename == NULL)
+      ERREXIT("Insufficient memory");
+    strcpy(temp_filename, filename);
+    strcat(temp_filename, ".tmp");
+    if ((outfile = fopen(temp_filename, WRITE_BINARY)) == NULL) {
+      fprintf(stderr, "%s: can't open %s\n", progname, temp_filename);
+      exit(EXIT_FAILURE);
+    }
+  }
+
   /* Copy JPEG headers until SOFn marker;
    * we will insert the new comment marker just before SOFn.
    * This (a) causes the new comment to appear after, rather than before,
@@ -571,12 +759,33 @@ main (int argc, char **argv)
       comment_length--;
     }
   }
+  /* Leave room for a longer comment to be stored in place later */
+  write_fill_bytes(pad_length);
   /* Duplicate the remainder of the source file.
    * Note that any COM markers occuring after SOF will not be touched.
    */
   write_marker(marker);
   copy_rest_of_file();
 
+  if (temp_filename != NULL) {
+    /* Replace the original file by the new copy */
+    fclose(infile);
+    if (fclose(outfile) != 0)
+      ERREXIT("Error writing JPEG file");
+    if (rename(temp_filename, filename) != 0) {
+      /* Some systems won't rename onto an existing file */
+      if (remove(filename) != 0 || rename(temp_filename, filename) != 0) {
+	fprintf(stderr, "%s: can't rename %s to %s\n", progname,
+		temp_filename, filename);
+	exit(EXIT_FAILURE);
+      }
+    }
+  } else {
+    fflush(outfile);
+    if (ferror(outfile))
+      ERREXIT("Error writing output file");
+  }
+
   /* All done. */
   exit(EXIT_SUCCESS);
   return 0;			/* suppress no-return-value warnings */